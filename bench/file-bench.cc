@@ -0,0 +1,746 @@
+/**
+ * @file	file-bench.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ *
+ * Throughput and latency of the library's hot paths, written as JSON in the
+ * Google Benchmark layout so runs of two library versions can be compared
+ * with its tools/compare.py.
+ *
+ * jcu-file-bench [--filter=REGEX] [--min-time=SECONDS] [--max-entries=N]
+ *                [--dir=PATH] [--label=TEXT] [--json=PATH|-]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jcu-file/file-factory.h>
+#include <jcu-file/file-handler.h>
+#include <jcu-file/file-info.h>
+#include <jcu-file/path.h>
+#include <jcu-file/path-table.h>
+#include <jcu-file/temp-file-service.h>
+#ifndef _WIN32
+#include <jcu-file/directory-iterator.h>
+#endif
+
+using namespace jcu::file;
+
+namespace {
+
+/**
+ * Handed to a benchmark function. Only the iterations of the
+ * keepRunning() loop are timed, setup before and after it is not.
+ *
+ * while (state.keepRunning()) { ... }
+ */
+class State {
+ private:
+  typedef std::chrono::steady_clock clock_type;
+
+  int64_t iterations_;
+  int64_t remaining_;
+  bool started_;
+  bool running_;
+  clock_type::time_point start_;
+  clock_t cpu_start_;
+  clock_type::duration elapsed_;
+  clock_t cpu_elapsed_;
+  int64_t bytes_;
+  int64_t items_;
+  std::string error_;
+
+ public:
+  explicit State(int64_t iterations)
+      : iterations_(iterations), remaining_(iterations), started_(false), running_(false),
+        cpu_start_(0), elapsed_(0), cpu_elapsed_(0), bytes_(0), items_(0) {}
+
+  bool keepRunning() {
+    if (remaining_ > 0 && error_.empty()) {
+      if (!started_) {
+        started_ = true;
+        resumeTiming();
+      }
+      remaining_--;
+      return true;
+    }
+    if (running_)
+      pauseTiming();
+    return false;
+  }
+
+  void pauseTiming() {
+    elapsed_ += clock_type::now() - start_;
+    cpu_elapsed_ += clock() - cpu_start_;
+    running_ = false;
+  }
+
+  void resumeTiming() {
+    running_ = true;
+    cpu_start_ = clock();
+    start_ = clock_type::now();
+  }
+
+  int64_t iterations() const { return iterations_; }
+
+  void setBytesProcessed(int64_t bytes) { bytes_ = bytes; }
+  void setItemsProcessed(int64_t items) { items_ = items; }
+
+  /**
+   * Stop the loop and report the benchmark as failed
+   */
+  void skipWithError(const std::string &message) { error_ = message; }
+
+  double realSeconds() const { return std::chrono::duration<double>(elapsed_).count(); }
+  double cpuSeconds() const { return (double) cpu_elapsed_ / CLOCKS_PER_SEC; }
+  int64_t bytesProcessed() const { return bytes_; }
+  int64_t itemsProcessed() const { return items_; }
+  const std::string &error() const { return error_; }
+};
+
+struct Benchmark {
+  std::string name;
+  std::function<void(State &)> fn;
+};
+
+struct Run {
+  std::string name;
+  int64_t iterations;
+  double real_ns;
+  double cpu_ns;
+  double bytes_per_second;
+  double items_per_second;
+  std::string error;
+};
+
+struct Options {
+  std::string filter;
+  double min_time;
+  int64_t max_entries;
+  std::string directory;
+  std::string label;
+  std::string json;
+
+  Options()
+      : min_time(0.5), max_entries(1000000) {}
+};
+
+const int64_t MAX_ITERATIONS = 1000000000LL;
+
+/**
+ * Run with more iterations each time until the loop takes min_time,
+ * like Google Benchmark does
+ */
+Run runBenchmark(const Benchmark &bench, double min_time) {
+  Run run;
+  run.name = bench.name;
+  int64_t iterations = 1;
+  for (;;) {
+    State state(iterations);
+    bench.fn(state);
+    if (!state.error().empty()) {
+      run.iterations = 0;
+      run.real_ns = run.cpu_ns = run.bytes_per_second = run.items_per_second = 0;
+      run.error = state.error();
+      return run;
+    }
+    double seconds = state.realSeconds();
+    if (seconds >= min_time || iterations >= MAX_ITERATIONS) {
+      run.iterations = iterations;
+      run.real_ns = seconds * 1e9 / iterations;
+      run.cpu_ns = state.cpuSeconds() * 1e9 / iterations;
+      run.bytes_per_second = (seconds > 0) ? state.bytesProcessed() / seconds : 0;
+      run.items_per_second = (seconds > 0) ? state.itemsProcessed() / seconds : 0;
+      return run;
+    }
+    double multiplier = (seconds > min_time / 10) ? min_time * 1.4 / seconds : 10;
+    int64_t next = (int64_t) (iterations * multiplier);
+    if (next <= iterations)
+      next = iterations + 1;
+    iterations = (next < MAX_ITERATIONS) ? next : MAX_ITERATIONS;
+  }
+}
+
+std::string jsonString(const std::string &text) {
+  std::string out("\"");
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if ((unsigned char) c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char) c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+  return out;
+}
+
+void writeJson(FILE *out, const Options &options, const char *executable, const std::vector<Run> &runs) {
+  char date[64];
+  time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+  fprintf(out, "{\n  \"context\": {\n");
+  fprintf(out, "    \"date\": %s,\n", jsonString(date).c_str());
+  fprintf(out, "    \"executable\": %s,\n", jsonString(executable).c_str());
+  fprintf(out, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+  fprintf(out, "    \"library_build_type\": \"release\",\n");
+#else
+  fprintf(out, "    \"library_build_type\": \"debug\",\n");
+#endif
+  fprintf(out, "    \"directory\": %s,\n", jsonString(options.directory).c_str());
+  fprintf(out, "    \"label\": %s\n", jsonString(options.label).c_str());
+  fprintf(out, "  },\n  \"benchmarks\": [");
+  for (size_t i = 0; i < runs.size(); i++) {
+    const Run &run = runs[i];
+    fprintf(out, "%s\n    {\n", i ? "," : "");
+    fprintf(out, "      \"name\": %s,\n", jsonString(run.name).c_str());
+    fprintf(out, "      \"run_name\": %s,\n", jsonString(run.name).c_str());
+    fprintf(out, "      \"run_type\": \"iteration\",\n");
+    if (!run.error.empty()) {
+      fprintf(out, "      \"error_occurred\": true,\n");
+      fprintf(out, "      \"error_message\": %s\n    }", jsonString(run.error).c_str());
+      continue;
+    }
+    fprintf(out, "      \"iterations\": %lld,\n", (long long) run.iterations);
+    fprintf(out, "      \"real_time\": %.3f,\n", run.real_ns);
+    fprintf(out, "      \"cpu_time\": %.3f,\n", run.cpu_ns);
+    if (run.bytes_per_second > 0)
+      fprintf(out, "      \"bytes_per_second\": %.1f,\n", run.bytes_per_second);
+    if (run.items_per_second > 0)
+      fprintf(out, "      \"items_per_second\": %.1f,\n", run.items_per_second);
+    fprintf(out, "      \"time_unit\": \"ns\"\n    }");
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+void printRun(FILE *out, const Run &run) {
+  if (!run.error.empty()) {
+    fprintf(out, "%-40s ERROR: %s\n", run.name.c_str(), run.error.c_str());
+    return;
+  }
+  fprintf(out, "%-40s %12lld %14.1f", run.name.c_str(), (long long) run.iterations, run.real_ns);
+  if (run.bytes_per_second > 0)
+    fprintf(out, " %12.1f MB/s", run.bytes_per_second / (1024 * 1024));
+  else if (run.items_per_second > 0)
+    fprintf(out, " %12.3f M/s", run.items_per_second / 1e6);
+  fprintf(out, "\n");
+  fflush(out);
+}
+
+/**
+ * Scratch directory shared by all benchmarks. Fixtures that are slow to
+ * build, like the synthetic directories, are made once and kept.
+ */
+class Workspace {
+ private:
+  TempDirectory root_;
+  std::map<int64_t, Path> listings_;
+  int64_t unique_;
+
+ public:
+  Workspace()
+      : unique_(0) {}
+
+  int init(const std::string &directory) {
+    TempFileService service(directory.empty() ? Path() : Path::newFromUtf8(directory));
+    return service.createDirectory(root_, "jcu-file-bench");
+  }
+
+  const Path &root() const { return root_.path(); }
+
+  Path uniquePath(const char *prefix) {
+    return Path::join(root(), Path::newFromUtf8(prefix + std::to_string(unique_++)));
+  }
+
+  /**
+   * A file of the given size, created on first use
+   */
+  int dataFile(const char *name, int64_t size, Path &out) {
+    out = Path::join(root(), Path::newFromUtf8(name));
+    if (fs()->getFileSize(out) == size)
+      return 0;
+    std::unique_ptr<FileHandler> handler(fs()->createFileHandle(out));
+    int rc = handler->open(MODE_WRITE | MODE_CREATE);
+    if (rc)
+      return rc;
+    std::vector<char> buffer(1 << 20, 'x');
+    for (int64_t written = 0; written < size;) {
+      size_t length = (size_t) std::min<int64_t>(size - written, (int64_t) buffer.size());
+      int64_t n = handler->write64(buffer.data(), length);
+      if (n <= 0)
+        return n ? (int) -n : EIO;
+      written += n;
+    }
+    return handler->close();
+  }
+
+  /**
+   * A directory of entries empty files, created on first use
+   */
+  int listing(int64_t entries, Path &out) {
+    auto it = listings_.find(entries);
+    if (it != listings_.end()) {
+      out = it->second;
+      return 0;
+    }
+    Path dir = Path::join(root(), Path::newFromUtf8("listing-" + std::to_string(entries)));
+    int rc = fs()->makeDirectory(dir);
+    if (rc)
+      return rc;
+    for (int64_t i = 0; i < entries; i++) {
+      std::unique_ptr<FileHandler> handler(
+          fs()->createFileHandle(Path::join(dir, Path::newFromUtf8("entry-" + std::to_string(i)))));
+      rc = handler->open(MODE_WRITE | MODE_CREATE_NEW);
+      if (rc)
+        return rc;
+      handler->close();
+    }
+    listings_[entries] = dir;
+    out = dir;
+    return 0;
+  }
+};
+
+const int64_t IO_FILE_SIZE = 64LL << 20;
+
+std::string errorText(const char *what, int rc) {
+  return std::string(what) + ": " + strerror(rc);
+}
+
+void addIoBenchmarks(std::vector<Benchmark> &list, Workspace &workspace) {
+  static const size_t buffer_sizes[] = {4096, 65536, 1 << 20};
+  for (size_t buffer_size : buffer_sizes) {
+    const std::string suffix = "/" + std::to_string(buffer_size);
+
+    // cursor I/O over a file that is rewound, untimed, at its end
+    list.push_back({"io/write" + suffix, [&workspace, buffer_size](State &state) {
+      Path path;
+      int rc = workspace.dataFile("io-write", IO_FILE_SIZE, path);
+      std::unique_ptr<FileHandler> handler(fs()->createFileHandle(path));
+      if (rc == 0)
+        rc = handler->open(MODE_WRITE);
+      if (rc) {
+        state.skipWithError(errorText("open", rc));
+        return;
+      }
+      std::vector<char> buffer(buffer_size, 'w');
+      int64_t offset = 0;
+      while (state.keepRunning()) {
+        if (offset + (int64_t) buffer_size > IO_FILE_SIZE) {
+          state.pauseTiming();
+          handler->close();
+          handler->open(MODE_WRITE);
+          offset = 0;
+          state.resumeTiming();
+        }
+        if (handler->write(buffer.data(), (int) buffer_size) != (int) buffer_size) {
+          state.skipWithError("short write");
+          break;
+        }
+        offset += buffer_size;
+      }
+      state.setBytesProcessed(state.iterations() * (int64_t) buffer_size);
+    }});
+
+    list.push_back({"io/read" + suffix, [&workspace, buffer_size](State &state) {
+      Path path;
+      int rc = workspace.dataFile("io-read", IO_FILE_SIZE, path);
+      std::unique_ptr<FileHandler> handler(fs()->createFileHandle(path));
+      if (rc == 0)
+        rc = handler->open(MODE_READ | MODE_EXISTS);
+      if (rc) {
+        state.skipWithError(errorText("open", rc));
+        return;
+      }
+      std::vector<char> buffer(buffer_size);
+      int64_t offset = 0;
+      while (state.keepRunning()) {
+        if (offset + (int64_t) buffer_size > IO_FILE_SIZE) {
+          state.pauseTiming();
+          handler->close();
+          handler->open(MODE_READ | MODE_EXISTS);
+          offset = 0;
+          state.resumeTiming();
+        }
+        if (handler->read(buffer.data(), (int) buffer_size) != (int) buffer_size) {
+          state.skipWithError("short read");
+          break;
+        }
+        offset += buffer_size;
+      }
+      state.setBytesProcessed(state.iterations() * (int64_t) buffer_size);
+    }});
+
+    list.push_back({"io/readAt" + suffix, [&workspace, buffer_size](State &state) {
+      Path path;
+      int rc = workspace.dataFile("io-read", IO_FILE_SIZE, path);
+      std::unique_ptr<FileHandler> handler(fs()->createFileHandle(path));
+      if (rc == 0)
+        rc = handler->open(MODE_READ | MODE_EXISTS);
+      if (rc) {
+        state.skipWithError(errorText("open", rc));
+        return;
+      }
+      std::vector<char> buffer(buffer_size);
+      const int64_t slots = IO_FILE_SIZE / (int64_t) buffer_size;
+      int64_t slot = 0;
+      while (state.keepRunning()) {
+        if (handler->readAt(buffer.data(), buffer_size, slot * (int64_t) buffer_size) != (int64_t) buffer_size) {
+          state.skipWithError("short read");
+          break;
+        }
+        if (++slot == slots)
+          slot = 0;
+      }
+      state.setBytesProcessed(state.iterations() * (int64_t) buffer_size);
+    }});
+  }
+}
+
+void addReaddirBenchmarks(std::vector<Benchmark> &list, Workspace &workspace, int64_t max_entries) {
+  static const int64_t entry_counts[] = {10, 1000, 100000, 1000000};
+  for (int64_t entries : entry_counts) {
+    if (entries > max_entries)
+      break;
+    const std::string suffix = "/" + std::to_string(entries);
+
+    list.push_back({"readdir/list" + suffix, [&workspace, entries](State &state) {
+      Path dir;
+      int rc = workspace.listing(entries, dir);
+      if (rc) {
+        state.skipWithError(errorText("listing", rc));
+        return;
+      }
+      while (state.keepRunning()) {
+        std::list<Path> names;
+        rc = fs()->readdir(names, dir);
+        if (rc || (int64_t) names.size() != entries) {
+          state.skipWithError("readdir");
+          break;
+        }
+      }
+      state.setItemsProcessed(state.iterations() * entries);
+    }});
+
+    list.push_back({"readdir/table" + suffix, [&workspace, entries](State &state) {
+      Path dir;
+      int rc = workspace.listing(entries, dir);
+      if (rc) {
+        state.skipWithError(errorText("listing", rc));
+        return;
+      }
+      while (state.keepRunning()) {
+        PathTable table;
+        rc = fs()->readdir(table, table.add(dir));
+        if (rc) {
+          state.skipWithError(errorText("readdir", rc));
+          break;
+        }
+      }
+      state.setItemsProcessed(state.iterations() * entries);
+    }});
+
+#ifndef _WIN32
+    list.push_back({"readdir/iterator" + suffix, [&workspace, entries](State &state) {
+      Path dir;
+      int rc = workspace.listing(entries, dir);
+      if (rc) {
+        state.skipWithError(errorText("listing", rc));
+        return;
+      }
+      while (state.keepRunning()) {
+        DirectoryIterator iter;
+        rc = iter.open(dir);
+        int64_t count = 0;
+        for (const DirectoryEntry &entry : iter) {
+          count += entry.name().length() ? 1 : 0;
+        }
+        if (rc || count != entries) {
+          state.skipWithError("readdir");
+          break;
+        }
+      }
+      state.setItemsProcessed(state.iterations() * entries);
+    }});
+#endif
+  }
+}
+
+void addPathBenchmarks(std::vector<Benchmark> &list) {
+  static const char *const base_text = "/var/lib/jcu-file/spool/incoming";
+
+  list.push_back({"path/newFromUtf8", [](State &state) {
+    const std::string text = std::string(base_text) + "/entry-name-0.dat";
+    size_t sink = 0;
+    while (state.keepRunning()) {
+      Path path = Path::newFromUtf8(text);
+      sink += path.getSystemString().length();
+    }
+    state.setItemsProcessed(sink ? state.iterations() : 0);
+  }});
+
+  list.push_back({"path/join", [](State &state) {
+    const Path base = Path::newFromUtf8(base_text);
+    const Path name = Path::newFromUtf8("entry-name-0.dat");
+    size_t sink = 0;
+    while (state.keepRunning()) {
+      Path joined = Path::join(base, name);
+      sink += joined.getSystemString().length();
+    }
+    state.setItemsProcessed(sink ? state.iterations() : 0);
+  }});
+
+  list.push_back({"path/parent", [](State &state) {
+    const Path path = Path::newFromUtf8(std::string(base_text) + "/entry-name-0.dat");
+    size_t sink = 0;
+    while (state.keepRunning()) {
+      Path dir = path.parent();
+      sink += dir.getSystemString().length();
+    }
+    state.setItemsProcessed(sink ? state.iterations() : 0);
+  }});
+
+  list.push_back({"path/toUtf8", [](State &state) {
+    const Path path = Path::newFromUtf8(std::string(base_text) + "/entry-name-0.dat");
+    size_t sink = 0;
+    while (state.keepRunning()) {
+      sink += path.toUtf8().length();
+    }
+    state.setItemsProcessed(sink ? state.iterations() : 0);
+  }});
+}
+
+void addMetadataBenchmarks(std::vector<Benchmark> &list, Workspace &workspace) {
+  struct Targets {
+    Path file;
+    Path directory;
+    Path missing;
+  };
+  struct Case {
+    const char *name;
+    bool (*call)(const Targets &targets);
+  };
+  static const Case cases[] = {
+      {"metadata/stat", [](const Targets &targets) {
+        FileInfo info;
+        return fs()->stat(targets.file, info) == 0;
+      }},
+      {"metadata/lstat", [](const Targets &targets) {
+        FileInfo info;
+        return fs()->stat(targets.file, info, false) == 0;
+      }},
+      {"metadata/stat_missing", [](const Targets &targets) {
+        FileInfo info;
+        return fs()->stat(targets.missing, info) == ENOENT;
+      }},
+      {"metadata/getFileSize", [](const Targets &targets) {
+        return fs()->getFileSize(targets.file) == 4096;
+      }},
+      {"metadata/isFile", [](const Targets &targets) {
+        return fs()->isFile(targets.file);
+      }},
+      {"metadata/isDirectory", [](const Targets &targets) {
+        return fs()->isDirectory(targets.directory);
+      }},
+  };
+  for (const Case &entry : cases) {
+    const Case *c = &entry;
+    list.push_back({c->name, [&workspace, c](State &state) {
+      Targets targets;
+      int rc = workspace.dataFile("metadata", 4096, targets.file);
+      if (rc) {
+        state.skipWithError(errorText("create", rc));
+        return;
+      }
+      targets.directory = workspace.root();
+      targets.missing = Path::join(workspace.root(), Path::newFromUtf8("metadata-missing"));
+      while (state.keepRunning()) {
+        if (!c->call(targets)) {
+          state.skipWithError("unexpected result");
+          break;
+        }
+      }
+      state.setItemsProcessed(state.iterations());
+    }});
+  }
+}
+
+void addMakeDirectoryBenchmarks(std::vector<Benchmark> &list, Workspace &workspace) {
+  static const int depths[] = {1, 4, 16};
+  for (int depth : depths) {
+    std::string tail;
+    for (int i = 0; i < depth; i++) {
+      tail += (i ? "/d" : "d") + std::to_string(i);
+    }
+    const Path relative = Path::newFromUtf8(tail);
+
+    // every iteration creates the whole chain under a new top directory
+    list.push_back({"makeDirectory/recursive/depth:" + std::to_string(depth), [&workspace, relative](State &state) {
+      std::vector<Path> paths;
+      paths.reserve((size_t) state.iterations());
+      for (int64_t i = 0; i < state.iterations(); i++) {
+        paths.emplace_back(Path::join(workspace.uniquePath("mkdir-"), relative));
+      }
+      size_t next = 0;
+      while (state.keepRunning()) {
+        int rc = fs()->makeDirectory(paths[next++], true);
+        if (rc) {
+          state.skipWithError(errorText("makeDirectory", rc));
+          break;
+        }
+      }
+      state.setItemsProcessed(state.iterations());
+    }});
+
+    list.push_back({"makeDirectory/existing/depth:" + std::to_string(depth), [&workspace, relative](State &state) {
+      const Path path = Path::join(workspace.root(), Path::join(Path::newFromUtf8("mkdir-existing"), relative));
+      int rc = fs()->makeDirectory(path, true);
+      if (rc) {
+        state.skipWithError(errorText("makeDirectory", rc));
+        return;
+      }
+      while (state.keepRunning()) {
+        rc = fs()->makeDirectory(path, true);
+        if (rc) {
+          state.skipWithError(errorText("makeDirectory", rc));
+          break;
+        }
+      }
+      state.setItemsProcessed(state.iterations());
+    }});
+  }
+}
+
+void addCommitBenchmarks(std::vector<Benchmark> &list, Workspace &workspace) {
+  struct Case {
+    const char *name;
+    int flags;
+  };
+  // replacing the same target every iteration
+  static const Case cases[] = {
+      {"commit/direct/4096", MODE_WRITE | MODE_CREATE},
+      {"commit/use_tempname/4096", MODE_WRITE | MODE_CREATE | USE_TEMPNAME | REMOVE_IF_EXISTS},
+      {"commit/atomic_replace_nosync/4096", MODE_WRITE | MODE_CREATE | ATOMIC_REPLACE | NO_SYNC_DATA | NO_SYNC_DIRECTORY},
+      {"commit/atomic_replace/4096", MODE_WRITE | MODE_CREATE | ATOMIC_REPLACE},
+  };
+  for (const Case &entry : cases) {
+    const Case *c = &entry;
+    list.push_back({c->name, [&workspace, c](State &state) {
+      const Path path = Path::join(workspace.root(), Path::newFromUtf8("commit-target"));
+      std::vector<char> buffer(4096, 'c');
+      while (state.keepRunning()) {
+        std::unique_ptr<FileHandler> handler(fs()->createFileHandle(path));
+        int rc = handler->open(c->flags);
+        if (rc == 0 && handler->write(buffer.data(), (int) buffer.size()) != (int) buffer.size())
+          rc = EIO;
+        if (rc == 0)
+          rc = handler->commit();
+        handler->close();
+        if (rc) {
+          state.skipWithError(errorText("commit", rc));
+          break;
+        }
+      }
+      state.setItemsProcessed(state.iterations());
+    }});
+  }
+}
+
+bool parseOption(const char *arg, const char *name, std::string &value) {
+  size_t length = strlen(name);
+  if (strncmp(arg, name, length) != 0 || arg[length] != '=')
+    return false;
+  value = arg + length + 1;
+  return true;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string value;
+    if (parseOption(argv[i], "--filter", value)) {
+      options.filter = value;
+    } else if (parseOption(argv[i], "--min-time", value)) {
+      options.min_time = atof(value.c_str());
+    } else if (parseOption(argv[i], "--max-entries", value)) {
+      options.max_entries = atoll(value.c_str());
+    } else if (parseOption(argv[i], "--dir", value)) {
+      options.directory = value;
+    } else if (parseOption(argv[i], "--label", value)) {
+      options.label = value;
+    } else if (parseOption(argv[i], "--json", value)) {
+      options.json = value;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--filter=REGEX] [--min-time=SECONDS] [--max-entries=N]\n"
+              "       [--dir=PATH] [--label=TEXT] [--json=PATH|-]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  Workspace workspace;
+  int rc = workspace.init(options.directory);
+  if (rc) {
+    fprintf(stderr, "scratch directory: %s\n", strerror(rc));
+    return 1;
+  }
+  options.directory = workspace.root().parent().toUtf8();
+
+  std::vector<Benchmark> benchmarks;
+  addIoBenchmarks(benchmarks, workspace);
+  addReaddirBenchmarks(benchmarks, workspace, options.max_entries);
+  addPathBenchmarks(benchmarks);
+  addMetadataBenchmarks(benchmarks, workspace);
+  addMakeDirectoryBenchmarks(benchmarks, workspace);
+  addCommitBenchmarks(benchmarks, workspace);
+
+  std::regex filter(options.filter.empty() ? "." : options.filter);
+  // the table goes to stderr when the JSON is written to stdout
+  FILE *table = (options.json == "-") ? stderr : stdout;
+  fprintf(table, "%-40s %12s %14s %17s\n", "benchmark", "iterations", "ns/op", "throughput");
+  std::vector<Run> runs;
+  bool failed = false;
+  for (const Benchmark &bench : benchmarks) {
+    if (!std::regex_search(bench.name, filter))
+      continue;
+    runs.push_back(runBenchmark(bench, options.min_time));
+    printRun(table, runs.back());
+    failed |= !runs.back().error.empty();
+  }
+
+  if (!options.json.empty()) {
+    FILE *out = (options.json == "-") ? stdout : fopen(options.json.c_str(), "w");
+    if (!out) {
+      fprintf(stderr, "%s: %s\n", options.json.c_str(), strerror(errno));
+      return 1;
+    }
+    writeJson(out, options, argv[0], runs);
+    if (out != stdout)
+      fclose(out);
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file	path-bench.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ *
+ * Counts heap allocations and time per join for Path::join against PathBuilder.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <jcu-file/path.h>
+
+static std::atomic<uint64_t> g_allocations(0);
+
+void *operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+using namespace jcu::file;
+
+namespace {
+
+struct Result {
+  double allocations_per_join;
+  double ns_per_join;
+};
+
+template<typename Fn>
+Result measure(int iterations, Fn fn) {
+  uint64_t start_allocations = g_allocations.load();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    fn(i);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  Result result;
+  result.allocations_per_join = (double) (g_allocations.load() - start_allocations) / iterations;
+  result.ns_per_join = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / iterations;
+  return result;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  const int iterations = (argc > 1) ? atoi(argv[1]) : 1000000;
+  const Path base = Path::newFromUtf8("/var/lib/jcu-file/spool/incoming");
+  std::vector<Path> names;
+  for (int i = 0; i < 256; i++) {
+    names.emplace_back(Path::newFromUtf8("entry-name-" + std::to_string(i) + ".dat"));
+  }
+  size_t sink = 0;
+
+  Result join = measure(iterations, [&](int i) {
+    Path joined = Path::join(base, names[i & 255]);
+    sink += joined.getSystemString().length();
+  });
+
+  PathBuilder builder(base);
+  builder.reserve(256);
+  const size_t mark = builder.length();
+  Result build = measure(iterations, [&](int i) {
+    builder.truncate(mark);
+    builder.append(names[i & 255]);
+    sink += builder.view().length();
+  });
+
+  Result parent = measure(iterations, [&](int i) {
+    Path joined = Path::join(base, names[i & 255]);
+    Path dir = joined.parent();
+    sink += dir.getSystemString().length();
+  });
+
+  printf("%-24s %12s %12s\n", "case", "allocs/op", "ns/op");
+  printf("%-24s %12.2f %12.1f\n", "Path::join", join.allocations_per_join, join.ns_per_join);
+  printf("%-24s %12.2f %12.1f\n", "PathBuilder::append", build.allocations_per_join, build.ns_per_join);
+  printf("%-24s %12.2f %12.1f\n", "Path::join + parent", parent.allocations_per_join, parent.ns_per_join);
+  return sink == 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file	aligned-buffer-pool.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_ALIGNED_BUFFER_POOL_H__
+#define __JCU_FILE_ALIGNED_BUFFER_POOL_H__
+
+#include <stddef.h>
+
+#include <memory>
+
+namespace jcu {
+namespace file {
+
+class AlignedBufferPool;
+
+/**
+ * An aligned buffer borrowed from an AlignedBufferPool. It goes back to
+ * the pool when destroyed, and may outlive the pool itself.
+ */
+class AlignedBuffer {
+ public:
+  struct PoolState;
+
+ private:
+  std::shared_ptr<PoolState> pool_;
+  void *data_;
+  size_t size_;
+
+  friend class AlignedBufferPool;
+  AlignedBuffer(std::shared_ptr<PoolState> pool, void *data, size_t size);
+
+ public:
+  AlignedBuffer();
+  AlignedBuffer(AlignedBuffer &&other) noexcept;
+  AlignedBuffer &operator=(AlignedBuffer &&other) noexcept;
+  AlignedBuffer(const AlignedBuffer &) = delete;
+  AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+  ~AlignedBuffer();
+
+  void *data() const { return data_; }
+  size_t size() const { return size_; }
+  explicit operator bool() const { return data_ != NULL; }
+
+  /**
+   * Return the buffer to the pool now
+   */
+  void release();
+};
+
+/**
+ * Reusable buffers that satisfy MODE_DIRECT alignment, so direct I/O does
+ * not pay for an aligned allocation per request.
+ *
+ * AlignedBufferPool pool(1 << 20, handler->getAlignment());
+ * AlignedBuffer buffer = pool.acquire();
+ * handler->readAt(buffer.data(), buffer.size(), 0);
+ *
+ * Thread-safe.
+ */
+class AlignedBufferPool {
+ private:
+  std::shared_ptr<AlignedBuffer::PoolState> state_;
+
+ public:
+  /**
+   * @param buffer_size rounded up to a multiple of alignment
+   * @param alignment power of two
+   * @param max_cached released buffers kept for reuse, more are freed
+   */
+  AlignedBufferPool(size_t buffer_size, size_t alignment = 4096, size_t max_cached = 16);
+  ~AlignedBufferPool();
+
+  /**
+   * @return a buffer, empty when the allocation failed
+   */
+  AlignedBuffer acquire();
+
+  size_t bufferSize() const;
+  size_t alignment() const;
+
+  /**
+   * Free the cached buffers
+   */
+  void trim();
+};
+
+}
+}
+
+#endif //__JCU_FILE_ALIGNED_BUFFER_POOL_H__
@@ -0,0 +1,136 @@
+/**
+ * @file	async-file-engine.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_ASYNC_FILE_ENGINE_H__
+#define __JCU_FILE_ASYNC_FILE_ENGINE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "file-handler.h"
+
+namespace jcu {
+namespace file {
+
+enum AsyncEngineType {
+  ASYNC_ENGINE_AUTO = 0,
+  ASYNC_ENGINE_IO_URING = 1,
+  ASYNC_ENGINE_THREAD_POOL = 2,
+};
+
+struct AsyncEngineOptions {
+  AsyncEngineType type;
+  // submission queue size; a batch is submitted automatically when it fills up
+  unsigned int queue_depth;
+  // worker threads of the thread pool engine, 0 for hardware concurrency
+  int threads;
+
+  AsyncEngineOptions()
+      : type(ASYNC_ENGINE_AUTO), queue_depth(256), threads(0) {}
+};
+
+/**
+ * Completion callback.
+ * result is the transferred bytes (or 0 for open/close/sync), or a negative error code.
+ */
+typedef std::function<void(int64_t result)> AsyncCallback;
+
+/**
+ * Batched asynchronous file operations.
+ *
+ * Operations are queued and handed to the kernel (or to the worker threads)
+ * together on submit(). Callbacks run on an engine thread. Handlers and
+ * buffers must stay alive until their completion has been delivered.
+ *
+ * Reads and writes may complete in any order. sync() and close() are
+ * barriers: they start once every operation queued before them has
+ * completed, and operations queued after them wait for them.
+ */
+class AsyncFileEngine {
+ public:
+  virtual ~AsyncFileEngine() {}
+
+  /**
+   * Create an engine. ASYNC_ENGINE_AUTO uses io_uring when available and
+   * falls back to a thread pool otherwise.
+   *
+   * @param options
+   * @param perr
+   * @return engine, or NULL on error
+   */
+  static std::unique_ptr<AsyncFileEngine> create(const AsyncEngineOptions &options = AsyncEngineOptions(), int *perr = NULL);
+
+  virtual AsyncEngineType type() const = 0;
+
+  /**
+   * Queue a positional read
+   *
+   * @return 0 or error code
+   */
+  virtual int readAt(FileHandler &handler, void *buf, size_t size, int64_t offset, AsyncCallback callback) = 0;
+
+  /**
+   * Queue a positional write
+   *
+   * @return 0 or error code
+   */
+  virtual int writeAt(FileHandler &handler, const void *buf, size_t size, int64_t offset, AsyncCallback callback) = 0;
+
+  /**
+   * Queue FileHandler::sync, after the operations queued before it
+   *
+   * @return 0 or error code
+   */
+  virtual int sync(FileHandler &handler, bool data_only, AsyncCallback callback) = 0;
+
+  /**
+   * Queue FileHandler::open. The handler is open once the callback reports 0.
+   *
+   * @return 0 or error code
+   */
+  virtual int open(FileHandler &handler, int flags, AsyncCallback callback) = 0;
+
+  /**
+   * Queue FileHandler::close, after the operations queued before it
+   *
+   * @return 0 or error code
+   */
+  virtual int close(FileHandler &handler, AsyncCallback callback) = 0;
+
+  /**
+   * Submit all queued operations with a single call
+   *
+   * @return 0 or error code
+   */
+  virtual int submit() = 0;
+
+  /**
+   * Submit and wait until every operation has completed
+   */
+  virtual void drain() = 0;
+
+  /*
+   * Future flavours of the calls above. The future holds the callback result
+   * (or the negated queue error) and becomes ready after submit().
+   */
+  std::future<int64_t> readAt(FileHandler &handler, void *buf, size_t size, int64_t offset);
+  std::future<int64_t> writeAt(FileHandler &handler, const void *buf, size_t size, int64_t offset);
+  std::future<int64_t> sync(FileHandler &handler, bool data_only);
+  std::future<int64_t> open(FileHandler &handler, int flags);
+  std::future<int64_t> close(FileHandler &handler);
+};
+
+}
+}
+
+#endif //__JCU_FILE_ASYNC_FILE_ENGINE_H__
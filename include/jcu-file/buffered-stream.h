@@ -0,0 +1,133 @@
+/**
+ * @file	buffered-stream.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_BUFFERED_STREAM_H__
+#define __JCU_FILE_BUFFERED_STREAM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "file-handler.h"
+
+namespace jcu {
+namespace file {
+
+/**
+ * Read buffer over an opened FileHandler.
+ * The handler is not owned and must outlive the reader.
+ */
+class BufferedReader {
+ private:
+  FileHandler &handler_;
+  std::vector<unsigned char> buffer_;
+  size_t pos_;
+  size_t end_;
+  bool eof_;
+
+  int64_t fill();
+
+ public:
+  BufferedReader(FileHandler &handler, size_t buffer_size = 65536);
+
+  /**
+   * Read up to size bytes. Requests larger than the buffer bypass it
+   * once the buffered bytes are consumed.
+   *
+   * @param buf
+   * @param size
+   * @return read bytes, 0 at end of file, or negative error code
+   */
+  int64_t read(void *buf, size_t size);
+
+  /**
+   * Read exactly size bytes unless the end of file comes first
+   *
+   * @param buf
+   * @param size
+   * @return read bytes (less than size only at end of file), or negative error code
+   */
+  int64_t readExact(void *buf, size_t size);
+
+  /**
+   * Look at the next bytes without consuming them
+   *
+   * @param data set to the buffered bytes
+   * @param size wanted bytes, at most the buffer size
+   * @return available bytes (less than size only at end of file), or negative error code
+   */
+  int64_t peek(const void **data, size_t size);
+
+  /**
+   * Read one line. The line terminator ("\n" or "\r\n") is not stored.
+   *
+   * @param line
+   * @return consumed bytes including the terminator, 0 at end of file, or negative error code
+   */
+  int64_t readLine(std::string &line);
+
+  size_t bufferSize() const;
+};
+
+/**
+ * Write buffer over an opened FileHandler.
+ * The handler is not owned and must outlive the writer.
+ * Buffered data is flushed on destruction.
+ */
+class BufferedWriter {
+ private:
+  FileHandler &handler_;
+  std::vector<unsigned char> buffer_;
+  size_t used_;
+
+  int64_t writeThrough(const unsigned char *data, size_t size);
+
+ public:
+  BufferedWriter(FileHandler &handler, size_t buffer_size = 65536);
+  ~BufferedWriter();
+
+  /**
+   * Write size bytes. Requests larger than the buffer bypass it.
+   *
+   * @param buf
+   * @param size
+   * @return size, or negative error code
+   */
+  int64_t write(const void *buf, size_t size);
+
+  /**
+   * Write the buffered bytes to the handler
+   *
+   * @return 0 or error code
+   */
+  int flush();
+
+  /**
+   * Flush and close the handler
+   *
+   * @return 0 or error code
+   */
+  int close();
+
+  /**
+   * Flush, close and commit the handler (see FileHandler::commit)
+   *
+   * @return 0 or error code
+   */
+  int commit();
+
+  size_t bufferSize() const;
+};
+
+}
+}
+
+#endif //__JCU_FILE_BUFFERED_STREAM_H__
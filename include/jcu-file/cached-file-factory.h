@@ -0,0 +1,80 @@
+/**
+ * @file	cached-file-factory.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_CACHED_FILE_FACTORY_H__
+#define __JCU_FILE_CACHED_FILE_FACTORY_H__
+
+#include <chrono>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "file-factory.h"
+
+namespace jcu {
+namespace file {
+
+/**
+ * FileFactory decorator that remembers stat() results (including failures)
+ * for a fixed time. isFile, isDirectory, isDevice and getFileSize are
+ * answered from the same cache.
+ *
+ * Changes made through this factory's makeDirectory, copyFile and moveFile
+ * are invalidated automatically (a moved directory with everything below
+ * it); anything else (writes through a handler, other processes) is seen
+ * after the TTL or after invalidate().
+ */
+class CachedFileFactory : public FileFactory {
+ private:
+  struct Entry {
+    int err;
+    FileInfo info;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  FileFactory *inner_;
+  std::chrono::steady_clock::duration ttl_;
+  size_t max_entries_;
+  mutable std::shared_mutex mutex_;
+  mutable std::unordered_map<Path::system_string_t, Entry> cache_;
+
+  int cachedStat(const Path &path, FileInfo &info) const;
+  // drop `path` and everything below it, mutex_ held
+  void eraseTree(const Path &path) const;
+
+ public:
+  /**
+   * @param inner not owned, must outlive this factory
+   * @param ttl
+   * @param max_entries expired entries are purged once the cache holds this many
+   */
+  CachedFileFactory(FileFactory *inner, std::chrono::milliseconds ttl, size_t max_entries = 65536);
+
+  void invalidate(const Path &path);
+  void invalidateAll();
+
+  std::unique_ptr<FileHandler> createFileHandle(const Path &file_path) const override;
+  int makeDirectory(const Path &path, bool recursive = false) const override;
+  int makeDirectories(const std::vector<Path> &paths, int threads = 1) const override;
+  Path getTempDir(int *perr = NULL) const override;
+  Path generateTempPath(const char *prefix, int *perr = NULL) const override;
+  bool isFile(const Path &path) const override;
+  bool isDirectory(const Path &path) const override;
+  bool isDevice(const Path &path) const override;
+  int readdir(std::list<Path> &out, const Path &path) const override;
+  int readdir(PathTable &table, PathTable::Id dir) const override;
+  int64_t getFileSize(const Path& path) const override;
+  int stat(const Path &path, FileInfo &info, bool follow_symlinks = true) const override;
+  int copyFile(const Path &src, const Path &dst, int flags = 0) const override;
+  int moveFile(const Path &src, const Path &dst, int flags = 0) const override;
+};
+
+}
+}
+
+#endif //__JCU_FILE_CACHED_FILE_FACTORY_H__
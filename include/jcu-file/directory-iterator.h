@@ -0,0 +1,151 @@
+/**
+ * @file	directory-iterator.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_DIRECTORY_ITERATOR_H__
+#define __JCU_FILE_DIRECTORY_ITERATOR_H__
+
+// POSIX only: built on getdents64 / readdir; there is no FindFirstFileEx backend
+#ifndef _WIN32
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+#include "file-type.h"
+#include "path.h"
+
+namespace jcu {
+namespace file {
+
+/**
+ * One directory entry. The name view is only valid until the iterator advances.
+ */
+class DirectoryEntry {
+ private:
+  const char *name_;
+  size_t name_length_;
+  FileType type_;
+  uint64_t inode_;
+
+  friend class DirectoryIterator;
+
+ public:
+  DirectoryEntry()
+      : name_(""), name_length_(0), type_(FILE_TYPE_UNKNOWN), inode_(0) {}
+
+  std::string_view name() const { return std::string_view(name_, name_length_); }
+  const char *c_name() const { return name_; }
+
+  /**
+   * Type as reported by the directory listing.
+   * FILE_TYPE_UNKNOWN on filesystems that do not report it.
+   */
+  FileType type() const { return type_; }
+  uint64_t inode() const { return inode_; }
+};
+
+/**
+ * Streaming directory reader. Entries are decoded in place from one
+ * reusable buffer; "." and ".." are skipped.
+ *
+ * for (const DirectoryEntry &entry : iter) { ... }
+ *
+ * POSIX only; the class is not declared on Windows.
+ */
+class DirectoryIterator {
+ private:
+  int fd_;
+  void *dir_;
+  std::vector<char> buffer_;
+  size_t pos_;
+  size_t end_;
+  int error_;
+  DirectoryEntry entry_;
+
+  bool fill();
+
+ public:
+  class iterator {
+   private:
+    DirectoryIterator *owner_;
+
+   public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef DirectoryEntry value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const DirectoryEntry *pointer;
+    typedef const DirectoryEntry &reference;
+
+    iterator(DirectoryIterator *owner = NULL)
+        : owner_(owner) {}
+    reference operator*() const { return owner_->entry_; }
+    pointer operator->() const { return &owner_->entry_; }
+    iterator &operator++() {
+      if (!owner_->next())
+        owner_ = NULL;
+      return *this;
+    }
+    bool operator==(const iterator &other) const { return owner_ == other.owner_; }
+    bool operator!=(const iterator &other) const { return owner_ != other.owner_; }
+  };
+
+  DirectoryIterator();
+  DirectoryIterator(DirectoryIterator &&obj);
+  DirectoryIterator &operator=(DirectoryIterator &&obj);
+  DirectoryIterator(const DirectoryIterator &) = delete;
+  DirectoryIterator &operator=(const DirectoryIterator &) = delete;
+  ~DirectoryIterator();
+
+  /**
+   * Open the directory
+   *
+   * @param path
+   * @param buffer_size bytes of directory entries fetched per system call
+   * @return 0 or error code
+   */
+  int open(const Path &path, size_t buffer_size = 131072);
+
+  /**
+   * Take over an opened directory descriptor
+   *
+   * @param fd closed by the iterator
+   * @param buffer_size bytes of directory entries fetched per system call
+   * @return 0 or error code
+   */
+  int openFd(int fd, size_t buffer_size = 131072);
+
+  void close();
+
+  /**
+   * Advance to the next entry
+   *
+   * @return false at the end of the directory or on error
+   */
+  bool next();
+
+  const DirectoryEntry &entry() const;
+
+  /**
+   * @return the error that stopped the iteration, 0 at a normal end
+   */
+  int error() const;
+
+  iterator begin();
+  iterator end();
+};
+
+}
+}
+
+#endif //_WIN32
+
+#endif //__JCU_FILE_DIRECTORY_ITERATOR_H__
@@ -0,0 +1,127 @@
+/**
+ * @file	directory.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_DIRECTORY_H__
+#define __JCU_FILE_DIRECTORY_H__
+
+// POSIX only: there is no *at family to build it on in Win32
+#ifndef _WIN32
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+
+#include "directory-iterator.h"
+#include "file-handler.h"
+#include "file-info.h"
+#include "path.h"
+
+namespace jcu {
+namespace file {
+
+/**
+ * An open directory. Names passed to its methods are relative to it and
+ * resolved with the *at system calls, so the kernel does not walk the
+ * directory's own path again on every call.
+ *
+ * Directory dir;
+ * dir.open(path);
+ * dir.stat(Path::newFromUtf8("a.txt"), info);
+ *
+ * POSIX only; the class is not declared on Windows.
+ */
+class Directory {
+ private:
+  int fd_;
+  Path path_;
+
+  std::string childPath(const Path &name) const;
+
+ public:
+  Directory();
+  Directory(Directory &&obj) noexcept;
+  Directory &operator=(Directory &&obj) noexcept;
+  Directory(const Directory &) = delete;
+  Directory &operator=(const Directory &) = delete;
+  ~Directory();
+
+  /**
+   * @param path
+   * @return 0 or error code
+   */
+  int open(const Path &path);
+
+  /**
+   * Open a subdirectory
+   *
+   * @param name relative path
+   * @param out
+   * @return 0 or error code
+   */
+  int openDirectory(const Path &name, Directory &out) const;
+
+  void close();
+  bool isOpen() const;
+  int fd() const;
+  const Path &path() const;
+
+  /**
+   * Open a file in the directory, same flags as FileHandler::open
+   *
+   * @param name relative path
+   * @param flags
+   * @param out the open handler
+   * @return 0 or error code
+   */
+  int openFile(const Path &name, int flags, std::unique_ptr<FileHandler> &out) const;
+
+  int stat(const Path &name, FileInfo &info, bool follow_symlinks = true) const;
+
+  /**
+   * @return 0 or error code, EEXIST when it already exists
+   */
+  int makeDirectory(const Path &name) const;
+
+  /**
+   * Remove a file or symlink
+   */
+  int unlink(const Path &name) const;
+
+  /**
+   * Remove an empty directory
+   */
+  int removeDirectory(const Path &name) const;
+
+  /**
+   * Rename within this directory
+   */
+  int rename(const Path &name, const Path &new_name) const;
+
+  /**
+   * Move to another open directory on the same filesystem
+   */
+  int rename(const Path &name, const Directory &new_dir, const Path &new_name) const;
+
+  /**
+   * Start listing the directory
+   *
+   * @param iter
+   * @param buffer_size see DirectoryIterator::open
+   * @return 0 or error code
+   */
+  int list(DirectoryIterator &iter, size_t buffer_size = 131072) const;
+};
+
+}
+}
+
+#endif //_WIN32
+
+#endif //__JCU_FILE_DIRECTORY_H__
@@ -0,0 +1,139 @@
+/**
+ * @file	durability-batch.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_DURABILITY_BATCH_H__
+#define __JCU_FILE_DURABILITY_BATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "async-file-engine.h"
+#include "file-handler.h"
+#include "path.h"
+
+namespace jcu {
+namespace file {
+
+/**
+ * Makes many files and directories durable together.
+ *
+ * flush() starts writeback of every file first (sync_file_range on Linux),
+ * then waits for them with fdatasync/fsync from several threads, and
+ * finally syncs each distinct directory once. Handlers must stay open
+ * until flush() returns.
+ */
+class DurabilityBatch {
+ private:
+  struct FileItem {
+    FileHandler *handler;
+    bool data_only;
+    AsyncCallback callback;
+  };
+  struct DirectoryItem {
+    Path path;
+    AsyncCallback callback;
+  };
+
+  int threads_;
+  std::vector<FileItem> files_;
+  std::vector<DirectoryItem> directories_;
+
+ public:
+  /**
+   * @param threads sync threads, 0 for hardware concurrency
+   */
+  DurabilityBatch(int threads = 0);
+
+  /**
+   * @param handler open handler
+   * @param data_only fdatasync instead of fsync
+   * @param callback optional, called from flush() with 0 or a negative error code
+   */
+  void add(FileHandler &handler, bool data_only = true, AsyncCallback callback = nullptr);
+
+  /**
+   * Sync a directory so that new, renamed or removed entries are durable.
+   * The same directory added several times is synced once.
+   */
+  void addDirectory(const Path &path, AsyncCallback callback = nullptr);
+
+  size_t size() const;
+  bool empty() const;
+  void clear();
+
+  /**
+   * Sync everything added so far and empty the batch
+   *
+   * @return 0, or the first error encountered
+   */
+  int flush();
+};
+
+struct SyncSchedulerOptions {
+  // commit at the latest this long after the first pending request
+  std::chrono::milliseconds max_delay;
+  // commit as soon as this many requests are pending
+  size_t max_pending;
+  // sync threads per commit, 0 for hardware concurrency
+  int threads;
+
+  SyncSchedulerOptions()
+      : max_delay(5), max_pending(1024), threads(0) {}
+};
+
+/**
+ * Background group commit.
+ *
+ * Requests are collected into a DurabilityBatch that a background thread
+ * flushes when it is old or big enough. Callbacks run on that thread.
+ * Handlers must stay open until their callback has run.
+ */
+class SyncScheduler {
+ private:
+  SyncSchedulerOptions options_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  DurabilityBatch pending_;
+  std::chrono::steady_clock::time_point first_pending_;
+  uint64_t submitted_;
+  uint64_t completed_;
+  bool flush_requested_;
+  bool stop_;
+  std::thread thread_;
+
+  void threadMain();
+
+ public:
+  SyncScheduler(const SyncSchedulerOptions &options = SyncSchedulerOptions());
+
+  /**
+   * Flushes what is pending and stops the background thread
+   */
+  ~SyncScheduler();
+
+  void submit(FileHandler &handler, bool data_only = true, AsyncCallback callback = nullptr);
+  void submitDirectory(const Path &path, AsyncCallback callback = nullptr);
+
+  /**
+   * Commit everything submitted so far now and wait for it
+   */
+  void flush();
+};
+
+}
+}
+
+#endif //__JCU_FILE_DURABILITY_BATCH_H__
@@ -0,0 +1,60 @@
+/**
+ * @file	extent-iterator.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_EXTENT_ITERATOR_H__
+#define __JCU_FILE_EXTENT_ITERATOR_H__
+
+#include <stdint.h>
+
+#include "file-handler.h"
+
+namespace jcu {
+namespace file {
+
+struct FileExtent {
+  int64_t offset;
+  int64_t length;
+};
+
+/**
+ * Walks the data extents of a file and skips its holes, so sparse files
+ * can be read or copied without reading zeros:
+ *
+ * ExtentIterator iter(handler);
+ * while (iter.next()) { readAt(..., iter.extent().offset); }
+ */
+class ExtentIterator {
+ private:
+  FileHandler *handler_;
+  int64_t pos_;
+  int64_t end_;
+  FileExtent extent_;
+  int error_;
+
+ public:
+  /**
+   * @param handler open handler
+   * @param offset first byte of interest
+   * @param end end of the range, -1 for the current file size
+   */
+  ExtentIterator(FileHandler &handler, int64_t offset = 0, int64_t end = -1);
+
+  /**
+   * @return false at the end or on error
+   */
+  bool next();
+
+  const FileExtent &extent() const;
+  int error() const;
+};
+
+}
+}
+
+#endif //__JCU_FILE_EXTENT_ITERATOR_H__
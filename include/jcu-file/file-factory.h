@@ -13,19 +13,45 @@
 #include <memory>
 #include <list>
 #include <string>
+#include <vector>
 
 #include "file-handler.h"
+#include "file-info.h"
 #include "path.h"
+#include "path-table.h"
 
 namespace jcu {
 namespace file {
 
+enum CopyFlag {
+  // replace an existing destination
+  COPY_OVERWRITE = 0x00000001,
+  // copy permissions, owner (when permitted) and timestamps
+  COPY_PRESERVE_METADATA = 0x00000002,
+  // always copy the data, never share extents with the source
+  COPY_NO_REFLINK = 0x00000004,
+  // split large files into chunks copied by several threads
+  COPY_PARALLEL = 0x00000008,
+};
+
 class FileFactory {
  public:
+  virtual ~FileFactory() {}
+
   virtual std::unique_ptr<FileHandler> createFileHandle(const Path &file_path) const = 0;
 
   virtual int makeDirectory(const Path &path, bool recursive = false) const = 0;
 
+  /**
+   * Create many directories and their missing parents; prefixes shared by
+   * several paths are created once
+   *
+   * @param paths
+   * @param threads 1 to create serially, 0 for hardware concurrency
+   * @return 0 or the first error
+   */
+  virtual int makeDirectories(const std::vector<Path> &paths, int threads = 1) const = 0;
+
   virtual Path getTempDir(int *perr = NULL) const = 0;
   virtual Path generateTempPath(const char *prefix, int *perr = NULL) const = 0;
 
@@ -34,7 +60,48 @@ class FileFactory {
   virtual bool isDevice(const Path &path) const = 0;
   virtual int readdir(std::list<Path> &out, const Path &path) const = 0;
 
+  /**
+   * List a directory straight into a path table
+   *
+   * @param table
+   * @param dir id of the directory in the table; its children are added under it
+   * @return 0 or error code
+   */
+  virtual int readdir(PathTable &table, PathTable::Id dir) const = 0;
+
   virtual int64_t getFileSize(const Path& path) const = 0;
+
+  /**
+   * Get type, size, times, identity and permissions with one call
+   *
+   * @param path
+   * @param info
+   * @param follow_symlinks describe the link target instead of the link
+   * @return 0 or error code
+   */
+  virtual int stat(const Path &path, FileInfo &info, bool follow_symlinks = true) const = 0;
+
+  /**
+   * Copy a regular file without passing the data through user space where
+   * possible: reflink, then in-kernel copy, then a buffered loop. Holes in
+   * sparse files are kept.
+   *
+   * @param src
+   * @param dst
+   * @param flags CopyFlag
+   * @return 0 or error code
+   */
+  virtual int copyFile(const Path &src, const Path &dst, int flags = 0) const = 0;
+
+  /**
+   * Rename, or copy and remove the source when it is on another device
+   *
+   * @param src
+   * @param dst
+   * @param flags CopyFlag; COPY_OVERWRITE replaces an existing destination
+   * @return 0 or error code
+   */
+  virtual int moveFile(const Path &src, const Path &dst, int flags = 0) const = 0;
 };
 
 extern FileFactory *fs();
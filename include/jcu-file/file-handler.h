@@ -10,6 +10,7 @@
 #ifndef __JCU_FILE_HANDLER_H__
 #define __JCU_FILE_HANDLER_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "path.h"
@@ -22,14 +23,63 @@ enum Flag {
   MODE_WRITE = 0x00000002,
   MODE_CREATE = 0x00000010,
   MODE_EXISTS = 0x00000020,
+  // Bypass the page cache (O_DIRECT / FILE_FLAG_NO_BUFFERING). Buffers,
+  // offsets and sizes must be multiples of getAlignment(). When the
+  // filesystem refuses direct I/O the file is opened cached; see isDirect().
+  MODE_DIRECT = 0x00000040,
+  // Create the file and fail with EEXIST when it already exists (O_EXCL)
+  MODE_CREATE_NEW = 0x00000080,
   SHARE_READ = 0x00000100,
   RENAME_IF_EXISTS = 0x00010000,
   REMOVE_IF_EXISTS = 0x00020000,
   USE_TEMPNAME = 0x00040000,
+  // Write to an anonymous temp file (O_TMPFILE where available) and replace
+  // the target atomically on commit(). The data is synced before the file
+  // is published and the parent directory is synced after. Uncommitted data
+  // is discarded when the handler is destroyed. RENAME_IF_EXISTS keeps the
+  // previous file under getOldName().
+  ATOMIC_REPLACE = 0x00080000,
+  // ATOMIC_REPLACE: skip the data sync before publishing
+  NO_SYNC_DATA = 0x00100000,
+  // ATOMIC_REPLACE: skip the parent directory sync after publishing
+  NO_SYNC_DIRECTORY = 0x00200000,
+  // Access pattern hints applied at open, see FileHandler::advise()
+  HINT_SEQUENTIAL = 0x00400000,
+  HINT_RANDOM = 0x00800000,
+  // Watch read()/read64()/readv() for sequential runs and prefetch a window
+  // ahead of the cursor that doubles while the run lasts. Positional reads
+  // are not tracked.
+  ADAPTIVE_READAHEAD = 0x01000000,
+  // Drop pages behind the cursor from the page cache while reading, so
+  // streaming a large file once does not evict everything else
+  DROP_BEHIND = 0x02000000,
+};
+
+enum AccessPattern {
+  ACCESS_NORMAL = 0,
+  // larger readahead
+  ACCESS_SEQUENTIAL,
+  // no readahead
+  ACCESS_RANDOM,
+  // start reading the range into the cache
+  ACCESS_WILLNEED,
+  // the range will not be read again soon, drop it from the cache
+  ACCESS_DONTNEED,
+};
+
+/**
+ * One buffer of a scatter-gather request.
+ * Same layout as struct iovec on POSIX.
+ */
+struct IoVec {
+  void *base;
+  size_t length;
 };
 
 class FileHandler {
  public:
+  virtual ~FileHandler() {}
+
   /**
    * Open the file
    *
@@ -56,6 +106,160 @@ class FileHandler {
    */
   virtual int write(const void *buf, int size) = 0;
 
+  /**
+   * Read from file at the given offset without using the file cursor.
+   * Safe to call from multiple threads on the same handle.
+   *
+   * @param buf
+   * @param size
+   * @param offset
+   * @return read bytes, or negative error code
+   */
+  virtual int64_t readAt(void *buf, size_t size, int64_t offset) = 0;
+
+  /**
+   * Write to file at the given offset without using the file cursor.
+   * Safe to call from multiple threads on the same handle.
+   *
+   * @param buf
+   * @param size
+   * @param offset
+   * @return written bytes, or negative error code
+   */
+  virtual int64_t writeAt(const void *buf, size_t size, int64_t offset) = 0;
+
+  /**
+   * Read from file, size is not limited to int
+   *
+   * @param buf
+   * @param size
+   * @return read bytes, or negative error code
+   */
+  virtual int64_t read64(void *buf, size_t size) = 0;
+
+  /**
+   * Write to file, size is not limited to int
+   *
+   * @param buf
+   * @param size
+   * @return written bytes, or negative error code
+   */
+  virtual int64_t write64(const void *buf, size_t size) = 0;
+
+  /**
+   * Read from file into several buffers with one call
+   *
+   * @param iov
+   * @param count
+   * @return read bytes, or negative error code
+   */
+  virtual int64_t readv(const IoVec *iov, int count) = 0;
+
+  /**
+   * Write several buffers to file with one call
+   *
+   * @param iov
+   * @param count
+   * @return written bytes, or negative error code
+   */
+  virtual int64_t writev(const IoVec *iov, int count) = 0;
+
+  /**
+   * Read into several buffers at the given offset without using the file cursor
+   *
+   * @param iov
+   * @param count
+   * @param offset
+   * @return read bytes, or negative error code
+   */
+  virtual int64_t readvAt(const IoVec *iov, int count, int64_t offset) = 0;
+
+  /**
+   * Write several buffers at the given offset without using the file cursor
+   *
+   * @param iov
+   * @param count
+   * @param offset
+   * @return written bytes, or negative error code
+   */
+  virtual int64_t writevAt(const IoVec *iov, int count, int64_t offset) = 0;
+
+  /**
+   * Flush written data to the storage device
+   *
+   * @param data_only skip metadata that is not needed to read the data back
+   * @return 0 or error code
+   */
+  virtual int sync(bool data_only = false) = 0;
+
+  /**
+   * Reserve disk space for a range so that later writes cannot fail for
+   * lack of space and the file is laid out contiguously
+   *
+   * @param offset
+   * @param length
+   * @param keep_size do not change the file size when the range goes past the end
+   * @return 0 or error code
+   */
+  virtual int allocate(int64_t offset, int64_t length, bool keep_size = false) = 0;
+
+  /**
+   * Release the storage of a range; it reads back as zeros and the size is unchanged
+   *
+   * @param offset
+   * @param length
+   * @return 0 or error code
+   */
+  virtual int punchHole(int64_t offset, int64_t length) = 0;
+
+  /**
+   * Zero a range, preferably without writing the zeros
+   *
+   * @param offset
+   * @param length
+   * @return 0 or error code
+   */
+  virtual int zeroRange(int64_t offset, int64_t length) = 0;
+
+  /**
+   * Set the file size
+   *
+   * @param size
+   * @return 0 or error code
+   */
+  virtual int truncate(int64_t size) = 0;
+
+  /**
+   * Find the first data extent at or after offset.
+   * Filesystems that do not track holes report the rest of the file as one extent.
+   *
+   * @param offset
+   * @param data_offset start of the data
+   * @param data_length length up to the next hole, 0 when there is no more data
+   * @return 0 or error code
+   */
+  virtual int nextExtent(int64_t offset, int64_t &data_offset, int64_t &data_length) = 0;
+
+  /**
+   * Tell the system how a range is going to be accessed. Only a hint: the
+   * call may do nothing where the system has no such interface.
+   *
+   * @param offset
+   * @param length 0 for up to the end of the file
+   * @param pattern
+   * @return 0 or error code
+   */
+  virtual int advise(int64_t offset, int64_t length, AccessPattern pattern) = 0;
+
+  /**
+   * Start reading a range into the page cache without waiting for it
+   *
+   * @param offset
+   * @param length
+   * @return 0 or error code
+   */
+  virtual int prefetch(int64_t offset, int64_t length) = 0;
+
   /**
    * remove temp file to real name
    *
@@ -74,6 +278,18 @@ class FileHandler {
 
   virtual Path getOldName() const = 0;
 
+  /**
+   * @return true when the file was opened with MODE_DIRECT and the filesystem accepted it
+   */
+  virtual bool isDirect() const = 0;
+
+  /**
+   * Alignment required for buffers, offsets and sizes
+   *
+   * @return the device's logical block alignment for direct I/O, 1 otherwise
+   */
+  virtual size_t getAlignment() const = 0;
+
   /**
    * get file size from filesystem
    *
@@ -0,0 +1,179 @@
+/**
+ * @file	file-hasher.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_FILE_HASHER_H__
+#define __JCU_FILE_FILE_HASHER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "file-handler.h"
+#include "file-factory.h"
+#include "path.h"
+
+namespace jcu {
+namespace file {
+
+enum HashAlgorithm {
+  // Castagnoli CRC, 4 bytes big-endian
+  HASH_CRC32C = 0,
+  // XXH3 64-bit with seed 0, 8 bytes big-endian as printed by xxhsum
+  HASH_XXH3_64,
+  HASH_SHA256,
+};
+
+struct HashValue {
+  HashAlgorithm algorithm;
+  size_t size;
+  uint8_t bytes[32];
+
+  HashValue();
+
+  /**
+   * @return lowercase hex of bytes
+   */
+  std::string toHex() const;
+
+  /**
+   * Parse toHex() output
+   *
+   * @return false when hex is not a valid digest of the algorithm
+   */
+  static bool fromHex(HashAlgorithm algorithm, const std::string &hex, HashValue &out);
+
+  bool operator==(const HashValue &other) const;
+  bool operator!=(const HashValue &other) const;
+};
+
+/**
+ * Incremental hash. The fastest implementation the CPU supports is chosen
+ * once per process: SSE4.2 for CRC32C, AVX2 for XXH3 and the SHA
+ * extensions for SHA-256, with portable code as the fallback.
+ *
+ * Hasher hasher(HASH_SHA256);
+ * hasher.update(data, size);
+ * HashValue value = hasher.digest();
+ */
+class Hasher {
+ private:
+  struct Xxh3State {
+    uint64_t acc[8];
+    uint8_t buffer[256];
+    size_t buffered;
+    size_t stripes;
+  };
+  struct Sha256State {
+    uint32_t h[8];
+    uint8_t buffer[64];
+    size_t buffered;
+  };
+
+  HashAlgorithm algorithm_;
+  uint64_t total_;
+  uint32_t crc_;
+  Xxh3State xxh3_;
+  Sha256State sha256_;
+
+ public:
+  explicit Hasher(HashAlgorithm algorithm);
+
+  HashAlgorithm algorithm() const { return algorithm_; }
+
+  void reset();
+  void update(const void *data, size_t size);
+
+  /**
+   * @return hash of everything passed to update() so far; more data may follow
+   */
+  HashValue digest() const;
+
+  /**
+   * Name of the implementation chosen for this CPU, e.g. "sse4.2"
+   */
+  static const char *kernelName(HashAlgorithm algorithm);
+
+  /**
+   * CRC32C of a followed by b, from the CRC32C of each part
+   *
+   * @param crc_a
+   * @param crc_b
+   * @param length_b size of b in bytes
+   */
+  static uint32_t crc32cCombine(uint32_t crc_a, uint32_t crc_b, uint64_t length_b);
+};
+
+struct FileHasherOptions {
+  // size of each of the two read buffers
+  size_t buffer_size;
+  // threads for parallel hashing, 0 for one per CPU
+  int threads;
+  // CRC32C files at least this large are hashed in parallel chunks
+  int64_t parallel_threshold;
+  // bytes hashed by one thread at a time in parallel mode
+  int64_t chunk_size;
+
+  FileHasherOptions()
+      : buffer_size(1 << 20), threads(0), parallel_threshold(64LL << 20), chunk_size(16LL << 20) {}
+};
+
+/**
+ * Hashes whole files. One buffer is read while the other is hashed, so the
+ * disk and the CPU work at the same time. CRC32C values of separate chunks
+ * can be combined, so large files are split across threads for it; XXH3
+ * and SHA-256 have to consume the file in order.
+ */
+class FileHasher {
+ private:
+  HashAlgorithm algorithm_;
+  FileHasherOptions options_;
+
+  int hashSequential(FileHandler &handler, HashValue &out) const;
+  int hashParallel(FileHandler &handler, int64_t size, HashValue &out) const;
+
+ public:
+  explicit FileHasher(HashAlgorithm algorithm, const FileHasherOptions &options = FileHasherOptions());
+
+  HashAlgorithm algorithm() const { return algorithm_; }
+
+  /**
+   * Hash the content of an open file with readAt(), the cursor is not moved
+   *
+   * @param handler opened with MODE_READ
+   * @param out
+   * @return 0 or error code
+   */
+  int hash(FileHandler &handler, HashValue &out) const;
+
+  /**
+   * @param path
+   * @param out
+   * @param factory NULL for fs()
+   * @return 0 or error code
+   */
+  int hash(const Path &path, HashValue &out, FileFactory *factory = NULL) const;
+
+  /**
+   * Hash what was written to a USE_TEMPNAME or ATOMIC_REPLACE handler and
+   * commit() only when it matches, so a corrupted write never replaces the
+   * target. Call it instead of commit(), before close(); the handler must
+   * be opened with MODE_READ | MODE_WRITE.
+   *
+   * @param handler
+   * @param expected
+   * @return 0, EBADMSG when the content does not match, or error code
+   */
+  int commitVerified(FileHandler &handler, const HashValue &expected) const;
+};
+
+}
+}
+
+#endif //__JCU_FILE_FILE_HASHER_H__
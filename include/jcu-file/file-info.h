@@ -0,0 +1,43 @@
+/**
+ * @file	file-info.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_FILE_INFO_H__
+#define __JCU_FILE_FILE_INFO_H__
+
+#include <stdint.h>
+
+#include "file-type.h"
+
+namespace jcu {
+namespace file {
+
+struct FileInfo {
+  FileType type;
+  int64_t size;
+  // nanoseconds since the unix epoch
+  int64_t mtime_ns;
+  int64_t ctime_ns;
+  uint64_t inode;
+  uint64_t device;
+  // permission bits (07777)
+  uint32_t permissions;
+  uint64_t link_count;
+
+  FileInfo()
+      : type(FILE_TYPE_UNKNOWN), size(0), mtime_ns(0), ctime_ns(0), inode(0), device(0), permissions(0), link_count(0) {}
+
+  bool isFile() const { return type != FILE_TYPE_DIRECTORY && type != FILE_TYPE_BLOCK_DEVICE && type != FILE_TYPE_CHAR_DEVICE; }
+  bool isDirectory() const { return type == FILE_TYPE_DIRECTORY; }
+  bool isDevice() const { return type == FILE_TYPE_BLOCK_DEVICE || type == FILE_TYPE_CHAR_DEVICE; }
+};
+
+}
+}
+
+#endif //__JCU_FILE_FILE_INFO_H__
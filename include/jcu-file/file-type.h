@@ -0,0 +1,30 @@
+/**
+ * @file	file-type.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_FILE_TYPE_H__
+#define __JCU_FILE_FILE_TYPE_H__
+
+namespace jcu {
+namespace file {
+
+enum FileType {
+  FILE_TYPE_UNKNOWN = 0,
+  FILE_TYPE_REGULAR = 1,
+  FILE_TYPE_DIRECTORY = 2,
+  FILE_TYPE_SYMLINK = 3,
+  FILE_TYPE_BLOCK_DEVICE = 4,
+  FILE_TYPE_CHAR_DEVICE = 5,
+  FILE_TYPE_FIFO = 6,
+  FILE_TYPE_SOCKET = 7,
+};
+
+}
+}
+
+#endif //__JCU_FILE_FILE_TYPE_H__
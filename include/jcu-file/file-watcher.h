@@ -0,0 +1,172 @@
+/**
+ * @file	file-watcher.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_FILE_WATCHER_H__
+#define __JCU_FILE_FILE_WATCHER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "path.h"
+#include "path-set.h"
+
+namespace jcu {
+namespace file {
+
+enum WatchEventFlag {
+  WATCH_CREATED = 0x0001,
+  WATCH_DELETED = 0x0002,
+  WATCH_MODIFIED = 0x0004,
+  WATCH_ATTRIBUTES = 0x0008,
+  WATCH_MOVED_FROM = 0x0010,
+  WATCH_MOVED_TO = 0x0020,
+  // a writer closed the file
+  WATCH_CLOSED_WRITE = 0x0040,
+  // events were lost; path is a watched root that has to be rescanned
+  WATCH_OVERFLOW = 0x0080,
+};
+
+/**
+ * Everything that happened to one path within a coalescing window
+ */
+struct WatchEvent {
+  Path path;
+  // WatchEventFlag bits
+  int events;
+  bool is_directory;
+};
+
+typedef std::function<void(const std::vector<WatchEvent> &events)> WatchCallback;
+
+struct FileWatcherOptions {
+  // events for the same path within this window are merged into one
+  std::chrono::milliseconds coalesce_window;
+  // deliver early once this many paths are pending
+  size_t max_pending;
+
+  FileWatcherOptions()
+      : coalesce_window(50), max_pending(4096) {}
+};
+
+/**
+ * Watches files and directories with inotify.
+ *
+ * Events are merged per path and delivered in batches, either to a
+ * callback running on a background thread (start()) or through a pollable
+ * descriptor (fd() and readEvents()). A file created and deleted within
+ * one window is not reported. Recursive watches follow directories
+ * created later. When the kernel queue overflows, each affected root is
+ * reported once with WATCH_OVERFLOW and its subdirectory watches are
+ * re-synced, so only those trees need to be rescanned.
+ *
+ * Linux only; add() returns ENOSYS elsewhere.
+ */
+class FileWatcher {
+ private:
+  struct Watch {
+    Path path;
+    Path root;
+    bool recursive;
+  };
+  struct Pending {
+    int events;
+    bool is_directory;
+  };
+
+  FileWatcherOptions options_;
+  int inotify_fd_;
+  int epoll_fd_;
+  int timer_fd_;
+  int stop_fd_;
+  int init_error_;
+
+  std::mutex mutex_;
+  std::unordered_map<int, Watch> watches_;
+  PathMap<int> watch_ids_;
+  PathMap<bool> roots_;
+  PathMap<Pending> pending_;
+  std::chrono::steady_clock::time_point first_pending_;
+  bool timer_armed_;
+
+  WatchCallback callback_;
+  std::thread thread_;
+  bool running_;
+
+  int addWatch(const Path &path, const Path &root, bool recursive, bool report_existing);
+  void removeWatch(int wd);
+  void queue(const Path &path, int events, bool is_directory);
+  void handleOverflow();
+  int drain();
+  void takeBatch(std::vector<WatchEvent> &out, bool force);
+  void armTimer();
+  void threadMain();
+
+ public:
+  FileWatcher(const FileWatcherOptions &options = FileWatcherOptions());
+
+  /**
+   * Stops the callback thread; pending events are dropped
+   */
+  ~FileWatcher();
+
+  /**
+   * Watch a file or a directory
+   *
+   * @param path
+   * @param recursive also watch every subdirectory, including ones created later
+   * @return 0 or error code
+   */
+  int add(const Path &path, bool recursive = false);
+
+  /**
+   * Stop watching a path added with add(), and its subdirectories
+   *
+   * @return 0 or error code
+   */
+  int remove(const Path &path);
+
+  /**
+   * Deliver batches to a callback on a background thread
+   *
+   * @return 0 or error code
+   */
+  int start(WatchCallback callback);
+
+  /**
+   * Stop the callback thread
+   */
+  void stop();
+
+  /**
+   * Descriptor that becomes readable when readEvents() has work to do;
+   * for use with poll/epoll when start() is not used
+   */
+  int fd() const;
+
+  /**
+   * Collect a batch
+   *
+   * @param out receives the batch, empty while the window is still open
+   * @param timeout_ms how long to wait for a batch, 0 to return at once, -1 to wait forever
+   * @return 0 or error code
+   */
+  int readEvents(std::vector<WatchEvent> &out, int timeout_ms = 0);
+};
+
+}
+}
+
+#endif //__JCU_FILE_FILE_WATCHER_H__
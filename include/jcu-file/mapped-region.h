@@ -0,0 +1,133 @@
+/**
+ * @file	mapped-region.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_MAPPED_REGION_H__
+#define __JCU_FILE_MAPPED_REGION_H__
+
+// POSIX only: built on mmap; there is no MapViewOfFile backend
+#ifndef _WIN32
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "file-handler.h"
+#include "path.h"
+
+namespace jcu {
+namespace file {
+
+enum MapMode {
+  MAP_MODE_READ_ONLY = 1,
+  MAP_MODE_READ_WRITE = 2,
+  // writable, but changes are never written back to the file
+  MAP_MODE_PRIVATE = 3,
+};
+
+enum MapAdvice {
+  MAP_ADVICE_NORMAL = 0,
+  MAP_ADVICE_SEQUENTIAL = 1,
+  MAP_ADVICE_RANDOM = 2,
+  MAP_ADVICE_WILLNEED = 3,
+  MAP_ADVICE_HUGEPAGE = 4,
+};
+
+/**
+ * Memory-mapped view of a file window.
+ * The view is unmapped when the object is destroyed.
+ *
+ * POSIX only; the class is not declared on Windows.
+ */
+class MappedRegion {
+ private:
+  void *base_;
+  size_t base_size_;
+  unsigned char *data_;
+  size_t size_;
+  int64_t offset_;
+  MapMode mode_;
+
+  int mapFd(int fd, MapMode mode, int64_t offset, int64_t length);
+
+ public:
+  MappedRegion();
+  MappedRegion(MappedRegion &&obj);
+  MappedRegion &operator=(MappedRegion &&obj);
+  MappedRegion(const MappedRegion &) = delete;
+  MappedRegion &operator=(const MappedRegion &) = delete;
+  ~MappedRegion();
+
+  /**
+   * Map a window of an opened file
+   *
+   * @param handler opened file, must be opened with access matching mode
+   * @param mode
+   * @param offset file offset of the window, need not be page aligned
+   * @param length window length, -1 maps up to the end of file.
+   *               A read-only window past the end of file is rejected; a
+   *               writable one is mapped, but touching its pages past the
+   *               end of file raises SIGBUS until the file is extended.
+   * @return 0 or error code, EINVAL for an empty window or a read-only window past the end of file
+   */
+  int map(FileHandler &handler, MapMode mode, int64_t offset = 0, int64_t length = -1);
+
+  /**
+   * Map a window of a file by path.
+   * The file descriptor is released after mapping.
+   *
+   * @param path
+   * @param mode
+   * @param offset file offset of the window, need not be page aligned
+   * @param length window length, -1 maps up to the end of file.
+   *               A read-only window past the end of file is rejected; a
+   *               writable one is mapped, but touching its pages past the
+   *               end of file raises SIGBUS until the file is extended.
+   * @return 0 or error code, EINVAL for an empty window or a read-only window past the end of file
+   */
+  int map(const Path &path, MapMode mode, int64_t offset = 0, int64_t length = -1);
+
+  /**
+   * Unmap the window. Modified pages of a MAP_MODE_READ_WRITE mapping are
+   * written back by the kernel later; call flush() first for durability.
+   *
+   * @return 0 or error code
+   */
+  int unmap();
+
+  /**
+   * Give the kernel an access pattern hint for part of the window
+   *
+   * @param advice
+   * @param offset relative to the window
+   * @param length -1 means up to the end of the window
+   * @return 0 or error code
+   */
+  int advise(MapAdvice advice, size_t offset = 0, int64_t length = -1);
+
+  /**
+   * Write modified pages back to the file
+   *
+   * @param async schedule writeback and return without waiting
+   * @return 0 or error code
+   */
+  int flush(bool async = false);
+
+  bool isMapped() const;
+  void *data();
+  const void *data() const;
+  size_t size() const;
+  int64_t offset() const;
+  MapMode mode() const;
+};
+
+}
+}
+
+#endif //_WIN32
+
+#endif //__JCU_FILE_MAPPED_REGION_H__
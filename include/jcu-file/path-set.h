@@ -0,0 +1,282 @@
+/**
+ * @file	path-set.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_PATH_SET_H__
+#define __JCU_FILE_PATH_SET_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include "path.h"
+
+namespace jcu {
+namespace file {
+
+namespace detail {
+
+/**
+ * Open-addressing index over a dense entry vector.
+ *
+ * Slots hold a 32-bit hash tag and the entry index, so probing touches one
+ * small array and only compares paths whose tags match. Paths cache their
+ * own hash, which makes rehashing cheap. Erase moves the last entry into
+ * the hole and shifts the probe run back, so there are no tombstones.
+ */
+template <typename Entry, typename KeyOf>
+class FlatPathIndex {
+ public:
+  static constexpr size_t npos = (size_t) -1;
+
+ private:
+  struct Slot {
+    uint32_t tag;
+    // entry index + 1, 0 for an empty slot
+    uint32_t index;
+  };
+
+  std::vector<Entry> entries_;
+  std::vector<Slot> slots_;
+
+  static uint32_t tagOf(size_t hash) {
+    return (uint32_t) (((uint64_t) hash) ^ (((uint64_t) hash) >> 32));
+  }
+
+  size_t home(size_t hash) const {
+    // Fibonacci hashing spreads std::hash values that differ only in low bits
+    return (size_t) ((((uint64_t) hash) * 0x9e3779b97f4a7c15ULL) >> 32) & (slots_.size() - 1);
+  }
+
+  size_t findSlot(const Path &key, size_t hash) const {
+    if (slots_.empty())
+      return npos;
+    size_t mask = slots_.size() - 1;
+    uint32_t tag = tagOf(hash);
+    for (size_t i = home(hash);; i = (i + 1) & mask) {
+      const Slot &slot = slots_[i];
+      if (!slot.index)
+        return npos;
+      if (slot.tag == tag && KeyOf::key(entries_[slot.index - 1]) == key)
+        return i;
+    }
+  }
+
+  void place(size_t hash, uint32_t index) {
+    size_t mask = slots_.size() - 1;
+    size_t i = home(hash);
+    while (slots_[i].index)
+      i = (i + 1) & mask;
+    slots_[i].tag = tagOf(hash);
+    slots_[i].index = index + 1;
+  }
+
+  void rehash(size_t slot_count) {
+    slots_.assign(slot_count, Slot{0, 0});
+    for (size_t i = 0; i < entries_.size(); i++) {
+      place(KeyOf::key(entries_[i]).hash(), (uint32_t) i);
+    }
+  }
+
+  void growFor(size_t count) {
+    size_t slot_count = slots_.empty() ? 16 : slots_.size();
+    while (count * 4 > slot_count * 3)
+      slot_count *= 2;
+    if (slot_count != slots_.size())
+      rehash(slot_count);
+  }
+
+ public:
+  size_t find(const Path &key) const {
+    size_t slot = findSlot(key, key.hash());
+    return (slot == npos) ? npos : (size_t) (slots_[slot].index - 1);
+  }
+
+  /**
+   * @return index of the entry and whether it was inserted
+   */
+  template <typename... Args>
+  std::pair<size_t, bool> emplace(const Path &key, Args &&... args) {
+    size_t hash = key.hash();
+    size_t slot = findSlot(key, hash);
+    if (slot != npos)
+      return std::make_pair((size_t) (slots_[slot].index - 1), false);
+    growFor(entries_.size() + 1);
+    size_t index = entries_.size();
+    entries_.emplace_back(std::forward<Args>(args)...);
+    place(hash, (uint32_t) index);
+    return std::make_pair(index, true);
+  }
+
+  bool erase(const Path &key) {
+    size_t slot = findSlot(key, key.hash());
+    if (slot == npos)
+      return false;
+    size_t mask = slots_.size() - 1;
+    size_t index = slots_[slot].index - 1;
+    size_t last = entries_.size() - 1;
+
+    // backward-shift deletion of the slot
+    size_t hole = slot;
+    for (size_t i = (hole + 1) & mask; slots_[i].index; i = (i + 1) & mask) {
+      size_t want = home(KeyOf::key(entries_[slots_[i].index - 1]).hash());
+      if (((i - want) & mask) >= ((i - hole) & mask)) {
+        slots_[hole] = slots_[i];
+        hole = i;
+      }
+    }
+    slots_[hole].index = 0;
+
+    // keep entries dense by moving the last one into the hole
+    if (index != last) {
+      size_t moved = findSlot(KeyOf::key(entries_[last]), KeyOf::key(entries_[last]).hash());
+      slots_[moved].index = (uint32_t) index + 1;
+      entries_[index] = std::move(entries_[last]);
+    }
+    entries_.pop_back();
+    return true;
+  }
+
+  void reserve(size_t count) {
+    entries_.reserve(count);
+    growFor(count);
+  }
+
+  void clear() {
+    entries_.clear();
+    slots_.clear();
+  }
+
+  size_t size() const { return entries_.size(); }
+  Entry &at(size_t index) { return entries_[index]; }
+  const Entry &at(size_t index) const { return entries_[index]; }
+  std::vector<Entry> &entries() { return entries_; }
+  const std::vector<Entry> &entries() const { return entries_; }
+};
+
+struct PathSetKey {
+  static const Path &key(const Path &entry) { return entry; }
+};
+
+template <typename T>
+struct PathMapKey {
+  static const Path &key(const std::pair<Path, T> &entry) { return entry.first; }
+};
+
+}
+
+/**
+ * Hash set of paths. Entries are stored densely in insertion order (until
+ * an erase moves the last entry into the gap); inserting invalidates
+ * iterators and references.
+ */
+class PathSet {
+ private:
+  detail::FlatPathIndex<Path, detail::PathSetKey> index_;
+
+ public:
+  typedef std::vector<Path>::const_iterator const_iterator;
+
+  /**
+   * @return true when the path was not in the set
+   */
+  bool insert(const Path &path) {
+    return index_.emplace(path, path).second;
+  }
+  bool insert(Path &&path) {
+    return index_.emplace(path, std::move(path)).second;
+  }
+
+  bool contains(const Path &path) const {
+    return index_.find(path) != index_.npos;
+  }
+
+  bool erase(const Path &path) {
+    return index_.erase(path);
+  }
+
+  size_t size() const { return index_.size(); }
+  bool empty() const { return index_.size() == 0; }
+  void reserve(size_t count) { index_.reserve(count); }
+  void clear() { index_.clear(); }
+
+  const_iterator begin() const { return index_.entries().begin(); }
+  const_iterator end() const { return index_.entries().end(); }
+};
+
+/**
+ * Hash map keyed by path, with the same storage rules as PathSet.
+ */
+template <typename T>
+class PathMap {
+ public:
+  typedef std::pair<Path, T> value_type;
+  typedef typename std::vector<value_type>::iterator iterator;
+  typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+ private:
+  detail::FlatPathIndex<value_type, detail::PathMapKey<T>> index_;
+
+ public:
+  /**
+   * @return the mapped value, default-constructed when the path is new
+   */
+  T &operator[](const Path &path) {
+    size_t index = index_.find(path);
+    if (index == index_.npos)
+      index = index_.emplace(path, path, T()).first;
+    return index_.at(index).second;
+  }
+
+  /**
+   * @return true when inserted, false when the path already exists (the value is left unchanged)
+   */
+  bool insert(const Path &path, const T &value) {
+    return index_.emplace(path, path, value).second;
+  }
+  bool insert(const Path &path, T &&value) {
+    return index_.emplace(path, path, std::move(value)).second;
+  }
+
+  /**
+   * @return pointer to the value or NULL, valid until the next insert or erase
+   */
+  T *find(const Path &path) {
+    size_t index = index_.find(path);
+    return (index == index_.npos) ? NULL : &index_.at(index).second;
+  }
+  const T *find(const Path &path) const {
+    size_t index = index_.find(path);
+    return (index == index_.npos) ? NULL : &index_.at(index).second;
+  }
+
+  bool contains(const Path &path) const {
+    return index_.find(path) != index_.npos;
+  }
+
+  bool erase(const Path &path) {
+    return index_.erase(path);
+  }
+
+  size_t size() const { return index_.size(); }
+  bool empty() const { return index_.size() == 0; }
+  void reserve(size_t count) { index_.reserve(count); }
+  void clear() { index_.clear(); }
+
+  iterator begin() { return index_.entries().begin(); }
+  iterator end() { return index_.entries().end(); }
+  const_iterator begin() const { return index_.entries().begin(); }
+  const_iterator end() const { return index_.entries().end(); }
+};
+
+}
+}
+
+#endif //__JCU_FILE_PATH_SET_H__
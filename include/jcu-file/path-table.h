@@ -0,0 +1,112 @@
+/**
+ * @file	path-table.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_PATH_TABLE_H__
+#define __JCU_FILE_PATH_TABLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "path.h"
+
+namespace jcu {
+namespace file {
+
+/**
+ * Compact store for many paths.
+ *
+ * Every entry is a (parent id, name) pair addressed by a 32-bit id, and
+ * names are interned once in a shared arena, so a path costs a few bytes
+ * plus its own name instead of a full string. A leading separator run
+ * ("/" or "\\\\") becomes a root entry of its own.
+ *
+ * Not thread-safe.
+ */
+class PathTable {
+ public:
+  typedef uint32_t Id;
+  static const Id NO_ID = 0xffffffffu;
+
+ private:
+  struct Node {
+    Id parent;
+    uint32_t name;
+  };
+
+  std::vector<Path::system_char_t> arena_;
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> name_slots_;
+  size_t name_count_;
+  std::vector<uint32_t> child_slots_;
+
+  uint32_t internName(Path::system_string_view_t name);
+  uint32_t findName(Path::system_string_view_t name) const;
+  Path::system_string_view_t nameAt(uint32_t offset) const;
+  void growNames();
+  void growChildren();
+  size_t childSlot(Id parent, uint32_t name) const;
+
+ public:
+  PathTable();
+
+  /**
+   * Add a path and all of its ancestors
+   *
+   * @return id of the path, NO_ID for an empty path
+   */
+  Id add(const Path &path);
+
+  /**
+   * Add one child entry
+   *
+   * @param parent NO_ID for a root entry
+   * @param name single component
+   * @return id of the entry; an existing id when it is already present
+   */
+  Id add(Id parent, Path::system_string_view_t name);
+
+  /**
+   * @return id of the path, or NO_ID
+   */
+  Id find(const Path &path) const;
+  Id find(Id parent, Path::system_string_view_t name) const;
+
+  Id parent(Id id) const;
+
+  /**
+   * @return the entry's own name, valid until the next add
+   */
+  Path::system_string_view_t name(Id id) const;
+
+  /**
+   * Rebuild the full path
+   */
+  Path path(Id id) const;
+
+  /**
+   * Append the full path to a reusable buffer
+   */
+  void appendPath(Id id, Path::system_string_t &out) const;
+
+  size_t size() const;
+  void reserve(size_t entries);
+  void clear();
+
+  /**
+   * @return bytes held by the table
+   */
+  size_t memoryUsage() const;
+};
+
+}
+}
+
+#endif //__JCU_FILE_PATH_TABLE_H__
@@ -10,7 +10,13 @@
 #ifndef __JCU_FILE_PATH_H__
 #define __JCU_FILE_PATH_H__
 
+#include <stddef.h>
+
+#include <atomic>
+#include <functional>
+#include <iterator>
 #include <string>
+#include <string_view>
 
 #ifdef _WIN32
 #include <tchar.h>
@@ -26,15 +32,65 @@ class Path {
 #else
   typedef std::string system_string_t;
 #endif
+  typedef system_string_t::value_type system_char_t;
+  typedef std::basic_string_view<system_char_t> system_string_view_t;
+
+  /**
+   * Iterates the non-empty components between separators.
+   * The views point into the Path and are valid while it is unchanged.
+   */
+  class ComponentIterator {
+   private:
+    system_string_view_t path_;
+    size_t pos_;
+    size_t end_;
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef system_string_view_t value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const system_string_view_t *pointer;
+    typedef system_string_view_t reference;
+
+    ComponentIterator(system_string_view_t path, size_t pos);
+    system_string_view_t operator*() const;
+    ComponentIterator &operator++();
+    bool operator==(const ComponentIterator &other) const { return pos_ == other.pos_; }
+    bool operator!=(const ComponentIterator &other) const { return pos_ != other.pos_; }
+  };
+
+  class Components {
+   private:
+    system_string_view_t path_;
+
+   public:
+    Components(system_string_view_t path)
+        : path_(path) {}
+    ComponentIterator begin() const { return ComponentIterator(path_, 0); }
+    ComponentIterator end() const { return ComponentIterator(path_, path_.length()); }
+  };
+
+  static bool isSeparator(system_char_t c) {
+#ifdef _WIN32
+    return c == '/' || c == '\\';
+#else
+    return c == '/';
+#endif
+  }
 
  private:
   system_string_t system_path_;
+  // 0 until hash() is first called
+  mutable std::atomic<size_t> hash_;
+
   Path(const system_string_t &system_string);
+  Path(system_string_t &&system_string);
 
  public:
   static Path newFromUtf8(const std::string &text);
   static Path newFromUtf8(const char *text, int length = -1);
   static Path newFromSystem(const system_string_t &text);
+  static Path newFromSystem(system_string_t &&text);
 
   static Path dir();
   static Path cwd();
@@ -45,13 +101,114 @@ class Path {
 
   Path();
   Path(const Path &obj);
+  Path(Path &&obj) noexcept;
   Path &operator=(const Path &obj);
+  Path &operator=(Path &&obj) noexcept;
   const system_string_t &getSystemString() const;
+#ifdef _UNICODE
   const std::string toUtf8() const;
+#else
+  const std::string &toUtf8() const;
+#endif
   bool isEmpty() const;
+
+  /**
+   * Last component, e.g. "c.tar.gz" of "a/b/c.tar.gz"
+   */
+  system_string_view_t filename() const;
+
+  /**
+   * Extension of the filename including the dot, e.g. ".gz".
+   * Empty for "name" and for dot files such as ".profile".
+   */
+  system_string_view_t extension() const;
+
+  /**
+   * Filename without the extension, e.g. "c.tar"
+   */
+  system_string_view_t stem() const;
+
+  Components components() const;
+
+  /**
+   * Hash of the system string, computed once and cached
+   */
+  size_t hash() const;
+
+  /**
+   * Compare two paths
+   *
+   * The plain comparison orders the system strings byte-wise, the same as
+   * operator<. The normalized comparison works component by component:
+   * repeated and trailing separators and "." components are ignored, and
+   * on Windows both separators match and letters compare case-insensitively.
+   * ".." is kept as-is since resolving it requires the filesystem.
+   *
+   * @return <0, 0 or >0
+   */
+  int compare(const Path &other, bool normalized = false) const;
+
+  bool operator==(const Path &other) const;
+  bool operator!=(const Path &other) const { return !(*this == other); }
+  bool operator<(const Path &other) const { return compare(other) < 0; }
+  bool operator<=(const Path &other) const { return compare(other) <= 0; }
+  bool operator>(const Path &other) const { return compare(other) > 0; }
+  bool operator>=(const Path &other) const { return compare(other) >= 0; }
+};
+
+/**
+ * Appending path buffer. Reuses one string for repeated joins:
+ *
+ * PathBuilder builder(root);
+ * size_t mark = builder.length();
+ * for (...) { builder.truncate(mark); builder.append(name); use(builder.view()); }
+ */
+class PathBuilder {
+ private:
+  Path::system_string_t buffer_;
+
+ public:
+  PathBuilder();
+  PathBuilder(const Path &base);
+
+  /**
+   * Append one or more components, adding a separator when needed
+   */
+  PathBuilder &append(Path::system_string_view_t name);
+  PathBuilder &append(const Path &name);
+
+  /**
+   * Remove the last component
+   */
+  PathBuilder &pop();
+
+  size_t length() const;
+  void truncate(size_t length);
+  void reserve(size_t capacity);
+  void clear();
+
+  Path::system_string_view_t view() const;
+  const Path::system_string_t &str() const;
+
+  /**
+   * @return copy of the buffer as a Path, the buffer is kept for reuse
+   */
+  Path toPath() const;
+
+  /**
+   * @return the buffer moved into a Path, the builder is left empty
+   */
+  Path take();
 };
 
 }
 }
 
+namespace std {
+template <>
+struct hash<jcu::file::Path> {
+  size_t operator()(const jcu::file::Path &path) const { return path.hash(); }
+};
+}
+
 #endif //__JCU_FILE_PATH_H__
@@ -0,0 +1,38 @@
+/**
+ * @file	copy-file.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_POSIX_COPY_FILE_H__
+#define __JCU_FILE_POSIX_COPY_FILE_H__
+
+#include "../file-factory.h"
+
+namespace jcu {
+namespace file {
+namespace posix {
+
+/**
+ * Copy between open descriptors: FICLONE, copy_file_range, sendfile, then
+ * pread/pwrite. dst_fd must be empty. Data extents are copied one by one
+ * so holes stay holes.
+ *
+ * @param src_fd
+ * @param dst_fd
+ * @param flags CopyFlag
+ * @return 0 or error code
+ */
+int copyFileFd(int src_fd, int dst_fd, int flags);
+
+int copyFile(const Path &src, const Path &dst, int flags);
+int moveFile(const Path &src, const Path &dst, int flags);
+
+}
+}
+}
+
+#endif //__JCU_FILE_POSIX_COPY_FILE_H__
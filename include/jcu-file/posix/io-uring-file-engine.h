@@ -0,0 +1,34 @@
+/**
+ * @file	io-uring-file-engine.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_POSIX_IO_URING_FILE_ENGINE_H__
+#define __JCU_FILE_POSIX_IO_URING_FILE_ENGINE_H__
+
+#include <memory>
+
+#include "../async-file-engine.h"
+
+namespace jcu {
+namespace file {
+namespace posix {
+
+/**
+ * Create an io_uring backed engine. Only PosixFileHandler instances can be used with it.
+ *
+ * @param options
+ * @param perr ENOSYS/EPERM when io_uring is not available
+ * @return engine, or NULL on error
+ */
+std::unique_ptr<AsyncFileEngine> createIoUringFileEngine(const AsyncEngineOptions &options, int *perr = NULL);
+
+}
+}
+}
+
+#endif //__JCU_FILE_POSIX_IO_URING_FILE_ENGINE_H__
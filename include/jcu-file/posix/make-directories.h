@@ -0,0 +1,47 @@
+/**
+ * @file	make-directories.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_POSIX_MAKE_DIRECTORIES_H__
+#define __JCU_FILE_POSIX_MAKE_DIRECTORIES_H__
+
+#include <string>
+#include <vector>
+
+#include "../path.h"
+
+namespace jcu {
+namespace file {
+namespace posix {
+
+/**
+ * mkdir -p that tries the leaf first and only walks up on ENOENT, so an
+ * existing or almost existing path costs one or two system calls.
+ *
+ * @param path
+ * @param recursive create missing parents
+ * @return 0 or error code; an existing path is not an error
+ */
+int makeDirectory(const std::string &path, bool recursive);
+
+/**
+ * Create many directories and their parents. The paths are merged into
+ * one tree; the longest shared prefix is created and opened once, and
+ * everything below it is created with mkdirat from the parent's descriptor.
+ *
+ * @param paths
+ * @param threads subtrees are handed out to this many threads, 0 for hardware concurrency
+ * @return 0 or the first error
+ */
+int makeDirectories(const std::vector<Path> &paths, int threads);
+
+}
+}
+}
+
+#endif //__JCU_FILE_POSIX_MAKE_DIRECTORIES_H__
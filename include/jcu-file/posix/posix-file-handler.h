@@ -0,0 +1,134 @@
+/**
+ * @file	posix-file-handler.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_POSIX_POSIX_FILE_HANDLER_H__
+#define __JCU_FILE_POSIX_POSIX_FILE_HANDLER_H__
+
+#include <string>
+
+#include "../file-handler.h"
+#include "../file-info.h"
+
+namespace jcu {
+namespace file {
+namespace posix {
+class PosixFileHandler : public FileHandler {
+ protected:
+  const std::string path_;
+  std::string temp_path_;
+  std::string old_path_;
+  int fd_;
+  int flags_;
+  int create_mode_;
+  // ATOMIC_REPLACE state: fd_ is an O_TMPFILE file, and the fd kept past
+  // close() until commit() publishes it
+  bool anonymous_;
+  bool replace_pending_;
+  int pending_fd_;
+  bool direct_;
+  size_t alignment_;
+  // ADAPTIVE_READAHEAD / DROP_BEHIND state, kept up to date by cursor I/O
+  int64_t cursor_;
+  int64_t last_read_end_;
+  int run_reads_;
+  int64_t readahead_end_;
+  int64_t readahead_window_;
+  int64_t dropped_end_;
+
+  int removeOld();
+  int prepareNamedTemp(std::string &open_path, int &open_flags);
+  int replaceTarget(const std::string &staged);
+  int commitReplace();
+  void discardReplace();
+  bool enableDirect();
+  void initDirect(bool requested);
+  void applyOpenHints();
+  void onCursorRead(int64_t n);
+
+ public:
+  PosixFileHandler(const std::string &path);
+  ~PosixFileHandler() override;
+  int fd() const;
+
+  /**
+   * Permission bits of files created by open(), before the umask.
+   * 0666 by default.
+   */
+  void setCreateMode(int mode);
+  int createMode() const;
+
+  /**
+   * First half of open(): applies the flags and the temp name / old file
+   * handling, and returns what has to be passed to openat.
+   * Used by engines that open the file themselves.
+   */
+  int prepareOpen(int flags, std::string &open_path, int &open_flags);
+  void attachFd(int fd);
+  int detachFd();
+  /**
+   * Whether an ATOMIC_REPLACE file is still waiting for commit(). close()
+   * keeps its descriptor then, so it must not be closed through detachFd().
+   */
+  bool isReplacePending() const;
+
+  int open(int flags) override;
+
+  /**
+   * open() with the file name resolved relative to a directory descriptor.
+   * path_ must still name the same file; it is used for temp names,
+   * commit() and getOldName().
+   *
+   * @param dir_fd directory descriptor or AT_FDCWD
+   * @param name relative to dir_fd, NULL to use the full path
+   * @param flags
+   * @return 0 or error code
+   */
+  int openAt(int dir_fd, const char *name, int flags);
+  int read(void *buf, int size) override;
+  int write(const void *buf, int size) override;
+  int64_t readAt(void *buf, size_t size, int64_t offset) override;
+  int64_t writeAt(const void *buf, size_t size, int64_t offset) override;
+  int64_t read64(void *buf, size_t size) override;
+  int64_t write64(const void *buf, size_t size) override;
+  int64_t readv(const IoVec *iov, int count) override;
+  int64_t writev(const IoVec *iov, int count) override;
+  int64_t readvAt(const IoVec *iov, int count, int64_t offset) override;
+  int64_t writevAt(const IoVec *iov, int count, int64_t offset) override;
+  int sync(bool data_only) override;
+  int allocate(int64_t offset, int64_t length, bool keep_size) override;
+  int punchHole(int64_t offset, int64_t length) override;
+  int zeroRange(int64_t offset, int64_t length) override;
+  int truncate(int64_t size) override;
+  int nextExtent(int64_t offset, int64_t &data_offset, int64_t &data_length) override;
+  int advise(int64_t offset, int64_t length, AccessPattern pattern) override;
+  int prefetch(int64_t offset, int64_t length) override;
+  int commit() override;
+  int close() override;
+  bool isOpen() const override;
+  Path getOldName() const override;
+  bool isDirect() const override;
+  size_t getAlignment() const override;
+  int64_t getFileSize() const override;
+};
+
+/**
+ * statx/fstatat into a FileInfo
+ *
+ * @param dir_fd directory descriptor or AT_FDCWD
+ * @param path relative to dir_fd
+ * @param info
+ * @param follow_symlinks
+ * @return 0 or error code
+ */
+int statAt(int dir_fd, const char *path, FileInfo &info, bool follow_symlinks = true);
+}
+}
+}
+
+#endif //__JCU_FILE_POSIX_POSIX_FILE_HANDLER_H__
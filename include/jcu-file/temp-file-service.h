@@ -0,0 +1,165 @@
+/**
+ * @file	temp-file-service.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_TEMP_FILE_SERVICE_H__
+#define __JCU_FILE_TEMP_FILE_SERVICE_H__
+
+#include <memory>
+
+#include "file-factory.h"
+#include "file-handler.h"
+#include "path.h"
+
+namespace jcu {
+namespace file {
+
+/**
+ * An open temp file, closed and removed when destroyed unless keep() was called.
+ */
+class TempFile {
+ private:
+  std::unique_ptr<FileHandler> handler_;
+  // empty for anonymous files
+  Path path_;
+
+  friend class TempFileService;
+
+ public:
+  TempFile();
+  TempFile(TempFile &&other) noexcept;
+  TempFile &operator=(TempFile &&other) noexcept;
+  TempFile(const TempFile &) = delete;
+  TempFile &operator=(const TempFile &) = delete;
+  ~TempFile();
+
+  FileHandler *handler() const { return handler_.get(); }
+  FileHandler *operator->() const { return handler_.get(); }
+  explicit operator bool() const { return handler_ != nullptr; }
+
+  /**
+   * @return the file name, empty for anonymous files
+   */
+  const Path &path() const { return path_; }
+
+  /**
+   * Give up ownership: the file stays on disk and the handler stays open
+   *
+   * @return the handler
+   */
+  std::unique_ptr<FileHandler> keep();
+
+  /**
+   * Close and remove the file now
+   *
+   * @return 0 or error code
+   */
+  int remove();
+};
+
+/**
+ * A temp directory, removed with everything in it when destroyed unless
+ * keep() was called.
+ */
+class TempDirectory {
+ private:
+  Path path_;
+
+  friend class TempFileService;
+
+ public:
+  TempDirectory();
+  TempDirectory(TempDirectory &&other) noexcept;
+  TempDirectory &operator=(TempDirectory &&other) noexcept;
+  TempDirectory(const TempDirectory &) = delete;
+  TempDirectory &operator=(const TempDirectory &) = delete;
+  ~TempDirectory();
+
+  const Path &path() const { return path_; }
+  explicit operator bool() const { return !path_.isEmpty(); }
+
+  /**
+   * Leave the directory on disk
+   *
+   * @return its path
+   */
+  Path keep();
+
+  /**
+   * Remove the directory tree now
+   *
+   * @return 0 or error code
+   */
+  int remove();
+};
+
+/**
+ * Creates temp files and directories from many threads.
+ *
+ * The temp directory is looked up once. Names come from a per-thread
+ * generator (seeded once from SecureRandom) so no lock is taken, and files
+ * are created with O_EXCL, retrying on the rare collision, so a returned
+ * name always belongs to the caller.
+ */
+class TempFileService {
+ private:
+  FileFactory *factory_;
+  Path directory_;
+
+ public:
+  /**
+   * @param directory where to create, empty for the system temp directory
+   * @param factory NULL for fs()
+   */
+  explicit TempFileService(const Path &directory = Path(), FileFactory *factory = NULL);
+
+  /**
+   * Shared service on the system temp directory
+   */
+  static TempFileService &instance();
+
+  const Path &directory() const;
+
+  /**
+   * A fresh name in the directory. Nothing is created, prefer createFile().
+   */
+  Path generatePath(const char *prefix) const;
+
+  /**
+   * Create and open a new named file
+   *
+   * @param out
+   * @param prefix
+   * @param flags open flags added to MODE_CREATE_NEW
+   * @return 0 or error code
+   */
+  int createFile(TempFile &out, const char *prefix = "tmp", int flags = MODE_READ | MODE_WRITE) const;
+
+  /**
+   * Create and open a file that has no name and disappears on close
+   * (O_TMPFILE, or a named file unlinked right away; FILE_FLAG_DELETE_ON_CLOSE on Windows)
+   *
+   * @param out
+   * @return 0 or error code
+   */
+  int createAnonymousFile(TempFile &out) const;
+
+  /**
+   * Create a new directory
+   *
+   * @param out
+   * @param prefix
+   * @return 0 or error code
+   */
+  int createDirectory(TempDirectory &out, const char *prefix = "tmp") const;
+};
+
+}
+}
+
+#endif //__JCU_FILE_TEMP_FILE_SERVICE_H__
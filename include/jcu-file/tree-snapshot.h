@@ -0,0 +1,215 @@
+/**
+ * @file	tree-snapshot.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_TREE_SNAPSHOT_H__
+#define __JCU_FILE_TREE_SNAPSHOT_H__
+
+// POSIX only: listed with DirectoryIterator and loaded with MappedRegion
+#ifndef _WIN32
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file-type.h"
+#include "mapped-region.h"
+#include "path.h"
+
+namespace jcu {
+namespace file {
+
+struct TreeSnapshotOptions {
+  // directories listed at the same time, 0 for hardware concurrency
+  int threads;
+  // rescan(): stat the files of directories whose mtime did not change.
+  // Without it only the directories' own entries are checked there, so
+  // added and removed files are still found but modified ones are not.
+  bool stat_unchanged;
+
+  TreeSnapshotOptions()
+      : threads(0), stat_unchanged(true) {}
+};
+
+enum SnapshotChange {
+  SNAPSHOT_ADDED = 1,
+  SNAPSHOT_REMOVED = 2,
+  // size, mtime or inode differ; only reported for non-directories
+  SNAPSHOT_MODIFIED = 3,
+};
+
+struct SnapshotDiff {
+  SnapshotChange change;
+  // relative to the root
+  Path path;
+  FileType type;
+};
+
+/**
+ * Path, size, mtime, inode and type of every entry of a directory tree.
+ *
+ * Entries are stored breadth-first, so the children of a directory are
+ * contiguous and sorted by name, and the first entry is the root. The
+ * records and the names are saved as they are held in memory; load() maps
+ * the file and uses it in place without parsing it.
+ *
+ * rescan() builds a new snapshot from an older one. Directories whose
+ * mtime and inode are unchanged are not listed again: their entries are
+ * taken from the older snapshot (and stat'ed, see stat_unchanged).
+ * Directories modified shortly before the older scan are listed again,
+ * since a change within the same timestamp tick would go unnoticed.
+ *
+ * TreeSnapshot before, after;
+ * before.load(index_path);
+ * after.rescan(before);
+ * TreeSnapshot::diff(before, after, changes);
+ * after.save(index_path);
+ *
+ * Symlinks are recorded, not followed. POSIX only; the class is not
+ * declared on Windows.
+ */
+class TreeSnapshot {
+ public:
+  static const uint32_t NO_ENTRY = 0xffffffffu;
+
+  /**
+   * One record, in the on-disk layout
+   */
+  struct Entry {
+    uint64_t inode;
+    int64_t size;
+    // nanoseconds since the unix epoch
+    int64_t mtime_ns;
+    // NO_ENTRY for the root
+    uint32_t parent;
+    uint32_t name_offset;
+    uint32_t name_length;
+    // FileType
+    uint32_t type;
+    // children of a directory, 0 for other entries
+    uint32_t first_child;
+    uint32_t child_count;
+  };
+
+ private:
+  std::vector<Entry> entries_;
+  std::string names_;
+  MappedRegion region_;
+
+  // either entries_ and names_, or the mapped file
+  const Entry *entry_data_;
+  size_t entry_count_;
+  const char *name_data_;
+  size_t name_size_;
+
+  int64_t scan_time_ns_;
+  size_t listed_directories_;
+
+  int build(const Path &root, const TreeSnapshot *previous, const TreeSnapshotOptions &options);
+  void useOwned();
+
+ public:
+  TreeSnapshot();
+  TreeSnapshot(TreeSnapshot &&obj);
+  TreeSnapshot &operator=(TreeSnapshot &&obj);
+  TreeSnapshot(const TreeSnapshot &) = delete;
+  TreeSnapshot &operator=(const TreeSnapshot &) = delete;
+
+  /**
+   * List the whole tree
+   *
+   * @param root
+   * @param options
+   * @return 0 or error code; unreadable subdirectories are recorded empty
+   */
+  int scan(const Path &root, const TreeSnapshotOptions &options = TreeSnapshotOptions());
+
+  /**
+   * Scan the root of an older snapshot again, listing only the directories
+   * that changed since
+   *
+   * @param previous may be this snapshot
+   * @param options
+   * @return 0 or error code
+   */
+  int rescan(const TreeSnapshot &previous, const TreeSnapshotOptions &options = TreeSnapshotOptions());
+
+  /**
+   * Write the snapshot to a file, replacing it atomically
+   *
+   * @return 0 or error code
+   */
+  int save(const Path &path) const;
+
+  /**
+   * Map a file written by save(). The records are checked once, then used
+   * from the mapping.
+   *
+   * @return 0, EINVAL for a file that is not a valid snapshot, or error code
+   */
+  int load(const Path &path);
+
+  void clear();
+
+  Path root() const;
+
+  /**
+   * @return when the scan started, nanoseconds since the unix epoch
+   */
+  int64_t scanTime() const;
+
+  /**
+   * @return directories read by the scan that built this snapshot; the
+   *         rest were taken from the previous snapshot (0 after load())
+   */
+  size_t listedDirectories() const;
+
+  /**
+   * @return number of entries, including the root
+   */
+  size_t size() const;
+
+  const Entry &entry(uint32_t index) const;
+  std::string_view name(uint32_t index) const;
+
+  /**
+   * @return path of an entry relative to the root, empty for the root
+   */
+  Path relativePath(uint32_t index) const;
+
+  /**
+   * @param relative path relative to the root
+   * @return index of the entry, or NO_ENTRY
+   */
+  uint32_t find(const Path &relative) const;
+
+  /**
+   * @return index of a directory's child, or NO_ENTRY
+   */
+  uint32_t findChild(uint32_t directory, std::string_view name) const;
+
+  /**
+   * Compare two snapshots of the same tree. Everything below an added or
+   * removed directory is reported as well, parents before children.
+   *
+   * @param before
+   * @param after
+   * @param out changes are appended
+   */
+  static void diff(const TreeSnapshot &before, const TreeSnapshot &after, std::vector<SnapshotDiff> &out);
+};
+
+}
+}
+
+#endif //_WIN32
+
+#endif //__JCU_FILE_TREE_SNAPSHOT_H__
@@ -0,0 +1,105 @@
+/**
+ * @file	walk.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jichan.\n
+ *            This software may be modified and distributed under the terms
+ *            of the Apache License 2.0.  See the LICENSE file for details.
+ */
+
+#ifndef __JCU_FILE_WALK_H__
+#define __JCU_FILE_WALK_H__
+
+// POSIX only: built on DirectoryIterator
+#ifndef _WIN32
+
+#include <stdint.h>
+
+#include <functional>
+#include <string_view>
+
+#include "file-type.h"
+#include "path.h"
+#include "path-table.h"
+
+namespace jcu {
+namespace file {
+
+enum SymlinkPolicy {
+  // report symlinks as entries, never descend through them
+  SYMLINK_NO_FOLLOW = 0,
+  // report the link target's type and descend into linked directories (loops are skipped)
+  SYMLINK_FOLLOW = 1,
+};
+
+/**
+ * Entry passed to the visitor. The views are only valid during the callback.
+ */
+struct WalkEntry {
+  std::string_view path;
+  std::string_view name;
+  FileType type;
+  uint64_t inode;
+  // children of the root are depth 1
+  int depth;
+};
+
+/**
+ * @return false to stop the walk
+ */
+typedef std::function<bool(const WalkEntry &entry)> WalkVisitor;
+
+/**
+ * @return false to skip the directory's subtree (the directory itself is still visited)
+ */
+typedef std::function<bool(const WalkEntry &directory)> WalkFilter;
+
+struct WalkOptions {
+  // 0 for hardware concurrency
+  int threads;
+  // deepest depth to visit (the root's children are depth 1, so 0 visits
+  // nothing), -1 for unlimited
+  int max_depth;
+  SymlinkPolicy symlinks;
+  WalkFilter directory_filter;
+  // Visit entries in a deterministic pre-order (siblings sorted by name) on
+  // the calling thread. The tree is listed in parallel first and held in
+  // memory until it has been visited.
+  bool ordered;
+
+  WalkOptions()
+      : threads(0), max_depth(-1), symlinks(SYMLINK_NO_FOLLOW), ordered(false) {}
+};
+
+/**
+ * Walk a directory tree with several threads, stealing subdirectories
+ * between threads. The directory filter is called concurrently from the
+ * worker threads, and so is the visitor unless options.ordered is set.
+ * POSIX only; neither walk() is declared on Windows.
+ *
+ * @param root
+ * @param visitor
+ * @param options
+ * @return 0, or the first error encountered; unreadable subdirectories do not stop the walk
+ */
+int walk(const Path &root, const WalkVisitor &visitor, const WalkOptions &options = WalkOptions());
+
+/**
+ * Walk a directory tree straight into a path table. Each directory's
+ * entries are added under one lock, so the table is only touched in
+ * batches. options.ordered is ignored; ids follow discovery order.
+ *
+ * @param root
+ * @param table receives the root, its ancestors and every entry found
+ * @param options
+ * @param root_id receives the id of the root, may be NULL
+ * @return 0, or the first error encountered
+ */
+int walk(const Path &root, PathTable &table, const WalkOptions &options = WalkOptions(), PathTable::Id *root_id = NULL);
+
+}
+}
+
+#endif //_WIN32
+
+#endif //__JCU_FILE_WALK_H__
@@ -12,6 +12,8 @@
 
 #include "../file-handler.h"
 
+#include <mutex>
+
 #include <windows.h>
 
 namespace jcu {
@@ -24,19 +26,48 @@ class WinFileHandler : public FileHandler {
   std::basic_string<TCHAR> old_path_;
   HANDLE handle_;
   int flags_;
+  bool direct_;
+  size_t alignment_;
+  // readAt/writeAt put the file pointer back, one at a time
+  std::mutex cursor_mutex_;
 
   int removeOld();
+  int commitReplace();
+  void initDirect(bool requested);
 
  public:
   WinFileHandler(const std::basic_string<TCHAR> &path);
+  ~WinFileHandler() override;
   HANDLE handle() const;
+  /**
+   * Take ownership of an already open handle
+   */
+  void attachHandle(HANDLE handle);
   int open(int flags) override;
   int read(void *buf, int size) override;
   int write(const void *buf, int size) override;
+  int64_t readAt(void *buf, size_t size, int64_t offset) override;
+  int64_t writeAt(const void *buf, size_t size, int64_t offset) override;
+  int64_t read64(void *buf, size_t size) override;
+  int64_t write64(const void *buf, size_t size) override;
+  int64_t readv(const IoVec *iov, int count) override;
+  int64_t writev(const IoVec *iov, int count) override;
+  int64_t readvAt(const IoVec *iov, int count, int64_t offset) override;
+  int64_t writevAt(const IoVec *iov, int count, int64_t offset) override;
+  int sync(bool data_only) override;
+  int allocate(int64_t offset, int64_t length, bool keep_size) override;
+  int punchHole(int64_t offset, int64_t length) override;
+  int zeroRange(int64_t offset, int64_t length) override;
+  int truncate(int64_t size) override;
+  int nextExtent(int64_t offset, int64_t &data_offset, int64_t &data_length) override;
+  int advise(int64_t offset, int64_t length, AccessPattern pattern) override;
+  int prefetch(int64_t offset, int64_t length) override;
   int commit() override;
   int close() override;
   bool isOpen() const override;
   Path getOldName() const override;
+  bool isDirect() const override;
+  size_t getAlignment() const override;
   int64_t getFileSize() const override;
 };
 }
@@ -0,0 +1,157 @@
+/**
+ * @file	aligned-buffer-pool.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/aligned-buffer-pool.h"
+
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include <mutex>
+#include <vector>
+
+namespace jcu {
+namespace file {
+
+namespace {
+
+void *allocAligned(size_t size, size_t alignment) {
+#ifdef _WIN32
+  return ::_aligned_malloc(size, alignment);
+#else
+  void *ptr = NULL;
+  if (::posix_memalign(&ptr, alignment, size) != 0)
+    return NULL;
+  return ptr;
+#endif
+}
+
+void freeAligned(void *ptr) {
+#ifdef _WIN32
+  ::_aligned_free(ptr);
+#else
+  ::free(ptr);
+#endif
+}
+
+}
+
+struct AlignedBuffer::PoolState {
+  size_t buffer_size;
+  size_t alignment;
+  size_t max_cached;
+  std::mutex mutex;
+  std::vector<void *> free_list;
+
+  ~PoolState() {
+    for (void *ptr : free_list)
+      freeAligned(ptr);
+  }
+
+  void put(void *ptr) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (free_list.size() < max_cached) {
+        free_list.push_back(ptr);
+        return;
+      }
+    }
+    freeAligned(ptr);
+  }
+};
+
+AlignedBuffer::AlignedBuffer()
+    : data_(NULL), size_(0) {
+}
+
+AlignedBuffer::AlignedBuffer(std::shared_ptr<PoolState> pool, void *data, size_t size)
+    : pool_(std::move(pool)), data_(data), size_(size) {
+}
+
+AlignedBuffer::AlignedBuffer(AlignedBuffer &&other) noexcept
+    : pool_(std::move(other.pool_)), data_(other.data_), size_(other.size_) {
+  other.data_ = NULL;
+  other.size_ = 0;
+}
+
+AlignedBuffer &AlignedBuffer::operator=(AlignedBuffer &&other) noexcept {
+  if (this != &other) {
+    release();
+    pool_ = std::move(other.pool_);
+    data_ = other.data_;
+    size_ = other.size_;
+    other.data_ = NULL;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+AlignedBuffer::~AlignedBuffer() {
+  release();
+}
+
+void AlignedBuffer::release() {
+  if (data_) {
+    pool_->put(data_);
+    data_ = NULL;
+    size_ = 0;
+  }
+  pool_.reset();
+}
+
+AlignedBufferPool::AlignedBufferPool(size_t buffer_size, size_t alignment, size_t max_cached)
+    : state_(std::make_shared<AlignedBuffer::PoolState>()) {
+  // posix_memalign wants at least pointer alignment
+  if (alignment < sizeof(void *))
+    alignment = sizeof(void *);
+  if (buffer_size == 0)
+    buffer_size = alignment;
+  state_->alignment = alignment;
+  state_->buffer_size = (buffer_size + alignment - 1) & ~(alignment - 1);
+  state_->max_cached = max_cached;
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+}
+
+AlignedBuffer AlignedBufferPool::acquire() {
+  void *ptr = NULL;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (!state_->free_list.empty()) {
+      ptr = state_->free_list.back();
+      state_->free_list.pop_back();
+    }
+  }
+  if (!ptr)
+    ptr = allocAligned(state_->buffer_size, state_->alignment);
+  if (!ptr)
+    return AlignedBuffer();
+  return AlignedBuffer(state_, ptr, state_->buffer_size);
+}
+
+size_t AlignedBufferPool::bufferSize() const {
+  return state_->buffer_size;
+}
+
+size_t AlignedBufferPool::alignment() const {
+  return state_->alignment;
+}
+
+void AlignedBufferPool::trim() {
+  std::vector<void *> free_list;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    free_list.swap(state_->free_list);
+  }
+  for (void *ptr : free_list)
+    freeAligned(ptr);
+}
+
+}
+}
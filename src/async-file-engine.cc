@@ -0,0 +1,255 @@
+/**
+ * @file	async-file-engine.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/async-file-engine.h"
+
+#include <errno.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include "jcu-file/posix/io-uring-file-engine.h"
+#endif
+
+namespace jcu {
+namespace file {
+
+namespace {
+
+class ThreadPoolFileEngine : public AsyncFileEngine {
+ private:
+  struct Work {
+    std::function<void()> fn;
+    // runs alone, after everything before it
+    bool barrier;
+  };
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable idle_cv_;
+  std::deque<Work> queued_;
+  std::deque<Work> runnable_;
+  size_t inflight_;
+  size_t running_;
+  bool barrier_running_;
+  size_t queue_depth_;
+  bool stopping_;
+  std::vector<std::thread> workers_;
+
+  int enqueue(std::function<void()> fn, bool barrier = false) {
+    bool full;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queued_.push_back(Work{std::move(fn), barrier});
+      inflight_++;
+      full = queued_.size() >= queue_depth_;
+    }
+    if (full)
+      submit();
+    return 0;
+  }
+
+  bool canStart() const {
+    if (runnable_.empty() || barrier_running_)
+      return false;
+    return !runnable_.front().barrier || running_ == 0;
+  }
+
+  void workerMain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      work_cv_.wait(lock, [this]() { return (stopping_ && runnable_.empty()) || canStart(); });
+      if (runnable_.empty())
+        break;
+      Work work(std::move(runnable_.front()));
+      runnable_.pop_front();
+      running_++;
+      barrier_running_ = work.barrier;
+      lock.unlock();
+      work.fn();
+      lock.lock();
+      running_--;
+      if (work.barrier) {
+        barrier_running_ = false;
+        work_cv_.notify_all();
+      } else if (running_ == 0 && !runnable_.empty() && runnable_.front().barrier) {
+        work_cv_.notify_all();
+      }
+      if (--inflight_ == 0)
+        idle_cv_.notify_all();
+    }
+  }
+
+  static int64_t toResult(int rc) {
+    return rc ? -((int64_t) rc) : 0;
+  }
+
+ public:
+  ThreadPoolFileEngine(const AsyncEngineOptions &options)
+      : inflight_(0), running_(0), barrier_running_(false), queue_depth_(options.queue_depth ? options.queue_depth : 1), stopping_(false) {
+    int threads = options.threads;
+    if (threads <= 0)
+      threads = (int) std::thread::hardware_concurrency();
+    if (threads <= 0)
+      threads = 1;
+    for (int i = 0; i < threads; i++) {
+      workers_.emplace_back(&ThreadPoolFileEngine::workerMain, this);
+    }
+  }
+
+  ~ThreadPoolFileEngine() {
+    drain();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  AsyncEngineType type() const override {
+    return ASYNC_ENGINE_THREAD_POOL;
+  }
+
+  int readAt(FileHandler &handler, void *buf, size_t size, int64_t offset, AsyncCallback callback) override {
+    return enqueue([&handler, buf, size, offset, callback]() {
+      int64_t result = handler.readAt(buf, size, offset);
+      if (callback)
+        callback(result);
+    });
+  }
+
+  int writeAt(FileHandler &handler, const void *buf, size_t size, int64_t offset, AsyncCallback callback) override {
+    return enqueue([&handler, buf, size, offset, callback]() {
+      int64_t result = handler.writeAt(buf, size, offset);
+      if (callback)
+        callback(result);
+    });
+  }
+
+  int sync(FileHandler &handler, bool data_only, AsyncCallback callback) override {
+    return enqueue([&handler, data_only, callback]() {
+      int64_t result = toResult(handler.sync(data_only));
+      if (callback)
+        callback(result);
+    }, true);
+  }
+
+  int open(FileHandler &handler, int flags, AsyncCallback callback) override {
+    return enqueue([&handler, flags, callback]() {
+      int64_t result = toResult(handler.open(flags));
+      if (callback)
+        callback(result);
+    });
+  }
+
+  int close(FileHandler &handler, AsyncCallback callback) override {
+    return enqueue([&handler, callback]() {
+      int64_t result = toResult(handler.close());
+      if (callback)
+        callback(result);
+    }, true);
+  }
+
+  int submit() override {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (queued_.empty())
+        return 0;
+      for (auto &work : queued_) {
+        runnable_.emplace_back(std::move(work));
+      }
+      queued_.clear();
+    }
+    work_cv_.notify_all();
+    return 0;
+  }
+
+  void drain() override {
+    submit();
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this]() { return inflight_ == 0; });
+  }
+};
+
+std::future<int64_t> queueForFuture(const std::function<int(AsyncCallback)> &queue) {
+  std::shared_ptr<std::promise<int64_t>> promise(new std::promise<int64_t>());
+  std::future<int64_t> future = promise->get_future();
+  int rc = queue([promise](int64_t result) {
+    promise->set_value(result);
+  });
+  if (rc)
+    promise->set_value(-((int64_t) rc));
+  return future;
+}
+
+}
+
+std::unique_ptr<AsyncFileEngine> AsyncFileEngine::create(const AsyncEngineOptions &options, int *perr) {
+  int err = 0;
+
+  if (options.type != ASYNC_ENGINE_THREAD_POOL) {
+#if defined(__linux__)
+    std::unique_ptr<AsyncFileEngine> engine(posix::createIoUringFileEngine(options, &err));
+    if (engine) {
+      if (perr)
+        *perr = 0;
+      return engine;
+    }
+#else
+    err = ENOSYS;
+#endif
+    if (options.type == ASYNC_ENGINE_IO_URING) {
+      if (perr)
+        *perr = err;
+      return nullptr;
+    }
+  }
+
+  if (perr)
+    *perr = 0;
+  return std::unique_ptr<AsyncFileEngine>(new ThreadPoolFileEngine(options));
+}
+
+std::future<int64_t> AsyncFileEngine::readAt(FileHandler &handler, void *buf, size_t size, int64_t offset) {
+  return queueForFuture([&](AsyncCallback callback) {
+    return readAt(handler, buf, size, offset, callback);
+  });
+}
+
+std::future<int64_t> AsyncFileEngine::writeAt(FileHandler &handler, const void *buf, size_t size, int64_t offset) {
+  return queueForFuture([&](AsyncCallback callback) {
+    return writeAt(handler, buf, size, offset, callback);
+  });
+}
+
+std::future<int64_t> AsyncFileEngine::sync(FileHandler &handler, bool data_only) {
+  return queueForFuture([&](AsyncCallback callback) {
+    return sync(handler, data_only, callback);
+  });
+}
+
+std::future<int64_t> AsyncFileEngine::open(FileHandler &handler, int flags) {
+  return queueForFuture([&](AsyncCallback callback) {
+    return open(handler, flags, callback);
+  });
+}
+
+std::future<int64_t> AsyncFileEngine::close(FileHandler &handler) {
+  return queueForFuture([&](AsyncCallback callback) {
+    return close(handler, callback);
+  });
+}
+
+}
+}
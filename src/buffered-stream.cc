@@ -0,0 +1,223 @@
+/**
+ * @file	buffered-stream.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/buffered-stream.h"
+
+#include <errno.h>
+#include <string.h>
+
+namespace jcu {
+namespace file {
+
+BufferedReader::BufferedReader(FileHandler &handler, size_t buffer_size)
+    : handler_(handler), buffer_(buffer_size ? buffer_size : 1), pos_(0), end_(0), eof_(false) {
+}
+
+int64_t BufferedReader::fill() {
+  if (pos_ > 0) {
+    memmove(buffer_.data(), buffer_.data() + pos_, end_ - pos_);
+    end_ -= pos_;
+    pos_ = 0;
+  }
+  if (end_ == buffer_.size() || eof_) {
+    return 0;
+  }
+  int64_t n = handler_.read64(buffer_.data() + end_, buffer_.size() - end_);
+  if (n < 0) {
+    return n;
+  }
+  if (n == 0) {
+    eof_ = true;
+  }
+  end_ += (size_t) n;
+  return n;
+}
+
+int64_t BufferedReader::read(void *buf, size_t size) {
+  size_t available = end_ - pos_;
+  if (size == 0) {
+    return 0;
+  }
+  if (available == 0) {
+    if (size >= buffer_.size()) {
+      return handler_.read64(buf, size);
+    }
+    int64_t n = fill();
+    if (n < 0) {
+      return n;
+    }
+    available = end_ - pos_;
+    if (available == 0) {
+      return 0;
+    }
+  }
+  if (size > available) {
+    size = available;
+  }
+  memcpy(buf, buffer_.data() + pos_, size);
+  pos_ += size;
+  return (int64_t) size;
+}
+
+int64_t BufferedReader::readExact(void *buf, size_t size) {
+  unsigned char *out = (unsigned char *) buf;
+  size_t total = 0;
+  while (total < size) {
+    int64_t n = read(out + total, size - total);
+    if (n < 0) {
+      return n;
+    }
+    if (n == 0) {
+      break;
+    }
+    total += (size_t) n;
+  }
+  return (int64_t) total;
+}
+
+int64_t BufferedReader::peek(const void **data, size_t size) {
+  if (size > buffer_.size()) {
+    size = buffer_.size();
+  }
+  while (end_ - pos_ < size && !eof_) {
+    int64_t n = fill();
+    if (n < 0) {
+      return n;
+    }
+  }
+  *data = buffer_.data() + pos_;
+  return (int64_t) ((end_ - pos_ < size) ? (end_ - pos_) : size);
+}
+
+int64_t BufferedReader::readLine(std::string &line) {
+  int64_t consumed = 0;
+  line.clear();
+  for (;;) {
+    if (pos_ == end_) {
+      int64_t n = fill();
+      if (n < 0) {
+        return n;
+      }
+      if (pos_ == end_) {
+        break;
+      }
+    }
+    const unsigned char *start = buffer_.data() + pos_;
+    const unsigned char *newline = (const unsigned char *) memchr(start, '\n', end_ - pos_);
+    if (newline) {
+      size_t length = (size_t) (newline - start);
+      line.append((const char *) start, length);
+      pos_ += length + 1;
+      consumed += (int64_t) length + 1;
+      if (!line.empty() && line[line.length() - 1] == '\r') {
+        line.pop_back();
+      }
+      return consumed;
+    }
+    line.append((const char *) start, end_ - pos_);
+    consumed += (int64_t) (end_ - pos_);
+    pos_ = end_;
+  }
+  return consumed;
+}
+
+size_t BufferedReader::bufferSize() const {
+  return buffer_.size();
+}
+
+BufferedWriter::BufferedWriter(FileHandler &handler, size_t buffer_size)
+    : handler_(handler), buffer_(buffer_size ? buffer_size : 1), used_(0) {
+}
+
+BufferedWriter::~BufferedWriter() {
+  flush();
+}
+
+int64_t BufferedWriter::writeThrough(const unsigned char *data, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    int64_t n = handler_.write64(data + total, size - total);
+    if (n < 0) {
+      return n;
+    }
+    if (n == 0) {
+      break;
+    }
+    total += (size_t) n;
+  }
+  return (int64_t) total;
+}
+
+int64_t BufferedWriter::write(const void *buf, size_t size) {
+  const unsigned char *data = (const unsigned char *) buf;
+  size_t remaining = size;
+
+  if (used_ > 0 && used_ + remaining > buffer_.size()) {
+    size_t chunk = buffer_.size() - used_;
+    memcpy(buffer_.data() + used_, data, chunk);
+    used_ += chunk;
+    data += chunk;
+    remaining -= chunk;
+    int rc = flush();
+    if (rc) {
+      return -((int64_t) rc);
+    }
+  }
+
+  if (remaining >= buffer_.size()) {
+    int64_t n = writeThrough(data, remaining);
+    if (n < 0) {
+      return n;
+    }
+    if ((size_t) n < remaining) {
+      return -((int64_t) EIO);
+    }
+  } else if (remaining > 0) {
+    memcpy(buffer_.data() + used_, data, remaining);
+    used_ += remaining;
+  }
+
+  return (int64_t) size;
+}
+
+int BufferedWriter::flush() {
+  if (used_ == 0) {
+    return 0;
+  }
+  int64_t n = writeThrough(buffer_.data(), used_);
+  if (n < 0) {
+    return (int) -n;
+  }
+  if ((size_t) n < used_) {
+    memmove(buffer_.data(), buffer_.data() + n, used_ - (size_t) n);
+    used_ -= (size_t) n;
+    return EIO;
+  }
+  used_ = 0;
+  return 0;
+}
+
+int BufferedWriter::close() {
+  int rc = flush();
+  int close_rc = handler_.close();
+  return rc ? rc : close_rc;
+}
+
+int BufferedWriter::commit() {
+  int rc = close();
+  if (rc) {
+    return rc;
+  }
+  return handler_.commit();
+}
+
+size_t BufferedWriter::bufferSize() const {
+  return buffer_.size();
+}
+
+}
+}
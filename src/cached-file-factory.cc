@@ -0,0 +1,170 @@
+/**
+ * @file	cached-file-factory.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/cached-file-factory.h"
+
+#include <mutex>
+
+namespace jcu {
+namespace file {
+
+CachedFileFactory::CachedFileFactory(FileFactory *inner, std::chrono::milliseconds ttl, size_t max_entries)
+    : inner_(inner), ttl_(ttl), max_entries_(max_entries ? max_entries : 1) {
+}
+
+int CachedFileFactory::cachedStat(const Path &path, FileInfo &info) const {
+  const Path::system_string_t &key = path.getSystemString();
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto found = cache_.find(key);
+    if (found != cache_.end() && found->second.expires > now) {
+      info = found->second.info;
+      return found->second.err;
+    }
+  }
+
+  Entry entry;
+  entry.err = inner_->stat(path, entry.info, true);
+  entry.expires = now + ttl_;
+  info = entry.info;
+
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (cache_.size() >= max_entries_) {
+    for (auto it = cache_.begin(); it != cache_.end();) {
+      if (it->second.expires <= now)
+        it = cache_.erase(it);
+      else
+        ++it;
+    }
+    if (cache_.size() >= max_entries_)
+      cache_.clear();
+  }
+  cache_[key] = entry;
+  return entry.err;
+}
+
+void CachedFileFactory::eraseTree(const Path &path) const {
+  const Path::system_string_t &key = path.getSystemString();
+  if (key.empty())
+    return;
+  size_t prefix_len = Path::isSeparator(key[key.length() - 1]) ? key.length() - 1 : key.length();
+  for (auto it = cache_.begin(); it != cache_.end();) {
+    const Path::system_string_t &cached = it->first;
+    if (cached == key
+        || (cached.length() > prefix_len && Path::isSeparator(cached[prefix_len])
+            && cached.compare(0, prefix_len, key, 0, prefix_len) == 0))
+      it = cache_.erase(it);
+    else
+      ++it;
+  }
+}
+
+void CachedFileFactory::invalidate(const Path &path) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  cache_.erase(path.getSystemString());
+}
+
+void CachedFileFactory::invalidateAll() {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  cache_.clear();
+}
+
+std::unique_ptr<FileHandler> CachedFileFactory::createFileHandle(const Path &file_path) const {
+  return inner_->createFileHandle(file_path);
+}
+
+int CachedFileFactory::makeDirectory(const Path &path, bool recursive) const {
+  int rc = inner_->makeDirectory(path, recursive);
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (recursive) {
+    // every missing parent may have been created
+    for (Path cur = path; !cur.isEmpty(); cur = cur.parent()) {
+      cache_.erase(cur.getSystemString());
+    }
+  } else {
+    cache_.erase(path.getSystemString());
+  }
+  return rc;
+}
+
+int CachedFileFactory::makeDirectories(const std::vector<Path> &paths, int threads) const {
+  int rc = inner_->makeDirectories(paths, threads);
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  for (const Path &path : paths) {
+    for (Path cur = path; !cur.isEmpty(); cur = cur.parent()) {
+      cache_.erase(cur.getSystemString());
+    }
+  }
+  return rc;
+}
+
+Path CachedFileFactory::getTempDir(int *perr) const {
+  return inner_->getTempDir(perr);
+}
+
+Path CachedFileFactory::generateTempPath(const char *prefix, int *perr) const {
+  return inner_->generateTempPath(prefix, perr);
+}
+
+bool CachedFileFactory::isFile(const Path &path) const {
+  FileInfo info;
+  return cachedStat(path, info) == 0 && info.isFile();
+}
+
+bool CachedFileFactory::isDirectory(const Path &path) const {
+  FileInfo info;
+  return cachedStat(path, info) == 0 && info.isDirectory();
+}
+
+bool CachedFileFactory::isDevice(const Path &path) const {
+  FileInfo info;
+  return cachedStat(path, info) == 0 && info.isDevice();
+}
+
+int CachedFileFactory::readdir(std::list<Path> &out, const Path &path) const {
+  return inner_->readdir(out, path);
+}
+
+int CachedFileFactory::readdir(PathTable &table, PathTable::Id dir) const {
+  return inner_->readdir(table, dir);
+}
+
+int64_t CachedFileFactory::getFileSize(const Path &path) const {
+  FileInfo info;
+  int rc = cachedStat(path, info);
+  if (rc) {
+    return -((int64_t) rc);
+  }
+  return info.size;
+}
+
+int CachedFileFactory::stat(const Path &path, FileInfo &info, bool follow_symlinks) const {
+  if (!follow_symlinks) {
+    return inner_->stat(path, info, follow_symlinks);
+  }
+  return cachedStat(path, info);
+}
+
+int CachedFileFactory::copyFile(const Path &src, const Path &dst, int flags) const {
+  int rc = inner_->copyFile(src, dst, flags);
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  cache_.erase(dst.getSystemString());
+  return rc;
+}
+
+int CachedFileFactory::moveFile(const Path &src, const Path &dst, int flags) const {
+  int rc = inner_->moveFile(src, dst, flags);
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  // a moved directory takes its whole subtree along
+  eraseTree(src);
+  eraseTree(dst);
+  return rc;
+}
+
+}
+}
@@ -0,0 +1,210 @@
+/**
+ * @file	durability-batch.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/durability-batch.h"
+#include "jcu-file/path-set.h"
+#include "parallel-for.h"
+
+#include <errno.h>
+
+#ifndef _WIN32
+#include "jcu-file/posix/posix-file-handler.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace jcu {
+namespace file {
+
+namespace {
+
+#ifndef _WIN32
+int syncDirectory(const Path &path) {
+  int fd;
+  do {
+    fd = ::open(path.getSystemString().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return errno;
+  int rc;
+  do {
+    rc = ::fsync(fd);
+  } while (rc != 0 && errno == EINTR);
+  int err = (rc != 0) ? errno : 0;
+  ::close(fd);
+  if (err == EINVAL || err == EROFS)
+    err = 0;
+  return err;
+}
+#else
+int syncDirectory(const Path &path) {
+  // NTFS journals directory changes itself
+  (void) path;
+  return 0;
+}
+#endif
+
+}
+
+DurabilityBatch::DurabilityBatch(int threads)
+    : threads_(threads) {
+}
+
+void DurabilityBatch::add(FileHandler &handler, bool data_only, AsyncCallback callback) {
+  files_.push_back(FileItem{&handler, data_only, std::move(callback)});
+}
+
+void DurabilityBatch::addDirectory(const Path &path, AsyncCallback callback) {
+  directories_.push_back(DirectoryItem{path, std::move(callback)});
+}
+
+size_t DurabilityBatch::size() const {
+  return files_.size() + directories_.size();
+}
+
+bool DurabilityBatch::empty() const {
+  return files_.empty() && directories_.empty();
+}
+
+void DurabilityBatch::clear() {
+  files_.clear();
+  directories_.clear();
+}
+
+int DurabilityBatch::flush() {
+  std::vector<FileItem> files;
+  std::vector<DirectoryItem> directories;
+  files.swap(files_);
+  directories.swap(directories_);
+
+#if defined(__linux__)
+  // Start writeback of every file before waiting on any of them, so the
+  // device sees one deep queue instead of one file at a time.
+  for (auto &item : files) {
+    posix::PosixFileHandler *posix_handler = dynamic_cast<posix::PosixFileHandler *>(item.handler);
+    if (posix_handler && posix_handler->isOpen())
+      ::sync_file_range(posix_handler->fd(), 0, 0, SYNC_FILE_RANGE_WRITE);
+  }
+#endif
+
+  std::vector<int> file_results(files.size(), 0);
+  parallelFor(files.size(), threads_, [&](size_t i) {
+    file_results[i] = files[i].handler->sync(files[i].data_only);
+    // every item runs, errors are reported per item below
+    return 0;
+  });
+
+  // Directories are synced after the files they may name
+  std::vector<Path> unique_directories;
+  PathMap<size_t> directory_index;
+  for (auto &item : directories) {
+    if (directory_index.insert(item.path, unique_directories.size()))
+      unique_directories.push_back(item.path);
+  }
+  std::vector<int> directory_results(unique_directories.size(), 0);
+  parallelFor(unique_directories.size(), threads_, [&](size_t i) {
+    directory_results[i] = syncDirectory(unique_directories[i]);
+    return 0;
+  });
+
+  int first_error = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    int rc = file_results[i];
+    if (rc && !first_error)
+      first_error = rc;
+    if (files[i].callback)
+      files[i].callback(rc ? -((int64_t) rc) : 0);
+  }
+  for (auto &item : directories) {
+    int rc = directory_results[*directory_index.find(item.path)];
+    if (rc && !first_error)
+      first_error = rc;
+    if (item.callback)
+      item.callback(rc ? -((int64_t) rc) : 0);
+  }
+  return first_error;
+}
+
+SyncScheduler::SyncScheduler(const SyncSchedulerOptions &options)
+    : options_(options), pending_(options.threads), submitted_(0), completed_(0), flush_requested_(false), stop_(false) {
+  thread_ = std::thread(&SyncScheduler::threadMain, this);
+}
+
+SyncScheduler::~SyncScheduler() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  thread_.join();
+}
+
+void SyncScheduler::submit(FileHandler &handler, bool data_only, AsyncCallback callback) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (pending_.empty())
+    first_pending_ = std::chrono::steady_clock::now();
+  pending_.add(handler, data_only, std::move(callback));
+  submitted_++;
+  if (pending_.size() == 1 || pending_.size() >= options_.max_pending)
+    work_cv_.notify_one();
+}
+
+void SyncScheduler::submitDirectory(const Path &path, AsyncCallback callback) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (pending_.empty())
+    first_pending_ = std::chrono::steady_clock::now();
+  pending_.addDirectory(path, std::move(callback));
+  submitted_++;
+  if (pending_.size() == 1 || pending_.size() >= options_.max_pending)
+    work_cv_.notify_one();
+}
+
+void SyncScheduler::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t target = submitted_;
+  if (completed_ >= target)
+    return;
+  flush_requested_ = true;
+  work_cv_.notify_one();
+  done_cv_.wait(lock, [&]() { return completed_ >= target; });
+}
+
+void SyncScheduler::threadMain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    if (pending_.empty()) {
+      flush_requested_ = false;
+      if (stop_)
+        break;
+      work_cv_.wait(lock);
+      continue;
+    }
+    if (!stop_ && !flush_requested_ && pending_.size() < options_.max_pending) {
+      auto deadline = first_pending_ + options_.max_delay;
+      if (std::chrono::steady_clock::now() < deadline) {
+        work_cv_.wait_until(lock, deadline);
+        continue;
+      }
+    }
+
+    DurabilityBatch batch(std::move(pending_));
+    pending_.clear();
+    uint64_t upto = submitted_;
+    flush_requested_ = false;
+
+    lock.unlock();
+    batch.flush();
+    lock.lock();
+
+    completed_ = upto;
+    done_cv_.notify_all();
+  }
+}
+
+}
+}
@@ -0,0 +1,55 @@
+/**
+ * @file	extent-iterator.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/extent-iterator.h"
+
+namespace jcu {
+namespace file {
+
+ExtentIterator::ExtentIterator(FileHandler &handler, int64_t offset, int64_t end)
+    : handler_(&handler), pos_(offset), end_(end), extent_{0, 0}, error_(0) {
+  if (end_ < 0) {
+    end_ = handler.getFileSize();
+    if (end_ < 0) {
+      error_ = (int) -end_;
+      end_ = 0;
+    }
+  }
+}
+
+bool ExtentIterator::next() {
+  if (error_ || pos_ >= end_)
+    return false;
+  int64_t data_offset = 0;
+  int64_t data_length = 0;
+  int rc = handler_->nextExtent(pos_, data_offset, data_length);
+  if (rc) {
+    error_ = rc;
+    return false;
+  }
+  if (data_length <= 0 || data_offset >= end_) {
+    pos_ = end_;
+    return false;
+  }
+  if (data_offset + data_length > end_)
+    data_length = end_ - data_offset;
+  extent_.offset = data_offset;
+  extent_.length = data_length;
+  pos_ = data_offset + data_length;
+  return true;
+}
+
+const FileExtent &ExtentIterator::extent() const {
+  return extent_;
+}
+
+int ExtentIterator::error() const {
+  return error_;
+}
+
+}
+}
@@ -0,0 +1,984 @@
+/**
+ * @file	file-hasher.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/file-hasher.h"
+#include "jcu-file/aligned-buffer-pool.h"
+#include "parallel-for.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// x86-64 kernels are built with per-function target attributes and picked
+// with cpuid at runtime; define JCU_FILE_PORTABLE_HASH to leave them out.
+#if !defined(JCU_FILE_PORTABLE_HASH) && (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define JCU_HASH_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#define JCU_HASH_TARGET(x) __attribute__((target(x)))
+#endif
+
+namespace jcu {
+namespace file {
+
+namespace {
+
+inline uint32_t readLE32(const uint8_t *p) {
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+inline uint64_t readLE64(const uint8_t *p) {
+  return (uint64_t) readLE32(p) | ((uint64_t) readLE32(p + 4) << 32);
+}
+
+inline uint32_t readBE32(const uint8_t *p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+inline void writeBE32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t) (v >> 24);
+  p[1] = (uint8_t) (v >> 16);
+  p[2] = (uint8_t) (v >> 8);
+  p[3] = (uint8_t) v;
+}
+
+inline void writeBE64(uint8_t *p, uint64_t v) {
+  writeBE32(p, (uint32_t) (v >> 32));
+  writeBE32(p + 4, (uint32_t) v);
+}
+
+inline uint64_t rotl64(uint64_t v, int n) {
+  return (v << n) | (v >> (64 - n));
+}
+
+inline uint32_t rotr32(uint32_t v, int n) {
+  return (v >> n) | (v << (32 - n));
+}
+
+inline uint64_t swap64(uint64_t v) {
+  v = ((v & 0x00ff00ff00ff00ffULL) << 8) | ((v >> 8) & 0x00ff00ff00ff00ffULL);
+  v = ((v & 0x0000ffff0000ffffULL) << 16) | ((v >> 16) & 0x0000ffff0000ffffULL);
+  return (v << 32) | (v >> 32);
+}
+
+size_t digestSize(HashAlgorithm algorithm) {
+  switch (algorithm) {
+    case HASH_CRC32C:
+      return 4;
+    case HASH_XXH3_64:
+      return 8;
+    case HASH_SHA256:
+      return 32;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// CRC32C
+
+const uint32_t CRC32C_POLY = 0x82f63b78;
+
+// lanes of the interleaved hardware loop
+const size_t CRC32C_LANE = 1024;
+
+// product of two polynomials modulo the CRC polynomial, bit-reflected
+uint32_t multModP(uint32_t a, uint32_t b) {
+  uint32_t m = 1u << 31;
+  uint32_t p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+        break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+  }
+  return p;
+}
+
+struct Crc32cTables {
+  // slicing-by-8
+  uint32_t slice[8][256];
+  // x^(2^n) modulo the polynomial
+  uint32_t x2n[32];
+  // multiply by x^(8 * CRC32C_LANE) and x^(16 * CRC32C_LANE), one table per byte
+  uint32_t shift1[4][256];
+  uint32_t shift2[4][256];
+
+  Crc32cTables() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++)
+        c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+      slice[0][i] = c;
+    }
+    for (int k = 1; k < 8; k++) {
+      for (int i = 0; i < 256; i++)
+        slice[k][i] = (slice[k - 1][i] >> 8) ^ slice[0][slice[k - 1][i] & 0xff];
+    }
+
+    uint32_t p = 1u << 30;
+    x2n[0] = p;
+    for (int n = 1; n < 32; n++)
+      x2n[n] = p = multModP(p, p);
+
+    uint32_t x1 = xPow8n(CRC32C_LANE);
+    uint32_t x2 = xPow8n(CRC32C_LANE * 2);
+    for (int k = 0; k < 4; k++) {
+      for (uint32_t b = 0; b < 256; b++) {
+        shift1[k][b] = multModP(x1, b << (8 * k));
+        shift2[k][b] = multModP(x2, b << (8 * k));
+      }
+    }
+  }
+
+  // x^(8 * n) modulo the polynomial
+  uint32_t xPow8n(uint64_t n) const {
+    uint32_t p = 1u << 31;
+    int k = 3;
+    while (n) {
+      if (n & 1)
+        p = multModP(x2n[k & 31], p);
+      n >>= 1;
+      k++;
+    }
+    return p;
+  }
+};
+
+const Crc32cTables &crc32cTables() {
+  static const Crc32cTables tables;
+  return tables;
+}
+
+uint32_t crc32cPortable(uint32_t crc, const uint8_t *p, size_t n) {
+  const Crc32cTables &t = crc32cTables();
+  while (n >= 8) {
+    uint64_t v = readLE64(p) ^ crc;
+    crc = t.slice[7][v & 0xff] ^ t.slice[6][(v >> 8) & 0xff] ^ t.slice[5][(v >> 16) & 0xff] ^
+        t.slice[4][(v >> 24) & 0xff] ^ t.slice[3][(v >> 32) & 0xff] ^ t.slice[2][(v >> 40) & 0xff] ^
+        t.slice[1][(v >> 48) & 0xff] ^ t.slice[0][v >> 56];
+    p += 8;
+    n -= 8;
+  }
+  while (n--)
+    crc = (crc >> 8) ^ t.slice[0][(crc ^ *p++) & 0xff];
+  return crc;
+}
+
+// ---------------------------------------------------------------------------
+// XXH3 64-bit, seed 0 and the default secret
+
+const uint64_t PRIME32_1 = 0x9E3779B1U;
+const uint64_t PRIME32_2 = 0x85EBCA77U;
+const uint64_t PRIME32_3 = 0xC2B2AE3DU;
+const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+const size_t XXH3_STRIPE = 64;
+const size_t XXH3_SECRET_SIZE = 192;
+// stripes per block, each consumes 8 more bytes of the secret
+const size_t XXH3_BLOCK_STRIPES = (XXH3_SECRET_SIZE - XXH3_STRIPE) / 8;
+const size_t XXH3_SECRET_LIMIT = XXH3_SECRET_SIZE - XXH3_STRIPE;
+const size_t XXH3_MIDSIZE_MAX = 240;
+
+alignas(64) const uint8_t XXH3_SECRET[XXH3_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+inline uint64_t mulFold64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 product = (unsigned __int128) a * b;
+  return (uint64_t) product ^ (uint64_t) (product >> 64);
+#else
+  uint64_t lo_lo = (a & 0xffffffff) * (b & 0xffffffff);
+  uint64_t hi_lo = (a >> 32) * (b & 0xffffffff);
+  uint64_t lo_hi = (a & 0xffffffff) * (b >> 32);
+  uint64_t hi_hi = (a >> 32) * (b >> 32);
+  uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+  uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+  uint64_t lower = (cross << 32) | (lo_lo & 0xffffffff);
+  return lower ^ upper;
+#endif
+}
+
+inline uint64_t xxh64Avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64_t xxh3Avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= PRIME_MX1;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64_t xxh3Rrmxmx(uint64_t h, uint64_t len) {
+  h ^= rotl64(h, 49) ^ rotl64(h, 24);
+  h *= PRIME_MX2;
+  h ^= (h >> 35) + len;
+  h *= PRIME_MX2;
+  return h ^ (h >> 28);
+}
+
+inline uint64_t xxh3Mix16(const uint8_t *input, const uint8_t *secret) {
+  return mulFold64(readLE64(input) ^ readLE64(secret), readLE64(input + 8) ^ readLE64(secret + 8));
+}
+
+// whole input of at most XXH3_MIDSIZE_MAX bytes
+uint64_t xxh3Short(const uint8_t *input, size_t len) {
+  const uint8_t *secret = XXH3_SECRET;
+  if (len == 0)
+    return xxh64Avalanche(readLE64(secret + 56) ^ readLE64(secret + 64));
+  if (len <= 3) {
+    uint32_t combined = ((uint32_t) input[0] << 16) | ((uint32_t) input[len >> 1] << 24) |
+        (uint32_t) input[len - 1] | ((uint32_t) len << 8);
+    uint64_t bitflip = readLE32(secret) ^ readLE32(secret + 4);
+    return xxh64Avalanche((uint64_t) combined ^ bitflip);
+  }
+  if (len <= 8) {
+    uint64_t bitflip = readLE64(secret + 8) ^ readLE64(secret + 16);
+    uint64_t input64 = readLE32(input + len - 4) + ((uint64_t) readLE32(input) << 32);
+    return xxh3Rrmxmx(input64 ^ bitflip, len);
+  }
+  if (len <= 16) {
+    uint64_t lo = readLE64(input) ^ (readLE64(secret + 24) ^ readLE64(secret + 32));
+    uint64_t hi = readLE64(input + len - 8) ^ (readLE64(secret + 40) ^ readLE64(secret + 48));
+    return xxh3Avalanche(len + swap64(lo) + hi + mulFold64(lo, hi));
+  }
+
+  uint64_t acc = len * PRIME64_1;
+  if (len <= 128) {
+    if (len > 32) {
+      if (len > 64) {
+        if (len > 96) {
+          acc += xxh3Mix16(input + 48, secret + 96);
+          acc += xxh3Mix16(input + len - 64, secret + 112);
+        }
+        acc += xxh3Mix16(input + 32, secret + 64);
+        acc += xxh3Mix16(input + len - 48, secret + 80);
+      }
+      acc += xxh3Mix16(input + 16, secret + 32);
+      acc += xxh3Mix16(input + len - 32, secret + 48);
+    }
+    acc += xxh3Mix16(input, secret);
+    acc += xxh3Mix16(input + len - 16, secret + 16);
+    return xxh3Avalanche(acc);
+  }
+
+  for (size_t i = 0; i < 8; i++)
+    acc += xxh3Mix16(input + 16 * i, secret + 16 * i);
+  acc = xxh3Avalanche(acc);
+  uint64_t acc_end = xxh3Mix16(input + len - 16, secret + 136 - 17);
+  for (size_t i = 8; i < len / 16; i++)
+    acc_end += xxh3Mix16(input + 16 * i, secret + 16 * (i - 8) + 3);
+  return xxh3Avalanche(acc + acc_end);
+}
+
+void xxh3AccumulatePortable(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t stripes) {
+  for (size_t s = 0; s < stripes; s++, input += XXH3_STRIPE, secret += 8) {
+    for (size_t i = 0; i < 8; i++) {
+      uint64_t data = readLE64(input + i * 8);
+      uint64_t key = data ^ readLE64(secret + i * 8);
+      acc[i ^ 1] += data;
+      acc[i] += (key & 0xffffffff) * (key >> 32);
+    }
+  }
+}
+
+void xxh3ScramblePortable(uint64_t *acc, const uint8_t *secret) {
+  for (size_t i = 0; i < 8; i++) {
+    uint64_t v = acc[i];
+    v ^= v >> 47;
+    v ^= readLE64(secret + i * 8);
+    acc[i] = v * PRIME32_1;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// SHA-256
+
+const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const uint32_t SHA256_INIT[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+void sha256BlocksPortable(uint32_t *state, const uint8_t *data, size_t blocks) {
+  uint32_t w[64];
+  for (; blocks; blocks--, data += 64) {
+    for (int i = 0; i < 16; i++)
+      w[i] = readBE32(data + i * 4);
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+      uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+      uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// x86-64 kernels
+
+#if defined(JCU_HASH_X86)
+
+JCU_HASH_TARGET("sse4.2")
+uint32_t crc32cSse42(uint32_t crc, const uint8_t *p, size_t n) {
+  // crc32 has a latency of three cycles and a throughput of one, so three
+  // independent lanes keep the unit busy; the lanes are merged by shifting
+  // the earlier ones over the later ones with the precomputed tables
+  if (n >= CRC32C_LANE * 3) {
+    const Crc32cTables &t = crc32cTables();
+    do {
+      uint64_t c0 = crc, c1 = 0, c2 = 0;
+      for (size_t i = 0; i < CRC32C_LANE; i += 8) {
+        uint64_t v0, v1, v2;
+        memcpy(&v0, p + i, 8);
+        memcpy(&v1, p + CRC32C_LANE + i, 8);
+        memcpy(&v2, p + CRC32C_LANE * 2 + i, 8);
+        c0 = _mm_crc32_u64(c0, v0);
+        c1 = _mm_crc32_u64(c1, v1);
+        c2 = _mm_crc32_u64(c2, v2);
+      }
+      crc = t.shift2[0][c0 & 0xff] ^ t.shift2[1][(c0 >> 8) & 0xff] ^
+          t.shift2[2][(c0 >> 16) & 0xff] ^ t.shift2[3][(c0 >> 24) & 0xff] ^
+          t.shift1[0][c1 & 0xff] ^ t.shift1[1][(c1 >> 8) & 0xff] ^
+          t.shift1[2][(c1 >> 16) & 0xff] ^ t.shift1[3][(c1 >> 24) & 0xff] ^
+          (uint32_t) c2;
+      p += CRC32C_LANE * 3;
+      n -= CRC32C_LANE * 3;
+    } while (n >= CRC32C_LANE * 3);
+  }
+
+  uint64_t c = crc;
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    c = _mm_crc32_u64(c, v);
+  }
+  crc = (uint32_t) c;
+  for (; n; p++, n--)
+    crc = _mm_crc32_u8(crc, *p);
+  return crc;
+}
+
+JCU_HASH_TARGET("avx2")
+void xxh3AccumulateAvx2(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t stripes) {
+  __m256i acc0 = _mm256_loadu_si256((const __m256i *) acc);
+  __m256i acc1 = _mm256_loadu_si256((const __m256i *) (acc + 4));
+  for (size_t s = 0; s < stripes; s++, input += XXH3_STRIPE, secret += 8) {
+    __m256i data0 = _mm256_loadu_si256((const __m256i *) input);
+    __m256i data1 = _mm256_loadu_si256((const __m256i *) (input + 32));
+    __m256i key0 = _mm256_xor_si256(data0, _mm256_loadu_si256((const __m256i *) secret));
+    __m256i key1 = _mm256_xor_si256(data1, _mm256_loadu_si256((const __m256i *) (secret + 32)));
+    __m256i product0 = _mm256_mul_epu32(key0, _mm256_srli_epi64(key0, 32));
+    __m256i product1 = _mm256_mul_epu32(key1, _mm256_srli_epi64(key1, 32));
+    // each lane also gets the input of its neighbour
+    acc0 = _mm256_add_epi64(acc0, _mm256_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc1 = _mm256_add_epi64(acc1, _mm256_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc0 = _mm256_add_epi64(acc0, product0);
+    acc1 = _mm256_add_epi64(acc1, product1);
+  }
+  _mm256_storeu_si256((__m256i *) acc, acc0);
+  _mm256_storeu_si256((__m256i *) (acc + 4), acc1);
+}
+
+JCU_HASH_TARGET("avx2")
+void xxh3ScrambleAvx2(uint64_t *acc, const uint8_t *secret) {
+  const __m256i prime = _mm256_set1_epi32((int) PRIME32_1);
+  for (int i = 0; i < 2; i++) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (acc + i * 4));
+    v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 47));
+    v = _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i *) (secret + i * 32)));
+    // 64-bit multiply by a 32-bit constant from two 32x32 products
+    __m256i lo = _mm256_mul_epu32(v, prime);
+    __m256i hi = _mm256_mul_epu32(_mm256_shuffle_epi32(v, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+    _mm256_storeu_si256((__m256i *) (acc + i * 4), _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+  }
+}
+
+JCU_HASH_TARGET("sha,sse4.1,ssse3")
+void sha256BlocksShaNi(uint32_t *state, const uint8_t *data, size_t blocks) {
+  const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  // the instructions want the state as ABEF and CDGH
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0xB1);
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) (state + 4)), 0x1B);
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+  for (; blocks; blocks--, data += 64) {
+    __m128i abef = state0;
+    __m128i cdgh = state1;
+    __m128i w[4];
+    // unrolled, the schedule slots stay in registers
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; i++) {
+      if (i < 4) {
+        w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + i * 16)), byte_swap);
+      } else {
+        // the next four schedule words from the previous sixteen
+        __m128i next = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+        next = _mm_add_epi32(next, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+        w[i & 3] = _mm_sha256msg2_epu32(next, w[(i + 3) & 3]);
+      }
+      __m128i msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *) (SHA256_K + i * 4)));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);
+  state1 = _mm_shuffle_epi32(state1, 0xB1);
+  _mm_storeu_si128((__m128i *) state, _mm_blend_epi16(tmp, state1, 0xF0));
+  _mm_storeu_si128((__m128i *) (state + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+#endif
+
+struct Kernels {
+  uint32_t (*crc32c)(uint32_t crc, const uint8_t *p, size_t n);
+  void (*xxh3Accumulate)(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t stripes);
+  void (*xxh3Scramble)(uint64_t *acc, const uint8_t *secret);
+  void (*sha256Blocks)(uint32_t *state, const uint8_t *data, size_t blocks);
+  const char *crc32c_name;
+  const char *xxh3_name;
+  const char *sha256_name;
+
+  Kernels()
+      : crc32c(crc32cPortable),
+        xxh3Accumulate(xxh3AccumulatePortable),
+        xxh3Scramble(xxh3ScramblePortable),
+        sha256Blocks(sha256BlocksPortable),
+        crc32c_name("portable"),
+        xxh3_name("portable"),
+        sha256_name("portable") {
+#if defined(JCU_HASH_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+      crc32c = crc32cSse42;
+      crc32c_name = "sse4.2";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      xxh3Accumulate = xxh3AccumulateAvx2;
+      xxh3Scramble = xxh3ScrambleAvx2;
+      xxh3_name = "avx2";
+    }
+    unsigned int eax, ebx, ecx, edx;
+    if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3") &&
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29))) {
+      sha256Blocks = sha256BlocksShaNi;
+      sha256_name = "sha-ni";
+    }
+#endif
+  }
+};
+
+const Kernels &kernels() {
+  static const Kernels selected;
+  return selected;
+}
+
+// stripes of a block that was started earlier may be pending
+void xxh3ConsumeStripes(const Kernels &k, uint64_t *acc, size_t &stripes_so_far,
+                        const uint8_t *input, size_t stripes) {
+  const uint8_t *secret = XXH3_SECRET;
+  size_t room = XXH3_BLOCK_STRIPES - stripes_so_far;
+  if (stripes >= room) {
+    k.xxh3Accumulate(acc, input, secret + stripes_so_far * 8, room);
+    k.xxh3Scramble(acc, secret + XXH3_SECRET_LIMIT);
+    input += room * XXH3_STRIPE;
+    stripes -= room;
+    while (stripes >= XXH3_BLOCK_STRIPES) {
+      k.xxh3Accumulate(acc, input, secret, XXH3_BLOCK_STRIPES);
+      k.xxh3Scramble(acc, secret + XXH3_SECRET_LIMIT);
+      input += XXH3_BLOCK_STRIPES * XXH3_STRIPE;
+      stripes -= XXH3_BLOCK_STRIPES;
+    }
+    stripes_so_far = 0;
+  }
+  if (stripes) {
+    k.xxh3Accumulate(acc, input, secret + stripes_so_far * 8, stripes);
+    stripes_so_far += stripes;
+  }
+}
+
+uint32_t crc32cFromValue(const HashValue &value) {
+  return readBE32(value.bytes);
+}
+
+}
+
+// ---------------------------------------------------------------------------
+
+HashValue::HashValue()
+    : algorithm(HASH_CRC32C), size(0) {
+  memset(bytes, 0, sizeof(bytes));
+}
+
+std::string HashValue::toHex() const {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(size * 2);
+  for (size_t i = 0; i < size; i++) {
+    hex.push_back(digits[bytes[i] >> 4]);
+    hex.push_back(digits[bytes[i] & 0xf]);
+  }
+  return hex;
+}
+
+bool HashValue::fromHex(HashAlgorithm algorithm, const std::string &hex, HashValue &out) {
+  size_t size = digestSize(algorithm);
+  if (size == 0 || hex.size() != size * 2)
+    return false;
+  HashValue value;
+  value.algorithm = algorithm;
+  value.size = size;
+  for (size_t i = 0; i < hex.size(); i++) {
+    char c = hex[i];
+    int v;
+    if (c >= '0' && c <= '9')
+      v = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      v = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      v = c - 'A' + 10;
+    else
+      return false;
+    value.bytes[i / 2] = (uint8_t) ((value.bytes[i / 2] << 4) | v);
+  }
+  out = value;
+  return true;
+}
+
+bool HashValue::operator==(const HashValue &other) const {
+  return algorithm == other.algorithm && size == other.size && memcmp(bytes, other.bytes, size) == 0;
+}
+
+bool HashValue::operator!=(const HashValue &other) const {
+  return !(*this == other);
+}
+
+Hasher::Hasher(HashAlgorithm algorithm)
+    : algorithm_(algorithm) {
+  reset();
+}
+
+void Hasher::reset() {
+  total_ = 0;
+  crc_ = 0xffffffff;
+  static const uint64_t xxh3_init[8] = {
+      PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1,
+  };
+  memcpy(xxh3_.acc, xxh3_init, sizeof(xxh3_.acc));
+  xxh3_.buffered = 0;
+  xxh3_.stripes = 0;
+  memcpy(sha256_.h, SHA256_INIT, sizeof(sha256_.h));
+  sha256_.buffered = 0;
+}
+
+void Hasher::update(const void *data, size_t size) {
+  const Kernels &k = kernels();
+  const uint8_t *p = (const uint8_t *) data;
+  total_ += size;
+
+  switch (algorithm_) {
+    case HASH_CRC32C:
+      crc_ = k.crc32c(crc_, p, size);
+      break;
+
+    case HASH_XXH3_64: {
+      Xxh3State &s = xxh3_;
+      const size_t buffer_size = sizeof(s.buffer);
+      if (size <= buffer_size - s.buffered) {
+        memcpy(s.buffer + s.buffered, p, size);
+        s.buffered += size;
+        break;
+      }
+      // the buffer is consumed only once more input follows it, so the
+      // last stripe is always still around for digest()
+      if (s.buffered) {
+        size_t fill = buffer_size - s.buffered;
+        memcpy(s.buffer + s.buffered, p, fill);
+        p += fill;
+        size -= fill;
+        xxh3ConsumeStripes(k, s.acc, s.stripes, s.buffer, buffer_size / XXH3_STRIPE);
+        s.buffered = 0;
+      }
+      if (size > buffer_size) {
+        size_t stripes = (size - 1) / XXH3_STRIPE;
+        xxh3ConsumeStripes(k, s.acc, s.stripes, p, stripes);
+        p += stripes * XXH3_STRIPE;
+        size -= stripes * XXH3_STRIPE;
+        memcpy(s.buffer + buffer_size - XXH3_STRIPE, p - XXH3_STRIPE, XXH3_STRIPE);
+      }
+      memcpy(s.buffer, p, size);
+      s.buffered = size;
+      break;
+    }
+
+    case HASH_SHA256: {
+      Sha256State &s = sha256_;
+      if (s.buffered) {
+        size_t fill = sizeof(s.buffer) - s.buffered;
+        if (fill > size)
+          fill = size;
+        memcpy(s.buffer + s.buffered, p, fill);
+        s.buffered += fill;
+        p += fill;
+        size -= fill;
+        if (s.buffered < sizeof(s.buffer))
+          break;
+        k.sha256Blocks(s.h, s.buffer, 1);
+        s.buffered = 0;
+      }
+      if (size >= 64) {
+        k.sha256Blocks(s.h, p, size / 64);
+        p += size & ~(size_t) 63;
+        size &= 63;
+      }
+      memcpy(s.buffer, p, size);
+      s.buffered = size;
+      break;
+    }
+  }
+}
+
+HashValue Hasher::digest() const {
+  const Kernels &k = kernels();
+  HashValue value;
+  value.algorithm = algorithm_;
+  value.size = digestSize(algorithm_);
+
+  switch (algorithm_) {
+    case HASH_CRC32C:
+      writeBE32(value.bytes, ~crc_);
+      break;
+
+    case HASH_XXH3_64: {
+      const Xxh3State &s = xxh3_;
+      if (total_ <= XXH3_MIDSIZE_MAX) {
+        writeBE64(value.bytes, xxh3Short(s.buffer, (size_t) total_));
+        break;
+      }
+      // work on a copy so more data can still be added
+      uint64_t acc[8];
+      memcpy(acc, s.acc, sizeof(acc));
+      uint8_t last[XXH3_STRIPE];
+      const uint8_t *last_stripe;
+      if (s.buffered >= XXH3_STRIPE) {
+        size_t stripes_so_far = s.stripes;
+        xxh3ConsumeStripes(k, acc, stripes_so_far, s.buffer, (s.buffered - 1) / XXH3_STRIPE);
+        last_stripe = s.buffer + s.buffered - XXH3_STRIPE;
+      } else {
+        size_t catchup = XXH3_STRIPE - s.buffered;
+        memcpy(last, s.buffer + sizeof(s.buffer) - catchup, catchup);
+        memcpy(last + catchup, s.buffer, s.buffered);
+        last_stripe = last;
+      }
+      k.xxh3Accumulate(acc, last_stripe, XXH3_SECRET + XXH3_SECRET_LIMIT - 7, 1);
+
+      uint64_t result = total_ * PRIME64_1;
+      for (int i = 0; i < 4; i++) {
+        result += mulFold64(acc[2 * i] ^ readLE64(XXH3_SECRET + 11 + 16 * i),
+                            acc[2 * i + 1] ^ readLE64(XXH3_SECRET + 11 + 16 * i + 8));
+      }
+      writeBE64(value.bytes, xxh3Avalanche(result));
+      break;
+    }
+
+    case HASH_SHA256: {
+      uint32_t h[8];
+      memcpy(h, sha256_.h, sizeof(h));
+      uint8_t tail[128];
+      size_t length = sha256_.buffered;
+      memcpy(tail, sha256_.buffer, length);
+      tail[length++] = 0x80;
+      size_t padded = (length <= 56) ? 64 : 128;
+      memset(tail + length, 0, padded - length);
+      writeBE64(tail + padded - 8, total_ * 8);
+      k.sha256Blocks(h, tail, padded / 64);
+      for (int i = 0; i < 8; i++)
+        writeBE32(value.bytes + i * 4, h[i]);
+      break;
+    }
+  }
+  return value;
+}
+
+const char *Hasher::kernelName(HashAlgorithm algorithm) {
+  const Kernels &k = kernels();
+  switch (algorithm) {
+    case HASH_CRC32C:
+      return k.crc32c_name;
+    case HASH_XXH3_64:
+      return k.xxh3_name;
+    case HASH_SHA256:
+      return k.sha256_name;
+  }
+  return "";
+}
+
+uint32_t Hasher::crc32cCombine(uint32_t crc_a, uint32_t crc_b, uint64_t length_b) {
+  return multModP(crc32cTables().xPow8n(length_b), crc_a) ^ crc_b;
+}
+
+// ---------------------------------------------------------------------------
+
+FileHasher::FileHasher(HashAlgorithm algorithm, const FileHasherOptions &options)
+    : algorithm_(algorithm), options_(options) {
+  if (options_.buffer_size == 0)
+    options_.buffer_size = FileHasherOptions().buffer_size;
+  if (options_.chunk_size <= 0)
+    options_.chunk_size = FileHasherOptions().chunk_size;
+}
+
+int FileHasher::hash(FileHandler &handler, HashValue &out) const {
+  int64_t size = handler.getFileSize();
+  if (algorithm_ == HASH_CRC32C && size >= options_.parallel_threshold && size > options_.chunk_size) {
+    // there are at least two chunks
+    if (parallelThreads(options_.threads, 2) > 1)
+      return hashParallel(handler, size, out);
+  }
+  return hashSequential(handler, out);
+}
+
+int FileHasher::hashSequential(FileHandler &handler, HashValue &out) const {
+  Hasher hasher(algorithm_);
+  // aligned so that MODE_DIRECT handlers can read into them
+  AlignedBufferPool pool(options_.buffer_size, handler.getAlignment(), 2);
+  AlignedBuffer buffers[2] = {pool.acquire(), pool.acquire()};
+  if (!buffers[0] || !buffers[1])
+    return ENOMEM;
+  size_t buffer_size = buffers[0].size();
+  bool direct = handler.isDirect();
+
+  int64_t size = handler.getFileSize();
+  if (size >= 0 && (uint64_t) size < buffer_size) {
+    // one read is enough, no need for a reader thread
+    int64_t offset = 0;
+    for (;;) {
+      int64_t n = handler.readAt(buffers[0].data(), buffer_size, offset);
+      if (n < 0)
+        return (int) -n;
+      if (n == 0)
+        break;
+      hasher.update(buffers[0].data(), (size_t) n);
+      offset += n;
+      if (direct && (size_t) n < buffer_size)
+        break;
+    }
+    out = hasher.digest();
+    return 0;
+  }
+
+  // the reader thread fills one buffer while the other is hashed
+  struct Slot {
+    int64_t length;
+    bool full;
+  };
+  Slot slots[2] = {{0, false}, {0, false}};
+  std::mutex mutex;
+  std::condition_variable cond;
+
+  std::thread reader([&]() {
+    int64_t offset = 0;
+    for (int i = 0;; i ^= 1) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() { return !slots[i].full; });
+      }
+      int64_t n = handler.readAt(buffers[i].data(), buffer_size, offset);
+      // a short direct read ends at the end of the file
+      bool last = n <= 0 || (direct && (size_t) n < buffer_size);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[i].length = n;
+        slots[i].full = true;
+      }
+      cond.notify_all();
+      if (last) {
+        if (n > 0) {
+          // queue the end marker behind the last buffer
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [&]() { return !slots[i ^ 1].full; });
+          slots[i ^ 1].length = 0;
+          slots[i ^ 1].full = true;
+          cond.notify_all();
+        }
+        return;
+      }
+      offset += n;
+    }
+  });
+
+  int rc = 0;
+  for (int i = 0;; i ^= 1) {
+    int64_t n;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&]() { return slots[i].full; });
+      n = slots[i].length;
+    }
+    if (n <= 0) {
+      rc = (int) -n;
+      break;
+    }
+    hasher.update(buffers[i].data(), (size_t) n);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      slots[i].full = false;
+    }
+    cond.notify_all();
+  }
+  reader.join();
+
+  if (rc)
+    return rc;
+  out = hasher.digest();
+  return 0;
+}
+
+int FileHasher::hashParallel(FileHandler &handler, int64_t size, HashValue &out) const {
+  int64_t chunk_size = options_.chunk_size;
+  size_t alignment = handler.getAlignment();
+  if (alignment > 1)
+    chunk_size = (chunk_size + (int64_t) alignment - 1) / (int64_t) alignment * (int64_t) alignment;
+  size_t chunks = (size_t) ((size + chunk_size - 1) / chunk_size);
+
+  int threads = parallelThreads(options_.threads, chunks);
+  std::vector<uint32_t> crcs(chunks);
+  std::vector<int64_t> lengths(chunks);
+  // one buffer per thread, handed back to the pool after each chunk
+  AlignedBufferPool pool(options_.buffer_size, alignment, (size_t) threads);
+
+  int rc = parallelFor(chunks, threads, [&](size_t i) {
+    AlignedBuffer buffer = pool.acquire();
+    if (!buffer)
+      return ENOMEM;
+    Hasher hasher(HASH_CRC32C);
+    int64_t begin = (int64_t) i * chunk_size;
+    int64_t end = (i + 1 == chunks) ? size : begin + chunk_size;
+    int64_t offset = begin;
+    while (offset < end) {
+      size_t want = buffer.size();
+      // direct reads must stay whole blocks; the chunk size is aligned too
+      if ((int64_t) want > end - offset && !handler.isDirect())
+        want = (size_t) (end - offset);
+      int64_t n = handler.readAt(buffer.data(), want, offset);
+      if (n < 0)
+        return (int) -n;
+      if (n == 0)
+        break;
+      if (n > end - offset)
+        n = end - offset;
+      hasher.update(buffer.data(), (size_t) n);
+      offset += n;
+    }
+    crcs[i] = crc32cFromValue(hasher.digest());
+    lengths[i] = offset - begin;
+    return 0;
+  });
+  if (rc)
+    return rc;
+
+  uint32_t crc = crcs[0];
+  for (size_t i = 1; i < chunks; i++)
+    crc = Hasher::crc32cCombine(crc, crcs[i], (uint64_t) lengths[i]);
+  out = HashValue();
+  out.algorithm = HASH_CRC32C;
+  out.size = 4;
+  writeBE32(out.bytes, crc);
+  return 0;
+}
+
+int FileHasher::hash(const Path &path, HashValue &out, FileFactory *factory) const {
+  if (!factory)
+    factory = fs();
+  std::unique_ptr<FileHandler> handler(factory->createFileHandle(path));
+  int rc = handler->open(MODE_READ | MODE_EXISTS | SHARE_READ | HINT_SEQUENTIAL);
+  if (rc)
+    return rc;
+  rc = hash(*handler, out);
+  handler->close();
+  return rc;
+}
+
+int FileHasher::commitVerified(FileHandler &handler, const HashValue &expected) const {
+  if (expected.algorithm != algorithm_)
+    return EINVAL;
+  HashValue actual;
+  int rc = hash(handler, actual);
+  if (rc)
+    return rc;
+  if (actual != expected)
+    return EBADMSG;
+  return handler.commit();
+}
+
+}
+}
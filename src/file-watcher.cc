@@ -0,0 +1,420 @@
+/**
+ * @file	file-watcher.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/file-watcher.h"
+
+#include <errno.h>
+
+#if defined(__linux__)
+#include "jcu-file/directory-iterator.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#endif
+
+namespace jcu {
+namespace file {
+
+#if defined(__linux__)
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+    | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_EXCL_UNLINK;
+
+int toWatchEvents(uint32_t mask) {
+  int events = 0;
+  if (mask & IN_CREATE)
+    events |= WATCH_CREATED;
+  if (mask & (IN_DELETE | IN_DELETE_SELF))
+    events |= WATCH_DELETED;
+  if (mask & IN_MODIFY)
+    events |= WATCH_MODIFIED;
+  if (mask & IN_ATTRIB)
+    events |= WATCH_ATTRIBUTES;
+  if (mask & (IN_MOVED_FROM | IN_MOVE_SELF))
+    events |= WATCH_MOVED_FROM;
+  if (mask & IN_MOVED_TO)
+    events |= WATCH_MOVED_TO;
+  if (mask & IN_CLOSE_WRITE)
+    events |= WATCH_CLOSED_WRITE;
+  return events;
+}
+
+bool isDirectoryPath(const Path &path) {
+  struct stat st;
+  return ::lstat(path.getSystemString().c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+void addToEpoll(int epoll_fd, int fd) {
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// @return true when the counter had fired
+bool drainCounter(int fd) {
+  uint64_t value;
+  bool fired = false;
+  while (::read(fd, &value, sizeof(value)) == (ssize_t) sizeof(value)) {
+    fired = true;
+  }
+  return fired;
+}
+
+}
+
+FileWatcher::FileWatcher(const FileWatcherOptions &options)
+    : options_(options), inotify_fd_(-1), epoll_fd_(-1), timer_fd_(-1), stop_fd_(-1), init_error_(0),
+      timer_armed_(false), running_(false) {
+  inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  timer_fd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  stop_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (inotify_fd_ < 0 || epoll_fd_ < 0 || timer_fd_ < 0 || stop_fd_ < 0) {
+    init_error_ = errno;
+    return;
+  }
+  addToEpoll(epoll_fd_, inotify_fd_);
+  addToEpoll(epoll_fd_, timer_fd_);
+  addToEpoll(epoll_fd_, stop_fd_);
+}
+
+FileWatcher::~FileWatcher() {
+  stop();
+  if (inotify_fd_ >= 0)
+    ::close(inotify_fd_);
+  if (epoll_fd_ >= 0)
+    ::close(epoll_fd_);
+  if (timer_fd_ >= 0)
+    ::close(timer_fd_);
+  if (stop_fd_ >= 0)
+    ::close(stop_fd_);
+}
+
+int FileWatcher::addWatch(const Path &path, const Path &root, bool recursive, bool report_existing) {
+  int wd = ::inotify_add_watch(inotify_fd_, path.getSystemString().c_str(), WATCH_MASK);
+  if (wd < 0)
+    return errno;
+  watches_[wd] = Watch{path, root, recursive};
+  watch_ids_[path] = wd;
+  if (!recursive)
+    return 0;
+
+  // the watch is in place first, so nothing created from here on is missed;
+  // entries that appeared before it are reported when asked
+  DirectoryIterator iter;
+  if (iter.open(path) != 0)
+    return 0;
+  std::vector<std::pair<Path, bool>> children;
+  for (const DirectoryEntry &entry : iter) {
+    Path child(Path::join(path, Path::newFromSystem(std::string(entry.name()))));
+    bool is_directory = (entry.type() == FILE_TYPE_DIRECTORY)
+        || (entry.type() == FILE_TYPE_UNKNOWN && isDirectoryPath(child));
+    children.emplace_back(std::move(child), is_directory);
+  }
+  iter.close();
+  for (auto &child : children) {
+    if (report_existing)
+      queue(child.first, WATCH_CREATED, child.second);
+    if (child.second)
+      addWatch(child.first, root, true, report_existing);
+  }
+  return 0;
+}
+
+void FileWatcher::removeWatch(int wd) {
+  auto it = watches_.find(wd);
+  if (it == watches_.end())
+    return;
+  const int *mapped = watch_ids_.find(it->second.path);
+  if (mapped && *mapped == wd)
+    watch_ids_.erase(it->second.path);
+  watches_.erase(it);
+}
+
+void FileWatcher::queue(const Path &path, int events, bool is_directory) {
+  Pending *pending = pending_.find(path);
+  if (!pending) {
+    if (pending_.empty())
+      first_pending_ = std::chrono::steady_clock::now();
+    pending_.insert(path, Pending{events, is_directory});
+    return;
+  }
+  if ((pending->events & WATCH_CREATED) && (events & WATCH_DELETED)) {
+    if (pending->events & WATCH_DELETED) {
+      // existed before the window: deleted, recreated and deleted again
+      pending->events = WATCH_DELETED;
+    } else {
+      // lived and died within the window
+      pending_.erase(path);
+    }
+    return;
+  }
+  pending->events |= events;
+  pending->is_directory = pending->is_directory || is_directory;
+}
+
+void FileWatcher::handleOverflow() {
+  // report each root once and pick up directories created while events were lost
+  std::vector<std::pair<Path, bool>> roots;
+  for (auto &root : roots_) {
+    roots.emplace_back(root.first, root.second);
+  }
+  for (auto &root : roots) {
+    queue(root.first, WATCH_OVERFLOW, isDirectoryPath(root.first));
+    if (root.second)
+      addWatch(root.first, root.first, true, false);
+  }
+}
+
+int FileWatcher::drain() {
+  alignas(struct inotify_event) char buffer[65536];
+  for (;;) {
+    ssize_t n = ::read(inotify_fd_, buffer, sizeof(buffer));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        return 0;
+      return errno;
+    }
+    if (n == 0)
+      return 0;
+    for (ssize_t pos = 0; pos < n;) {
+      const struct inotify_event *ev = (const struct inotify_event *) (buffer + pos);
+      pos += sizeof(struct inotify_event) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        handleOverflow();
+        continue;
+      }
+      auto it = watches_.find(ev->wd);
+      if (it == watches_.end())
+        continue;
+      if (ev->mask & IN_IGNORED) {
+        removeWatch(ev->wd);
+        continue;
+      }
+      Watch watch = it->second;
+      bool is_directory = (ev->mask & IN_ISDIR) != 0;
+      Path path = (ev->len && ev->name[0]) ? Path::join(watch.path, Path::newFromSystem(std::string(ev->name))) : watch.path;
+      int events = toWatchEvents(ev->mask);
+      if (events)
+        queue(path, events, is_directory);
+      if (watch.recursive && is_directory && (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+        addWatch(path, watch.root, true, true);
+    }
+  }
+}
+
+void FileWatcher::takeBatch(std::vector<WatchEvent> &out, bool force) {
+  if (pending_.empty())
+    return;
+  if (!force && pending_.size() < options_.max_pending
+      && std::chrono::steady_clock::now() < first_pending_ + options_.coalesce_window)
+    return;
+  out.reserve(out.size() + pending_.size());
+  for (auto &entry : pending_) {
+    out.push_back(WatchEvent{entry.first, entry.second.events, entry.second.is_directory});
+  }
+  pending_.clear();
+  if (timer_armed_) {
+    struct itimerspec spec = {};
+    ::timerfd_settime(timer_fd_, 0, &spec, NULL);
+    timer_armed_ = false;
+  }
+}
+
+void FileWatcher::armTimer() {
+  if (pending_.empty() || timer_armed_)
+    return;
+  auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      first_pending_ + options_.coalesce_window - std::chrono::steady_clock::now()).count();
+  if (remaining < 1)
+    remaining = 1;
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = (time_t) (remaining / 1000000000LL);
+  spec.it_value.tv_nsec = (long) (remaining % 1000000000LL);
+  ::timerfd_settime(timer_fd_, 0, &spec, NULL);
+  timer_armed_ = true;
+}
+
+int FileWatcher::add(const Path &path, bool recursive) {
+  if (init_error_)
+    return init_error_;
+  std::lock_guard<std::mutex> lock(mutex_);
+  int rc = addWatch(path, path, recursive, false);
+  if (rc == 0)
+    roots_[path] = recursive;
+  return rc;
+}
+
+int FileWatcher::remove(const Path &path) {
+  if (init_error_)
+    return init_error_;
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int *wd = watch_ids_.find(path);
+  if (!wd)
+    return ENOENT;
+  std::vector<int> wds(1, *wd);
+  if (roots_.erase(path)) {
+    for (auto &watch : watches_) {
+      if (watch.first != wds[0] && watch.second.root == path)
+        wds.push_back(watch.first);
+    }
+  }
+  for (int id : wds) {
+    ::inotify_rm_watch(inotify_fd_, id);
+    removeWatch(id);
+  }
+  return 0;
+}
+
+int FileWatcher::start(WatchCallback callback) {
+  if (init_error_)
+    return init_error_;
+  if (running_)
+    return EBUSY;
+  callback_ = std::move(callback);
+  running_ = true;
+  thread_ = std::thread(&FileWatcher::threadMain, this);
+  return 0;
+}
+
+void FileWatcher::stop() {
+  if (!running_)
+    return;
+  uint64_t one = 1;
+  ssize_t n = ::write(stop_fd_, &one, sizeof(one));
+  (void) n;
+  thread_.join();
+  drainCounter(stop_fd_);
+  running_ = false;
+}
+
+void FileWatcher::threadMain() {
+  std::vector<WatchEvent> batch;
+  for (;;) {
+    struct epoll_event evs[4];
+    int n = ::epoll_wait(epoll_fd_, evs, 4, -1);
+    if (n < 0 && errno != EINTR)
+      break;
+    bool stop_requested = false;
+    for (int i = 0; i < n; i++) {
+      if (evs[i].data.fd == stop_fd_)
+        stop_requested = true;
+    }
+    if (stop_requested)
+      break;
+
+    batch.clear();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // a one-shot timer that fired is disarmed, even when everything
+      // pending was cancelled out and no batch is delivered
+      if (drainCounter(timer_fd_))
+        timer_armed_ = false;
+      drain();
+      takeBatch(batch, false);
+      armTimer();
+    }
+    if (!batch.empty())
+      callback_(batch);
+  }
+}
+
+int FileWatcher::fd() const {
+  return epoll_fd_;
+}
+
+int FileWatcher::readEvents(std::vector<WatchEvent> &out, int timeout_ms) {
+  out.clear();
+  if (init_error_)
+    return init_error_;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms < 0 ? 0 : timeout_ms);
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // a one-shot timer that fired is disarmed, even when everything
+      // pending was cancelled out and no batch is delivered
+      if (drainCounter(timer_fd_))
+        timer_armed_ = false;
+      int rc = drain();
+      if (rc)
+        return rc;
+      takeBatch(out, false);
+      if (!out.empty())
+        return 0;
+      armTimer();
+    }
+    if (timeout_ms == 0)
+      return 0;
+
+    int wait_ms = -1;
+    if (timeout_ms > 0) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+      if (remaining <= 0)
+        return 0;
+      wait_ms = (int) remaining;
+    }
+    struct epoll_event evs[4];
+    int n = ::epoll_wait(epoll_fd_, evs, 4, wait_ms);
+    if (n < 0 && errno != EINTR)
+      return errno;
+  }
+}
+
+#else
+
+FileWatcher::FileWatcher(const FileWatcherOptions &options)
+    : options_(options), inotify_fd_(-1), epoll_fd_(-1), timer_fd_(-1), stop_fd_(-1), init_error_(ENOSYS),
+      timer_armed_(false), running_(false) {
+}
+
+FileWatcher::~FileWatcher() {
+}
+
+int FileWatcher::add(const Path &path, bool recursive) {
+  (void) path;
+  (void) recursive;
+  return init_error_;
+}
+
+int FileWatcher::remove(const Path &path) {
+  (void) path;
+  return init_error_;
+}
+
+int FileWatcher::start(WatchCallback callback) {
+  (void) callback;
+  return init_error_;
+}
+
+void FileWatcher::stop() {
+}
+
+int FileWatcher::fd() const {
+  return -1;
+}
+
+int FileWatcher::readEvents(std::vector<WatchEvent> &out, int timeout_ms) {
+  (void) timeout_ms;
+  out.clear();
+  return init_error_;
+}
+
+#endif
+
+}
+}
@@ -0,0 +1,86 @@
+/**
+ * @file	parallel-for.h
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ *
+ * Internal: the worker loop shared by the library's parallel operations.
+ */
+
+#ifndef __JCU_FILE_SRC_PARALLEL_FOR_H__
+#define __JCU_FILE_SRC_PARALLEL_FOR_H__
+
+#include <stddef.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace jcu {
+namespace file {
+
+/**
+ * Threads parallelFor() would use
+ *
+ * @param threads requested threads, 0 or less for one per CPU
+ * @param count number of items
+ * @return between 1 and count (1 when count is 0)
+ */
+inline int parallelThreads(int threads, size_t count) {
+  if (threads <= 0)
+    threads = (int) std::thread::hardware_concurrency();
+  if (threads <= 0)
+    threads = 1;
+  if ((size_t) threads > count)
+    threads = (int) count;
+  return (threads < 1) ? 1 : threads;
+}
+
+/**
+ * Run fn(i) for every i in [0, count) on up to `threads` threads, the
+ * caller included. Items are handed out one at a time in order. fn returns
+ * 0 or an error code; once an item fails no further item is started.
+ *
+ * @param count
+ * @param threads 0 or less for one per CPU
+ * @param fn int(size_t index), called concurrently
+ * @return 0, or the first error returned by fn
+ */
+template <typename Fn>
+int parallelFor(size_t count, int threads, Fn fn) {
+  threads = parallelThreads(threads, count);
+  if (threads <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      int rc = fn(i);
+      if (rc)
+        return rc;
+    }
+    return 0;
+  }
+
+  std::atomic<size_t> next(0);
+  std::atomic<int> first_error(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < count && !first_error.load(std::memory_order_relaxed); i = next++) {
+      int rc = fn(i);
+      if (rc) {
+        int expected = 0;
+        first_error.compare_exchange_strong(expected, rc);
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int i = 1; i < threads; i++) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : workers) {
+    thread.join();
+  }
+  return first_error.load();
+}
+
+}
+}
+
+#endif //__JCU_FILE_SRC_PARALLEL_FOR_H__
@@ -0,0 +1,288 @@
+/**
+ * @file	path-table.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/path-table.h"
+
+#include <functional>
+
+namespace jcu {
+namespace file {
+
+namespace {
+
+const uint32_t NO_NAME = 0xffffffffu;
+const size_t MAX_NAME_LENGTH = 0xffff;
+const size_t MIN_SLOTS = 1024;
+
+inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+inline size_t hashName(Path::system_string_view_t name) {
+  return std::hash<Path::system_string_view_t>()(name);
+}
+
+inline bool isSeparatorRun(Path::system_string_view_t name) {
+  if (name.empty())
+    return false;
+  for (auto c : name) {
+    if (!Path::isSeparator(c))
+      return false;
+  }
+  return true;
+}
+
+}
+
+const PathTable::Id PathTable::NO_ID;
+
+PathTable::PathTable()
+    : name_count_(0) {
+}
+
+Path::system_string_view_t PathTable::nameAt(uint32_t offset) const {
+  const Path::system_char_t *p = arena_.data() + offset;
+  size_t length = ((size_t) (p[0] & 0xff)) | (((size_t) (p[1] & 0xff)) << 8);
+  return Path::system_string_view_t(p + 2, length);
+}
+
+void PathTable::growNames() {
+  size_t new_size = name_slots_.empty() ? MIN_SLOTS : name_slots_.size() * 2;
+  std::vector<uint32_t> slots(new_size, 0);
+  size_t mask = new_size - 1;
+  for (uint32_t slot : name_slots_) {
+    if (slot) {
+      size_t i = hashName(nameAt(slot - 1)) & mask;
+      while (slots[i])
+        i = (i + 1) & mask;
+      slots[i] = slot;
+    }
+  }
+  name_slots_.swap(slots);
+}
+
+uint32_t PathTable::findName(Path::system_string_view_t name) const {
+  if (name_slots_.empty())
+    return NO_NAME;
+  size_t mask = name_slots_.size() - 1;
+  size_t i = hashName(name) & mask;
+  while (uint32_t slot = name_slots_[i]) {
+    if (nameAt(slot - 1) == name)
+      return slot - 1;
+    i = (i + 1) & mask;
+  }
+  return NO_NAME;
+}
+
+uint32_t PathTable::internName(Path::system_string_view_t name) {
+  if (name.length() > MAX_NAME_LENGTH)
+    return NO_NAME;
+  if ((name_count_ + 1) * 10 > name_slots_.size() * 7)
+    growNames();
+
+  size_t mask = name_slots_.size() - 1;
+  size_t i = hashName(name) & mask;
+  while (uint32_t slot = name_slots_[i]) {
+    if (nameAt(slot - 1) == name)
+      return slot - 1;
+    i = (i + 1) & mask;
+  }
+
+  size_t offset = arena_.size();
+  if (offset + name.length() + 2 >= (size_t) NO_NAME)
+    return NO_NAME;
+  arena_.push_back((Path::system_char_t) (name.length() & 0xff));
+  arena_.push_back((Path::system_char_t) ((name.length() >> 8) & 0xff));
+  arena_.insert(arena_.end(), name.begin(), name.end());
+  name_slots_[i] = (uint32_t) offset + 1;
+  name_count_++;
+  return (uint32_t) offset;
+}
+
+size_t PathTable::childSlot(Id parent, uint32_t name) const {
+  return (size_t) mix64((((uint64_t) parent) << 32) | name) & (child_slots_.size() - 1);
+}
+
+void PathTable::growChildren() {
+  size_t new_size = child_slots_.empty() ? MIN_SLOTS : child_slots_.size() * 2;
+  child_slots_.assign(new_size, 0);
+  size_t mask = new_size - 1;
+  for (size_t id = 0; id < nodes_.size(); id++) {
+    size_t i = childSlot(nodes_[id].parent, nodes_[id].name);
+    while (child_slots_[i])
+      i = (i + 1) & mask;
+    child_slots_[i] = (uint32_t) id + 1;
+  }
+}
+
+PathTable::Id PathTable::add(Id parent, Path::system_string_view_t name) {
+  if (name.empty())
+    return NO_ID;
+  if (parent != NO_ID && parent >= nodes_.size())
+    return NO_ID;
+  uint32_t name_offset = internName(name);
+  if (name_offset == NO_NAME)
+    return NO_ID;
+
+  if ((nodes_.size() + 1) * 10 > child_slots_.size() * 7)
+    growChildren();
+
+  size_t mask = child_slots_.size() - 1;
+  size_t i = childSlot(parent, name_offset);
+  while (uint32_t slot = child_slots_[i]) {
+    const Node &node = nodes_[slot - 1];
+    if (node.parent == parent && node.name == name_offset)
+      return slot - 1;
+    i = (i + 1) & mask;
+  }
+
+  if (nodes_.size() >= (size_t) NO_ID - 1)
+    return NO_ID;
+  Id id = (Id) nodes_.size();
+  Node node;
+  node.parent = parent;
+  node.name = name_offset;
+  nodes_.push_back(node);
+  child_slots_[i] = id + 1;
+  return id;
+}
+
+PathTable::Id PathTable::find(Id parent, Path::system_string_view_t name) const {
+  if (child_slots_.empty())
+    return NO_ID;
+  uint32_t name_offset = findName(name);
+  if (name_offset == NO_NAME)
+    return NO_ID;
+  size_t mask = child_slots_.size() - 1;
+  size_t i = childSlot(parent, name_offset);
+  while (uint32_t slot = child_slots_[i]) {
+    const Node &node = nodes_[slot - 1];
+    if (node.parent == parent && node.name == name_offset)
+      return slot - 1;
+    i = (i + 1) & mask;
+  }
+  return NO_ID;
+}
+
+PathTable::Id PathTable::add(const Path &path) {
+  Path::system_string_view_t str(path.getSystemString());
+  Id cur = NO_ID;
+  size_t root_length = 0;
+  while (root_length < str.length() && Path::isSeparator(str[root_length]))
+    root_length++;
+  if (root_length > 0) {
+    cur = add(NO_ID, str.substr(0, root_length));
+  }
+  for (auto component : path.components()) {
+    cur = add(cur, component);
+    if (cur == NO_ID)
+      break;
+  }
+  return cur;
+}
+
+PathTable::Id PathTable::find(const Path &path) const {
+  Path::system_string_view_t str(path.getSystemString());
+  Id cur = NO_ID;
+  size_t root_length = 0;
+  while (root_length < str.length() && Path::isSeparator(str[root_length]))
+    root_length++;
+  if (root_length > 0) {
+    cur = find(NO_ID, str.substr(0, root_length));
+    if (cur == NO_ID)
+      return NO_ID;
+  }
+  for (auto component : path.components()) {
+    cur = find(cur, component);
+    if (cur == NO_ID)
+      break;
+  }
+  return cur;
+}
+
+PathTable::Id PathTable::parent(Id id) const {
+  if (id >= nodes_.size())
+    return NO_ID;
+  return nodes_[id].parent;
+}
+
+Path::system_string_view_t PathTable::name(Id id) const {
+  if (id >= nodes_.size())
+    return Path::system_string_view_t();
+  return nameAt(nodes_[id].name);
+}
+
+void PathTable::appendPath(Id id, Path::system_string_t &out) const {
+  Id chain_buf[64];
+  std::vector<Id> chain_heap;
+  size_t depth = 0;
+
+  for (Id cur = id; cur != NO_ID && cur < nodes_.size(); cur = nodes_[cur].parent) {
+    if (depth < 64) {
+      chain_buf[depth] = cur;
+    } else {
+      if (chain_heap.empty())
+        chain_heap.assign(chain_buf, chain_buf + 64);
+      chain_heap.push_back(cur);
+    }
+    depth++;
+  }
+  const Id *chain = chain_heap.empty() ? chain_buf : chain_heap.data();
+
+  bool need_separator = false;
+  for (size_t i = depth; i-- > 0;) {
+    Path::system_string_view_t part = nameAt(nodes_[chain[i]].name);
+    if (need_separator) {
+#ifdef _WIN32
+      out.push_back('\\');
+#else
+      out.push_back('/');
+#endif
+    }
+    out.append(part.data(), part.length());
+    need_separator = !isSeparatorRun(part);
+  }
+}
+
+Path PathTable::path(Id id) const {
+  Path::system_string_t str;
+  appendPath(id, str);
+  return Path::newFromSystem(std::move(str));
+}
+
+size_t PathTable::size() const {
+  return nodes_.size();
+}
+
+void PathTable::reserve(size_t entries) {
+  nodes_.reserve(entries);
+  while (entries * 10 > child_slots_.size() * 7)
+    growChildren();
+}
+
+void PathTable::clear() {
+  arena_.clear();
+  nodes_.clear();
+  name_slots_.clear();
+  name_count_ = 0;
+  child_slots_.clear();
+}
+
+size_t PathTable::memoryUsage() const {
+  return arena_.capacity() * sizeof(Path::system_char_t)
+    + nodes_.capacity() * sizeof(Node)
+    + name_slots_.capacity() * sizeof(uint32_t)
+    + child_slots_.capacity() * sizeof(uint32_t);
+}
+
+}
+}
@@ -18,17 +18,35 @@ namespace jcu {
 namespace file {
 
 Path::Path(const Path::system_string_t &system_string)
-    : system_path_(system_string) {
+    : system_path_(system_string), hash_(0) {
 }
 
-Path::Path() {}
+Path::Path(Path::system_string_t &&system_string)
+    : system_path_(std::move(system_string)), hash_(0) {
+}
+
+Path::Path()
+    : hash_(0) {}
 
 Path::Path(const Path &obj)
-    : system_path_(obj.system_path_) {
+    : system_path_(obj.system_path_), hash_(obj.hash_.load(std::memory_order_relaxed)) {
+}
+
+Path::Path(Path &&obj) noexcept
+    : system_path_(std::move(obj.system_path_)), hash_(obj.hash_.load(std::memory_order_relaxed)) {
+  obj.hash_.store(0, std::memory_order_relaxed);
 }
 
 Path &Path::operator=(const Path &obj) {
   system_path_ = obj.system_path_;
+  hash_.store(obj.hash_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  return *this;
+}
+
+Path &Path::operator=(Path &&obj) noexcept {
+  system_path_ = std::move(obj.system_path_);
+  hash_.store(obj.hash_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  obj.hash_.store(0, std::memory_order_relaxed);
   return *this;
 }
 
@@ -36,17 +54,19 @@ const Path::system_string_t &Path::getSystemString() const {
   return system_path_;
 }
 
-const std::string Path::toUtf8() const {
 #ifdef _UNICODE
+const std::string Path::toUtf8() const {
   std::vector<char> ubuf;
   int uLen = WideCharToMultiByte(CP_UTF8, 0, system_path_.c_str(), system_path_.length(), NULL, 0, NULL, NULL);
   ubuf.reserve(uLen + 1);
   WideCharToMultiByte(CP_UTF8, 0, system_path_.c_str(), system_path_.length(), ubuf.data(), uLen, NULL, NULL);
   return std::string(ubuf.data(), uLen);
+}
 #else
+const std::string &Path::toUtf8() const {
   return system_path_;
-#endif
 }
+#endif
 
 bool Path::isEmpty() const {
   return system_path_.empty();
@@ -56,6 +76,10 @@ Path Path::newFromSystem(const Path::system_string_t &text) {
   return Path(text);
 }
 
+Path Path::newFromSystem(Path::system_string_t &&text) {
+  return Path(std::move(text));
+}
+
 Path Path::newFromUtf8(const std::string &text) {
 #ifdef _WIN32
   return newFromUtf8(text.c_str(), text.length());
@@ -82,6 +106,8 @@ Path Path::newFromUtf8(const char *text, int length) {
   return Path(std::basic_string<char>(cbuf.data(), cbuf.data() + cLen));
 #endif
 #else
+  if (length < 0)
+    return Path(std::string(text));
   return Path(std::string(text, length));
 #endif
 }
@@ -112,13 +138,14 @@ Path Path::parent() const {
 
 Path Path::join(const Path &a, const Path &b) {
   system_string_t joined;
+  joined.reserve(a.system_path_.length() + 1 + b.system_path_.length());
   if (!a.system_path_.empty()) {
     joined = a.system_path_;
     if ((joined.at(joined.length() - 1) != '\\') && (joined.at(joined.length() - 1) != '/'))
       joined.append(_T("\\"));
   }
   joined.append(b.system_path_);
-  return Path(joined);
+  return Path(std::move(joined));
 }
 #else
 Path Path::cwd() {
@@ -141,14 +168,215 @@ Path Path::parent() const {
 
 Path Path::join(const Path& a, const Path& b) {
     system_string_t joined;
+    joined.reserve(a.system_path_.length() + 1 + b.system_path_.length());
     if(!a.system_path_.empty()) {
         joined = a.system_path_;
         if(joined.at(joined.length() - 1) != '/')
             joined.append("/");
     }
     joined.append(b.system_path_);
-    return Path(joined);
+    return Path(std::move(joined));
+}
+#endif
+
+Path::system_string_view_t Path::filename() const {
+  size_t pos = system_path_.length();
+  while (pos > 0 && !isSeparator(system_path_[pos - 1])) {
+    pos--;
+  }
+  return system_string_view_t(system_path_).substr(pos);
+}
+
+Path::system_string_view_t Path::extension() const {
+  system_string_view_t name = filename();
+  size_t pos = name.find_last_of('.');
+  if (pos == system_string_view_t::npos || pos == 0) {
+    return system_string_view_t();
+  }
+  return name.substr(pos);
+}
+
+Path::system_string_view_t Path::stem() const {
+  system_string_view_t name = filename();
+  return name.substr(0, name.length() - extension().length());
+}
+
+Path::Components Path::components() const {
+  return Components(system_path_);
+}
+
+size_t Path::hash() const {
+  size_t value = hash_.load(std::memory_order_relaxed);
+  if (value == 0) {
+    value = std::hash<system_string_view_t>()(system_path_);
+    // 0 marks "not computed yet"
+    if (value == 0)
+      value = 1;
+    hash_.store(value, std::memory_order_relaxed);
+  }
+  return value;
+}
+
+bool Path::operator==(const Path &other) const {
+  if (system_path_.length() != other.system_path_.length())
+    return false;
+  size_t a = hash_.load(std::memory_order_relaxed);
+  size_t b = other.hash_.load(std::memory_order_relaxed);
+  if (a && b && a != b)
+    return false;
+  return system_path_ == other.system_path_;
+}
+
+namespace {
+
+int compareComponent(Path::system_string_view_t a, Path::system_string_view_t b) {
+#ifdef _WIN32
+  size_t n = (a.length() < b.length()) ? a.length() : b.length();
+  for (size_t i = 0; i < n; i++) {
+    unsigned int ca = (unsigned int) a[i];
+    unsigned int cb = (unsigned int) b[i];
+    if (ca >= 'a' && ca <= 'z') ca -= 'a' - 'A';
+    if (cb >= 'a' && cb <= 'z') cb -= 'a' - 'A';
+    if (ca != cb)
+      return (ca < cb) ? -1 : 1;
+  }
+  if (a.length() == b.length())
+    return 0;
+  return (a.length() < b.length()) ? -1 : 1;
+#else
+  return a.compare(b);
+#endif
+}
+
+bool isDotComponent(Path::system_string_view_t name) {
+  return name.length() == 1 && name[0] == '.';
+}
+
+}
+
+int Path::compare(const Path &other, bool normalized) const {
+  if (!normalized) {
+    int rc = system_path_.compare(other.system_path_);
+    return (rc < 0) ? -1 : ((rc > 0) ? 1 : 0);
+  }
+
+  bool a_root = !system_path_.empty() && isSeparator(system_path_[0]);
+  bool b_root = !other.system_path_.empty() && isSeparator(other.system_path_[0]);
+  if (a_root != b_root)
+    return a_root ? -1 : 1;
+
+  Components a_components(system_path_);
+  Components b_components(other.system_path_);
+  ComponentIterator a = a_components.begin(), a_end = a_components.end();
+  ComponentIterator b = b_components.begin(), b_end = b_components.end();
+  for (;;) {
+    while (a != a_end && isDotComponent(*a))
+      ++a;
+    while (b != b_end && isDotComponent(*b))
+      ++b;
+    if (a == a_end || b == b_end)
+      break;
+    int rc = compareComponent(*a, *b);
+    if (rc)
+      return (rc < 0) ? -1 : 1;
+    ++a;
+    ++b;
+  }
+  if (a == a_end && b == b_end)
+    return 0;
+  return (a == a_end) ? -1 : 1;
+}
+
+Path::ComponentIterator::ComponentIterator(Path::system_string_view_t path, size_t pos)
+    : path_(path), pos_(pos), end_(pos) {
+  while (pos_ < path_.length() && isSeparator(path_[pos_])) {
+    pos_++;
+  }
+  end_ = pos_;
+  while (end_ < path_.length() && !isSeparator(path_[end_])) {
+    end_++;
+  }
+}
+
+Path::system_string_view_t Path::ComponentIterator::operator*() const {
+  return path_.substr(pos_, end_ - pos_);
+}
+
+Path::ComponentIterator &Path::ComponentIterator::operator++() {
+  *this = ComponentIterator(path_, end_);
+  return *this;
 }
+
+PathBuilder::PathBuilder() {}
+
+PathBuilder::PathBuilder(const Path &base)
+    : buffer_(base.getSystemString()) {
+}
+
+PathBuilder &PathBuilder::append(Path::system_string_view_t name) {
+  if (!buffer_.empty() && !Path::isSeparator(buffer_[buffer_.length() - 1])) {
+#ifdef _WIN32
+    buffer_.push_back('\\');
+#else
+    buffer_.push_back('/');
 #endif
+  }
+  buffer_.append(name.data(), name.length());
+  return *this;
+}
+
+PathBuilder &PathBuilder::append(const Path &name) {
+  return append(Path::system_string_view_t(name.getSystemString()));
+}
+
+PathBuilder &PathBuilder::pop() {
+  size_t pos = buffer_.length();
+  while (pos > 0 && Path::isSeparator(buffer_[pos - 1])) {
+    pos--;
+  }
+  while (pos > 0 && !Path::isSeparator(buffer_[pos - 1])) {
+    pos--;
+  }
+  while (pos > 1 && Path::isSeparator(buffer_[pos - 1])) {
+    pos--;
+  }
+  buffer_.resize(pos);
+  return *this;
+}
+
+size_t PathBuilder::length() const {
+  return buffer_.length();
+}
+
+void PathBuilder::truncate(size_t length) {
+  if (length < buffer_.length())
+    buffer_.resize(length);
+}
+
+void PathBuilder::reserve(size_t capacity) {
+  buffer_.reserve(capacity);
+}
+
+void PathBuilder::clear() {
+  buffer_.clear();
+}
+
+Path::system_string_view_t PathBuilder::view() const {
+  return buffer_;
+}
+
+const Path::system_string_t &PathBuilder::str() const {
+  return buffer_;
+}
+
+Path PathBuilder::toPath() const {
+  return Path::newFromSystem(buffer_);
+}
+
+Path PathBuilder::take() {
+  Path path(Path::newFromSystem(std::move(buffer_)));
+  buffer_.clear();
+  return path;
+}
 }
 }
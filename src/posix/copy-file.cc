@@ -0,0 +1,341 @@
+/**
+ * @file	copy-file.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/posix/copy-file.h"
+
+#ifndef _WIN32
+#include "../parallel-for.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__linux__) && !defined(FICLONE)
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+namespace jcu {
+namespace file {
+namespace posix {
+
+namespace {
+
+// largest request handed to the kernel at once
+const int64_t MAX_CALL_SIZE = 1 << 30;
+const size_t BUFFER_SIZE = 1 << 20;
+// COPY_PARALLEL splits the data into chunks of this size, and only when there are several
+const int64_t PARALLEL_CHUNK_SIZE = 64LL << 20;
+const int64_t PARALLEL_MIN_SIZE = 4 * PARALLEL_CHUNK_SIZE;
+
+enum CopyMethod {
+  METHOD_COPY_FILE_RANGE = 0,
+  METHOD_SENDFILE,
+  METHOD_BUFFERED,
+};
+
+struct Extent {
+  int64_t offset;
+  int64_t length;
+};
+
+// Errors that mean "this method does not work for these files", not "the copy failed"
+bool isUnsupported(int err) {
+  return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP || err == EBADF;
+}
+
+int copyBuffered(int src_fd, int dst_fd, int64_t &offset, int64_t end, std::vector<char> &buffer) {
+  if (buffer.empty())
+    buffer.resize(BUFFER_SIZE);
+  while (offset < end) {
+    size_t count = (size_t) std::min<int64_t>(end - offset, (int64_t) buffer.size());
+    ssize_t n;
+    do {
+      n = ::pread(src_fd, buffer.data(), count, (off_t) offset);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+      return errno;
+    if (n == 0)
+      break;
+    ssize_t written = 0;
+    while (written < n) {
+      ssize_t w = ::pwrite(dst_fd, buffer.data() + written, (size_t) (n - written), (off_t) (offset + written));
+      if (w < 0) {
+        if (errno == EINTR)
+          continue;
+        return errno;
+      }
+      written += w;
+    }
+    offset += n;
+  }
+  return 0;
+}
+
+/**
+ * Copy [offset, offset + length) to the same offset of dst_fd.
+ * method is lowered as methods turn out to be unsupported. sendfile moves
+ * the destination's file position, so it is only used when allowed.
+ */
+int copyRange(int src_fd, int dst_fd, int64_t offset, int64_t length, int &method, bool allow_sendfile, std::vector<char> &buffer) {
+  int64_t end = offset + length;
+#if defined(__linux__)
+  while (offset < end && method != METHOD_BUFFERED) {
+    size_t count = (size_t) std::min(end - offset, MAX_CALL_SIZE);
+    ssize_t n;
+    if (method == METHOD_COPY_FILE_RANGE) {
+#if defined(SYS_copy_file_range)
+      loff_t in_offset = offset;
+      loff_t out_offset = offset;
+      n = ::syscall(SYS_copy_file_range, src_fd, &in_offset, dst_fd, &out_offset, count, 0);
+#else
+      n = -1;
+      errno = ENOSYS;
+#endif
+    } else {
+      off_t in_offset = (off_t) offset;
+      if (::lseek(dst_fd, (off_t) offset, SEEK_SET) < 0)
+        return errno;
+      n = ::sendfile(dst_fd, src_fd, &in_offset, count);
+    }
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (!isUnsupported(errno))
+        return errno;
+      method = (method == METHOD_COPY_FILE_RANGE && allow_sendfile) ? METHOD_SENDFILE : METHOD_BUFFERED;
+      continue;
+    }
+    if (n == 0) {
+      // source shrank under us
+      return 0;
+    }
+    offset += n;
+  }
+#else
+  (void) allow_sendfile;
+  method = METHOD_BUFFERED;
+#endif
+  return copyBuffered(src_fd, dst_fd, offset, end, buffer);
+}
+
+void collectExtents(int fd, const struct stat &st, std::vector<Extent> &extents) {
+  int64_t size = st.st_size;
+  extents.clear();
+#ifdef SEEK_DATA
+  // fewer allocated blocks than the size means holes
+  if ((int64_t) st.st_blocks * 512 < size) {
+    int64_t pos = 0;
+    while (pos < size) {
+      off_t data = ::lseek(fd, (off_t) pos, SEEK_DATA);
+      if (data < 0) {
+        if (errno == ENXIO)
+          return;
+        // SEEK_DATA unsupported: copy everything
+        extents.clear();
+        break;
+      }
+      off_t hole = ::lseek(fd, data, SEEK_HOLE);
+      int64_t data_end = (hole < 0 || (int64_t) hole > size) ? size : (int64_t) hole;
+      extents.push_back(Extent{(int64_t) data, data_end - (int64_t) data});
+      pos = data_end;
+    }
+    if (pos >= size)
+      return;
+  }
+#else
+  (void) fd;
+#endif
+  extents.push_back(Extent{0, size});
+}
+
+int copyParallel(int src_fd, int dst_fd, const std::vector<Extent> &extents) {
+  std::vector<Extent> chunks;
+  for (const Extent &extent : extents) {
+    for (int64_t pos = 0; pos < extent.length; pos += PARALLEL_CHUNK_SIZE) {
+      chunks.push_back(Extent{extent.offset + pos, std::min(PARALLEL_CHUNK_SIZE, extent.length - pos)});
+    }
+  }
+
+  return parallelFor(chunks.size(), 0, [&](size_t i) {
+    std::vector<char> buffer;
+    int method = METHOD_COPY_FILE_RANGE;
+    return copyRange(src_fd, dst_fd, chunks[i].offset, chunks[i].length, method, false, buffer);
+  });
+}
+
+int copyMetadata(int dst_fd, const struct stat &st) {
+  // ownership first: chown clears the set-id bits
+  if (::fchown(dst_fd, st.st_uid, st.st_gid) != 0 && errno != EPERM)
+    return errno;
+  if (::fchmod(dst_fd, st.st_mode & 07777) != 0)
+    return errno;
+  struct timespec times[2];
+#if defined(__APPLE__)
+  times[0] = st.st_atimespec;
+  times[1] = st.st_mtimespec;
+#else
+  times[0] = st.st_atim;
+  times[1] = st.st_mtim;
+#endif
+  if (::futimens(dst_fd, times) != 0)
+    return errno;
+  return 0;
+}
+
+}
+
+int copyFileFd(int src_fd, int dst_fd, int flags) {
+  struct stat st;
+  if (::fstat(src_fd, &st) != 0)
+    return errno;
+  if (!S_ISREG(st.st_mode))
+    return EINVAL;
+
+#if defined(__linux__)
+  // shares the extents, O(1) on XFS/Btrfs with reflink support
+  if (!(flags & COPY_NO_REFLINK) && ::ioctl(dst_fd, FICLONE, src_fd) == 0)
+    return 0;
+#endif
+
+  if (st.st_size == 0)
+    return 0;
+  // sets the size up front, extents that are not copied stay holes
+  if (::ftruncate(dst_fd, st.st_size) != 0)
+    return errno;
+
+  std::vector<Extent> extents;
+  collectExtents(src_fd, st, extents);
+
+  if (flags & COPY_PARALLEL) {
+    int64_t total = 0;
+    for (const Extent &extent : extents)
+      total += extent.length;
+    if (total >= PARALLEL_MIN_SIZE)
+      return copyParallel(src_fd, dst_fd, extents);
+  }
+
+  std::vector<char> buffer;
+  int method = METHOD_COPY_FILE_RANGE;
+  for (const Extent &extent : extents) {
+    int rc = copyRange(src_fd, dst_fd, extent.offset, extent.length, method, true, buffer);
+    if (rc)
+      return rc;
+  }
+  return 0;
+}
+
+int copyFile(const Path &src, const Path &dst, int flags) {
+  int src_fd;
+  do {
+    src_fd = ::open(src.getSystemString().c_str(), O_RDONLY | O_CLOEXEC);
+  } while (src_fd < 0 && errno == EINTR);
+  if (src_fd < 0)
+    return errno;
+
+  struct stat src_st;
+  if (::fstat(src_fd, &src_st) != 0) {
+    int err = errno;
+    ::close(src_fd);
+    return err;
+  }
+  if (S_ISDIR(src_st.st_mode)) {
+    ::close(src_fd);
+    return EISDIR;
+  }
+
+  int open_flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+  if (!(flags & COPY_OVERWRITE))
+    open_flags |= O_EXCL;
+  int dst_fd;
+  do {
+    dst_fd = ::open(dst.getSystemString().c_str(), open_flags, src_st.st_mode & 0777);
+  } while (dst_fd < 0 && errno == EINTR);
+  if (dst_fd < 0) {
+    int err = errno;
+    ::close(src_fd);
+    return err;
+  }
+
+  int rc = 0;
+  struct stat dst_st;
+  if (::fstat(dst_fd, &dst_st) != 0) {
+    rc = errno;
+  } else if (dst_st.st_dev == src_st.st_dev && dst_st.st_ino == src_st.st_ino) {
+    // truncating would destroy the source
+    ::close(src_fd);
+    ::close(dst_fd);
+    return EINVAL;
+  } else if (dst_st.st_size && ::ftruncate(dst_fd, 0) != 0) {
+    rc = errno;
+  }
+
+  if (!rc)
+    rc = copyFileFd(src_fd, dst_fd, flags);
+  if (!rc && (flags & COPY_PRESERVE_METADATA))
+    rc = copyMetadata(dst_fd, src_st);
+
+  ::close(src_fd);
+  if (::close(dst_fd) != 0 && !rc)
+    rc = errno;
+  if (rc)
+    ::unlink(dst.getSystemString().c_str());
+  return rc;
+}
+
+int moveFile(const Path &src, const Path &dst, int flags) {
+  const char *src_path = src.getSystemString().c_str();
+  const char *dst_path = dst.getSystemString().c_str();
+  // -1 until a rename has been attempted
+  int err = -1;
+
+#if defined(__linux__) && defined(SYS_renameat2)
+  if (!(flags & COPY_OVERWRITE)) {
+    if (::syscall(SYS_renameat2, AT_FDCWD, src_path, AT_FDCWD, dst_path, RENAME_NOREPLACE) == 0)
+      return 0;
+    err = errno;
+    if (err == EINVAL || err == ENOSYS)
+      err = -1;
+  }
+#endif
+
+  if (err < 0) {
+    struct stat st;
+    if (!(flags & COPY_OVERWRITE) && ::lstat(dst_path, &st) == 0)
+      return EEXIST;
+    if (::rename(src_path, dst_path) == 0)
+      return 0;
+    err = errno;
+  }
+  if (err != EXDEV)
+    return err;
+
+  // another filesystem: copy, then remove the source
+  int rc = copyFile(src, dst, flags | COPY_PRESERVE_METADATA);
+  if (rc)
+    return rc;
+  if (::unlink(src_path) != 0)
+    return errno;
+  return 0;
+}
+
+}
+}
+}
+#endif
@@ -0,0 +1,213 @@
+/**
+ * @file	directory-iterator.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/directory-iterator.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+namespace jcu {
+namespace file {
+
+namespace {
+
+#if defined(__linux__)
+// Kernel record returned by getdents64
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+#endif
+
+FileType fromDirentType(unsigned char d_type) {
+  switch (d_type) {
+    case DT_REG: return FILE_TYPE_REGULAR;
+    case DT_DIR: return FILE_TYPE_DIRECTORY;
+    case DT_LNK: return FILE_TYPE_SYMLINK;
+    case DT_BLK: return FILE_TYPE_BLOCK_DEVICE;
+    case DT_CHR: return FILE_TYPE_CHAR_DEVICE;
+    case DT_FIFO: return FILE_TYPE_FIFO;
+    case DT_SOCK: return FILE_TYPE_SOCKET;
+    default: return FILE_TYPE_UNKNOWN;
+  }
+}
+
+bool isDotOrDotDot(const char *name) {
+  return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+}
+
+}
+
+DirectoryIterator::DirectoryIterator()
+    : fd_(-1), dir_(NULL), pos_(0), end_(0), error_(0) {
+}
+
+DirectoryIterator::DirectoryIterator(DirectoryIterator &&obj)
+    : fd_(obj.fd_), dir_(obj.dir_), buffer_(std::move(obj.buffer_)), pos_(obj.pos_), end_(obj.end_), error_(obj.error_), entry_(obj.entry_) {
+  obj.fd_ = -1;
+  obj.dir_ = NULL;
+  obj.pos_ = 0;
+  obj.end_ = 0;
+}
+
+DirectoryIterator &DirectoryIterator::operator=(DirectoryIterator &&obj) {
+  if (this != &obj) {
+    close();
+    fd_ = obj.fd_;
+    dir_ = obj.dir_;
+    buffer_ = std::move(obj.buffer_);
+    pos_ = obj.pos_;
+    end_ = obj.end_;
+    error_ = obj.error_;
+    entry_ = obj.entry_;
+    obj.fd_ = -1;
+    obj.dir_ = NULL;
+    obj.pos_ = 0;
+    obj.end_ = 0;
+  }
+  return *this;
+}
+
+DirectoryIterator::~DirectoryIterator() {
+  close();
+}
+
+int DirectoryIterator::open(const Path &path, size_t buffer_size) {
+  int fd;
+  do {
+    fd = ::open(path.getSystemString().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    return errno;
+  }
+  return openFd(fd, buffer_size);
+}
+
+int DirectoryIterator::openFd(int fd, size_t buffer_size) {
+  close();
+  error_ = 0;
+#if defined(__linux__)
+  fd_ = fd;
+  if (buffer_size < 4096)
+    buffer_size = 4096;
+  if (buffer_.size() != buffer_size)
+    buffer_.resize(buffer_size);
+#else
+  (void) buffer_size;
+  DIR *dir = ::fdopendir(fd);
+  if (!dir) {
+    int err = errno;
+    ::close(fd);
+    return err;
+  }
+  dir_ = dir;
+#endif
+  return 0;
+}
+
+void DirectoryIterator::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  if (dir_) {
+    ::closedir((DIR *) dir_);
+  }
+  fd_ = -1;
+  dir_ = NULL;
+  pos_ = 0;
+  end_ = 0;
+}
+
+bool DirectoryIterator::fill() {
+#if defined(__linux__)
+  long n;
+  do {
+    n = ::syscall(SYS_getdents64, fd_, buffer_.data(), buffer_.size());
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    error_ = errno;
+    return false;
+  }
+  pos_ = 0;
+  end_ = (size_t) n;
+  return n > 0;
+#else
+  return false;
+#endif
+}
+
+bool DirectoryIterator::next() {
+#if defined(__linux__)
+  if (fd_ < 0) {
+    return false;
+  }
+  for (;;) {
+    if (pos_ >= end_) {
+      if (!fill())
+        return false;
+    }
+    const LinuxDirent64 *dirent = (const LinuxDirent64 *) (buffer_.data() + pos_);
+    pos_ += dirent->d_reclen;
+    if (isDotOrDotDot(dirent->d_name))
+      continue;
+    entry_.name_ = dirent->d_name;
+    entry_.name_length_ = strlen(dirent->d_name);
+    entry_.type_ = fromDirentType(dirent->d_type);
+    entry_.inode_ = dirent->d_ino;
+    return true;
+  }
+#else
+  if (!dir_) {
+    return false;
+  }
+  for (;;) {
+    errno = 0;
+    struct dirent *dirent = ::readdir((DIR *) dir_);
+    if (!dirent) {
+      error_ = errno;
+      return false;
+    }
+    if (isDotOrDotDot(dirent->d_name))
+      continue;
+    entry_.name_ = dirent->d_name;
+    entry_.name_length_ = strlen(dirent->d_name);
+    entry_.type_ = fromDirentType(dirent->d_type);
+    entry_.inode_ = dirent->d_ino;
+    return true;
+  }
+#endif
+}
+
+const DirectoryEntry &DirectoryIterator::entry() const {
+  return entry_;
+}
+
+int DirectoryIterator::error() const {
+  return error_;
+}
+
+DirectoryIterator::iterator DirectoryIterator::begin() {
+  return next() ? iterator(this) : iterator();
+}
+
+DirectoryIterator::iterator DirectoryIterator::end() {
+  return iterator();
+}
+
+}
+}
+#endif
@@ -0,0 +1,161 @@
+/**
+ * @file	directory.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/directory.h"
+
+#ifndef _WIN32
+#include "jcu-file/posix/posix-file-handler.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// the descriptor is only used as a starting point for lookups
+#if defined(O_PATH)
+#define DIRECTORY_OPEN_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+#else
+#define DIRECTORY_OPEN_FLAGS (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+#endif
+
+namespace jcu {
+namespace file {
+
+Directory::Directory()
+    : fd_(-1) {
+}
+
+Directory::Directory(Directory &&obj) noexcept
+    : fd_(obj.fd_), path_(std::move(obj.path_)) {
+  obj.fd_ = -1;
+}
+
+Directory &Directory::operator=(Directory &&obj) noexcept {
+  if (this != &obj) {
+    close();
+    fd_ = obj.fd_;
+    path_ = std::move(obj.path_);
+    obj.fd_ = -1;
+  }
+  return *this;
+}
+
+Directory::~Directory() {
+  close();
+}
+
+std::string Directory::childPath(const Path &name) const {
+  std::string str(path_.getSystemString());
+  if (!str.empty() && str.back() != '/')
+    str.push_back('/');
+  str.append(name.getSystemString());
+  return str;
+}
+
+int Directory::open(const Path &path) {
+  int fd;
+  do {
+    fd = ::open(path.getSystemString().c_str(), DIRECTORY_OPEN_FLAGS);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return errno;
+  close();
+  fd_ = fd;
+  path_ = path;
+  return 0;
+}
+
+int Directory::openDirectory(const Path &name, Directory &out) const {
+  int fd;
+  do {
+    fd = ::openat(fd_, name.getSystemString().c_str(), DIRECTORY_OPEN_FLAGS);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return errno;
+  out.close();
+  out.fd_ = fd;
+  out.path_ = Path::newFromSystem(childPath(name));
+  return 0;
+}
+
+void Directory::close() {
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+  path_ = Path();
+}
+
+bool Directory::isOpen() const {
+  return fd_ >= 0;
+}
+
+int Directory::fd() const {
+  return fd_;
+}
+
+const Path &Directory::path() const {
+  return path_;
+}
+
+int Directory::openFile(const Path &name, int flags, std::unique_ptr<FileHandler> &out) const {
+  if (fd_ < 0)
+    return EBADF;
+  std::unique_ptr<posix::PosixFileHandler> handler(new posix::PosixFileHandler(childPath(name)));
+  int rc = handler->openAt(fd_, name.getSystemString().c_str(), flags);
+  if (rc)
+    return rc;
+  out = std::move(handler);
+  return 0;
+}
+
+int Directory::stat(const Path &name, FileInfo &info, bool follow_symlinks) const {
+  return posix::statAt(fd_, name.getSystemString().c_str(), info, follow_symlinks);
+}
+
+int Directory::makeDirectory(const Path &name) const {
+  if (::mkdirat(fd_, name.getSystemString().c_str(), 0777) != 0)
+    return errno;
+  return 0;
+}
+
+int Directory::unlink(const Path &name) const {
+  if (::unlinkat(fd_, name.getSystemString().c_str(), 0) != 0)
+    return errno;
+  return 0;
+}
+
+int Directory::removeDirectory(const Path &name) const {
+  if (::unlinkat(fd_, name.getSystemString().c_str(), AT_REMOVEDIR) != 0)
+    return errno;
+  return 0;
+}
+
+int Directory::rename(const Path &name, const Path &new_name) const {
+  return rename(name, *this, new_name);
+}
+
+int Directory::rename(const Path &name, const Directory &new_dir, const Path &new_name) const {
+  if (::renameat(fd_, name.getSystemString().c_str(), new_dir.fd_, new_name.getSystemString().c_str()) != 0)
+    return errno;
+  return 0;
+}
+
+int Directory::list(DirectoryIterator &iter, size_t buffer_size) const {
+  // O_PATH descriptors cannot be read, reopen "." for the listing
+  int fd;
+  do {
+    fd = ::openat(fd_, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return errno;
+  return iter.openFd(fd, buffer_size);
+}
+
+}
+}
+#endif
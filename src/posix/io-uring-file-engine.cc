@@ -0,0 +1,440 @@
+/**
+ * @file	io-uring-file-engine.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/posix/io-uring-file-engine.h"
+
+#if defined(__linux__)
+#include "jcu-file/posix/posix-file-handler.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace jcu {
+namespace file {
+namespace posix {
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+
+namespace {
+
+inline int sysIoUringSetup(unsigned int entries, struct io_uring_params *params) {
+  return (int) ::syscall(__NR_io_uring_setup, entries, params);
+}
+
+inline int sysIoUringEnter(int ring_fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+  return (int) ::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+inline int sysIoUringRegister(int ring_fd, unsigned int opcode, void *arg, unsigned int nr_args) {
+  return (int) ::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+struct Request {
+  AsyncCallback callback;
+  // open: the handler the new fd belongs to
+  PosixFileHandler *attach_to;
+  std::string path;
+  struct iovec iov;
+
+  Request(const AsyncCallback &cb)
+      : callback(cb), attach_to(NULL) {
+    iov.iov_base = NULL;
+    iov.iov_len = 0;
+  }
+};
+
+class IoUringFileEngine : public AsyncFileEngine {
+ private:
+  int ring_fd_;
+
+  void *sq_ring_;
+  size_t sq_ring_size_;
+  void *cq_ring_;
+  size_t cq_ring_size_;
+  struct io_uring_sqe *sqes_;
+  size_t sqes_size_;
+
+  unsigned int *sq_head_;
+  unsigned int *sq_tail_;
+  unsigned int sq_mask_;
+  unsigned int sq_entries_;
+  unsigned int *sq_array_;
+  unsigned int *cq_head_;
+  unsigned int *cq_tail_;
+  unsigned int cq_mask_;
+  unsigned int cq_entries_;
+  struct io_uring_cqe *cqes_;
+
+  bool has_read_write_;
+  bool has_openat_;
+  bool has_close_;
+
+  std::mutex mutex_;
+  std::condition_variable idle_cv_;
+  std::condition_variable slot_cv_;
+  unsigned int pending_;
+  size_t inflight_;
+  bool stopping_;
+  std::thread reaper_;
+
+  void probe() {
+    std::vector<unsigned char> buf(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe *p = (struct io_uring_probe *) buf.data();
+    if (sysIoUringRegister(ring_fd_, IORING_REGISTER_PROBE, p, 256) < 0) {
+      // kernels before 5.6 have neither the probe nor these opcodes
+      return;
+    }
+    auto supported = [p](unsigned int op) {
+      return op <= p->last_op && (p->ops[op].flags & IO_URING_OP_SUPPORTED);
+    };
+    has_read_write_ = supported(IORING_OP_READ) && supported(IORING_OP_WRITE);
+    has_openat_ = supported(IORING_OP_OPENAT);
+    has_close_ = supported(IORING_OP_CLOSE);
+  }
+
+  int submitLocked() {
+    while (pending_ > 0) {
+      int ret = sysIoUringEnter(ring_fd_, pending_, 0, 0);
+      if (ret < 0) {
+        if (errno == EINTR)
+          continue;
+        return errno;
+      }
+      // nothing was consumed; report it instead of spinning
+      if (ret == 0)
+        return EAGAIN;
+      pending_ -= (unsigned int) ret;
+    }
+    return 0;
+  }
+
+  // Fill an SQE under mutex_. Takes ownership of req.
+  int queue(std::unique_lock<std::mutex> &lock, uint8_t opcode, int fd, uint64_t addr, uint32_t len, uint64_t off, uint32_t op_flags, Request *req,
+            uint8_t sqe_flags = 0) {
+    unsigned int tail;
+    struct io_uring_sqe *sqe;
+
+    // Keep completions within the CQ ring so none are dropped. Callbacks
+    // queueing from the reaper can't wait on themselves; the kernel buffers those.
+    if (inflight_ >= cq_entries_ && std::this_thread::get_id() != reaper_.get_id()) {
+      submitLocked();
+      slot_cv_.wait(lock, [this]() { return inflight_ < cq_entries_; });
+    }
+
+    tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+      int rc = submitLocked();
+      if (rc) {
+        delete req;
+        return rc;
+      }
+      if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        delete req;
+        return EBUSY;
+      }
+    }
+
+    unsigned int index = tail & sq_mask_;
+    sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->flags = sqe_flags;
+    sqe->fd = fd;
+    sqe->addr = addr;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->rw_flags = op_flags;
+    sqe->user_data = (uint64_t) (uintptr_t) req;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+    pending_++;
+    if (req)
+      inflight_++;
+    // The request belongs to the ring now and will complete, so a failed
+    // submit must not be reported as a failed queue; submit() reports it.
+    if (pending_ >= sq_entries_)
+      submitLocked();
+    return 0;
+  }
+
+  void complete(uint64_t user_data, int res) {
+    Request *req = (Request *) (uintptr_t) user_data;
+    if (!req)
+      return;
+    if (req->attach_to && res >= 0)
+      req->attach_to->attachFd(res);
+    if (req->callback)
+      req->callback(res);
+    delete req;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    inflight_--;
+    slot_cv_.notify_all();
+    if (inflight_ == 0)
+      idle_cv_.notify_all();
+  }
+
+  void reaperMain() {
+    for (;;) {
+      unsigned int head = *cq_head_;
+      unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      if (head == tail) {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          if (stopping_ && inflight_ == 0)
+            break;
+        }
+        sysIoUringEnter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+        continue;
+      }
+      while (head != tail) {
+        struct io_uring_cqe *cqe = &cqes_[head & cq_mask_];
+        uint64_t user_data = cqe->user_data;
+        int res = cqe->res;
+        head++;
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        complete(user_data, res);
+      }
+    }
+  }
+
+  static PosixFileHandler *toPosix(FileHandler &handler) {
+    return dynamic_cast<PosixFileHandler *>(&handler);
+  }
+
+ public:
+  IoUringFileEngine()
+      : ring_fd_(-1), sq_ring_(MAP_FAILED), sq_ring_size_(0), cq_ring_(MAP_FAILED), cq_ring_size_(0),
+        sqes_((struct io_uring_sqe *) MAP_FAILED), sqes_size_(0),
+        has_read_write_(false), has_openat_(false), has_close_(false),
+        pending_(0), inflight_(0), stopping_(false) {
+  }
+
+  ~IoUringFileEngine() {
+    if (reaper_.joinable()) {
+      drain();
+      std::unique_lock<std::mutex> lock(mutex_);
+      stopping_ = true;
+      // wake the reaper up with a completion that carries no request
+      queue(lock, IORING_OP_NOP, -1, 0, 0, 0, 0, NULL);
+      submitLocked();
+      lock.unlock();
+      reaper_.join();
+    }
+    if (sqes_ != MAP_FAILED)
+      ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+      ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED)
+      ::munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ >= 0)
+      ::close(ring_fd_);
+  }
+
+  int init(const AsyncEngineOptions &options) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring_fd_ = sysIoUringSetup(options.queue_depth ? options.queue_depth : 1, &params);
+    if (ring_fd_ < 0) {
+      return errno;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      if (cq_ring_size_ > sq_ring_size_)
+        sq_ring_size_ = cq_ring_size_;
+      cq_ring_size_ = sq_ring_size_;
+    }
+
+    sq_ring_ = ::mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      return errno;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = ::mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+      if (cq_ring_ == MAP_FAILED) {
+        return errno;
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = (struct io_uring_sqe *) ::mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+      return errno;
+    }
+
+    unsigned char *sq = (unsigned char *) sq_ring_;
+    unsigned char *cq = (unsigned char *) cq_ring_;
+    sq_head_ = (unsigned int *) (sq + params.sq_off.head);
+    sq_tail_ = (unsigned int *) (sq + params.sq_off.tail);
+    sq_mask_ = *(unsigned int *) (sq + params.sq_off.ring_mask);
+    sq_entries_ = *(unsigned int *) (sq + params.sq_off.ring_entries);
+    sq_array_ = (unsigned int *) (sq + params.sq_off.array);
+    cq_head_ = (unsigned int *) (cq + params.cq_off.head);
+    cq_tail_ = (unsigned int *) (cq + params.cq_off.tail);
+    cq_mask_ = *(unsigned int *) (cq + params.cq_off.ring_mask);
+    cq_entries_ = *(unsigned int *) (cq + params.cq_off.ring_entries);
+    cqes_ = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    probe();
+
+    reaper_ = std::thread(&IoUringFileEngine::reaperMain, this);
+    return 0;
+  }
+
+  AsyncEngineType type() const override {
+    return ASYNC_ENGINE_IO_URING;
+  }
+
+  int readAt(FileHandler &handler, void *buf, size_t size, int64_t offset, AsyncCallback callback) override {
+    PosixFileHandler *posix_handler = toPosix(handler);
+    if (!posix_handler)
+      return EBADF;
+    if (size > 0x7ffff000)
+      size = 0x7ffff000;
+    Request *req = new Request(callback);
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (has_read_write_)
+      return queue(lock, IORING_OP_READ, posix_handler->fd(), (uint64_t) (uintptr_t) buf, (uint32_t) size, (uint64_t) offset, 0, req);
+    req->iov.iov_base = buf;
+    req->iov.iov_len = size;
+    return queue(lock, IORING_OP_READV, posix_handler->fd(), (uint64_t) (uintptr_t) &req->iov, 1, (uint64_t) offset, 0, req);
+  }
+
+  int writeAt(FileHandler &handler, const void *buf, size_t size, int64_t offset, AsyncCallback callback) override {
+    PosixFileHandler *posix_handler = toPosix(handler);
+    if (!posix_handler)
+      return EBADF;
+    if (size > 0x7ffff000)
+      size = 0x7ffff000;
+    Request *req = new Request(callback);
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (has_read_write_)
+      return queue(lock, IORING_OP_WRITE, posix_handler->fd(), (uint64_t) (uintptr_t) buf, (uint32_t) size, (uint64_t) offset, 0, req);
+    req->iov.iov_base = (void *) buf;
+    req->iov.iov_len = size;
+    return queue(lock, IORING_OP_WRITEV, posix_handler->fd(), (uint64_t) (uintptr_t) &req->iov, 1, (uint64_t) offset, 0, req);
+  }
+
+  int sync(FileHandler &handler, bool data_only, AsyncCallback callback) override {
+    PosixFileHandler *posix_handler = toPosix(handler);
+    if (!posix_handler)
+      return EBADF;
+    Request *req = new Request(callback);
+    std::unique_lock<std::mutex> lock(mutex_);
+    // IOSQE_IO_DRAIN: after the writes queued before it, see AsyncFileEngine::sync
+    return queue(lock, IORING_OP_FSYNC, posix_handler->fd(), 0, 0, 0, data_only ? IORING_FSYNC_DATASYNC : 0, req, IOSQE_IO_DRAIN);
+  }
+
+  int open(FileHandler &handler, int flags, AsyncCallback callback) override {
+    PosixFileHandler *posix_handler = toPosix(handler);
+    if (!posix_handler)
+      return EBADF;
+    // ATOMIC_REPLACE may have to retry with other flags and MODE_DIRECT is
+    // switched on after the open, keep them synchronous
+    if (!has_openat_ || (flags & (ATOMIC_REPLACE | MODE_DIRECT))) {
+      int rc = posix_handler->open(flags);
+      if (callback)
+        callback(rc ? -((int64_t) rc) : 0);
+      return 0;
+    }
+
+    Request *req = new Request([callback](int64_t result) {
+      if (callback)
+        callback(result < 0 ? result : 0);
+    });
+    int open_flags = 0;
+    int rc = posix_handler->prepareOpen(flags, req->path, open_flags);
+    if (rc) {
+      delete req;
+      return rc;
+    }
+    req->attach_to = posix_handler;
+    std::unique_lock<std::mutex> lock(mutex_);
+    return queue(lock, IORING_OP_OPENAT, AT_FDCWD, (uint64_t) (uintptr_t) req->path.c_str(), (uint32_t) posix_handler->createMode(), 0, (uint32_t) open_flags, req);
+  }
+
+  int close(FileHandler &handler, AsyncCallback callback) override {
+    PosixFileHandler *posix_handler = toPosix(handler);
+    if (!posix_handler)
+      return EBADF;
+    if (!posix_handler->isOpen()) {
+      int rc = posix_handler->close();
+      if (callback)
+        callback(rc ? -((int64_t) rc) : 0);
+      return 0;
+    }
+    // a pending ATOMIC_REPLACE keeps its fd for commit(), only close() knows that
+    if (!has_close_ || posix_handler->isReplacePending()) {
+      // close on the reaper once a draining NOP says the earlier operations are done
+      Request *req = new Request([posix_handler, callback](int64_t) {
+        int rc = posix_handler->close();
+        if (callback)
+          callback(rc ? -((int64_t) rc) : 0);
+      });
+      std::unique_lock<std::mutex> lock(mutex_);
+      return queue(lock, IORING_OP_NOP, -1, 0, 0, 0, 0, req, IOSQE_IO_DRAIN);
+    }
+    Request *req = new Request(callback);
+    std::unique_lock<std::mutex> lock(mutex_);
+    return queue(lock, IORING_OP_CLOSE, posix_handler->detachFd(), 0, 0, 0, 0, req, IOSQE_IO_DRAIN);
+  }
+
+  int submit() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return submitLocked();
+  }
+
+  void drain() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    submitLocked();
+    idle_cv_.wait(lock, [this]() { return inflight_ == 0; });
+  }
+};
+
+}
+
+std::unique_ptr<AsyncFileEngine> createIoUringFileEngine(const AsyncEngineOptions &options, int *perr) {
+  std::unique_ptr<IoUringFileEngine> engine(new IoUringFileEngine());
+  int rc = engine->init(options);
+  if (perr)
+    *perr = rc;
+  if (rc)
+    return nullptr;
+  return engine;
+}
+
+#else
+
+std::unique_ptr<AsyncFileEngine> createIoUringFileEngine(const AsyncEngineOptions &options, int *perr) {
+  if (perr)
+    *perr = ENOSYS;
+  return nullptr;
+}
+
+#endif
+
+}
+}
+}
+#endif
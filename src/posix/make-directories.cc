@@ -0,0 +1,138 @@
+/**
+ * @file	make-directories.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/posix/make-directories.h"
+
+#ifndef _WIN32
+#include "jcu-file/path-table.h"
+#include "../parallel-for.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace jcu {
+namespace file {
+namespace posix {
+
+namespace {
+
+// the descriptors are only used as starting points for mkdirat/openat
+#if defined(O_PATH)
+const int DIRECTORY_OPEN_FLAGS = O_PATH | O_DIRECTORY | O_CLOEXEC;
+#else
+const int DIRECTORY_OPEN_FLAGS = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+#endif
+
+typedef std::vector<std::vector<PathTable::Id>> ChildLists;
+
+int createAt(int parent_fd, const PathTable &table, const ChildLists &children, PathTable::Id id) {
+  std::string name(table.name(id));
+  if (::mkdirat(parent_fd, name.c_str(), 0777) != 0 && errno != EEXIST)
+    return errno;
+  if (children[id].empty())
+    return 0;
+
+  int fd;
+  do {
+    fd = ::openat(parent_fd, name.c_str(), DIRECTORY_OPEN_FLAGS);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return errno;
+  int rc = 0;
+  for (PathTable::Id child : children[id]) {
+    rc = createAt(fd, table, children, child);
+    if (rc)
+      break;
+  }
+  ::close(fd);
+  return rc;
+}
+
+}
+
+int makeDirectory(const std::string &path, bool recursive) {
+  if (::mkdir(path.c_str(), 0777) == 0)
+    return 0;
+  int err = errno;
+  if (err == EEXIST)
+    return 0;
+  if (err != ENOENT || !recursive)
+    return err;
+
+  // a parent is missing: create it the same way, then retry
+  size_t end = path.find_last_not_of('/');
+  if (end == std::string::npos)
+    return err;
+  size_t slash = path.find_last_of('/', end);
+  if (slash == std::string::npos)
+    return err;
+  size_t parent_end = path.find_last_not_of('/', slash);
+  if (parent_end == std::string::npos)
+    return err;
+  int rc = makeDirectory(path.substr(0, parent_end + 1), true);
+  if (rc)
+    return rc;
+  if (::mkdir(path.c_str(), 0777) != 0 && errno != EEXIST)
+    return errno;
+  return 0;
+}
+
+int makeDirectories(const std::vector<Path> &paths, int threads) {
+  // the table merges shared prefixes and drops duplicates
+  PathTable table;
+  for (const Path &path : paths) {
+    if (path.isEmpty())
+      continue;
+    if (table.add(path) == PathTable::NO_ID)
+      return ENAMETOOLONG;
+  }
+  if (table.size() == 0)
+    return 0;
+
+  // the last list holds the top-level nodes
+  size_t root = table.size();
+  ChildLists children(root + 1);
+  for (PathTable::Id id = 0; id < root; id++) {
+    PathTable::Id parent = table.parent(id);
+    children[(parent == PathTable::NO_ID) ? root : parent].push_back(id);
+  }
+
+  // walk down the part shared by every path and create it in one go
+  size_t node = root;
+  while (children[node].size() == 1)
+    node = children[node][0];
+  int base_fd = AT_FDCWD;
+  if (node != root) {
+    std::string prefix;
+    table.appendPath((PathTable::Id) node, prefix);
+    int rc = makeDirectory(prefix, true);
+    if (rc || children[node].empty())
+      return rc;
+    do {
+      base_fd = ::open(prefix.c_str(), DIRECTORY_OPEN_FLAGS);
+    } while (base_fd < 0 && errno == EINTR);
+    if (base_fd < 0)
+      return errno;
+  }
+
+  // subtrees below the prefix are independent
+  const std::vector<PathTable::Id> &subtrees = children[node];
+  int rc = parallelFor(subtrees.size(), threads, [&](size_t i) {
+    return createAt(base_fd, table, children, subtrees[i]);
+  });
+
+  if (base_fd != AT_FDCWD)
+    ::close(base_fd);
+  return rc;
+}
+
+}
+}
+}
+#endif
@@ -0,0 +1,234 @@
+/**
+ * @file	mapped-region.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/mapped-region.h"
+
+#ifndef _WIN32
+#include "jcu-file/posix/posix-file-handler.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace jcu {
+namespace file {
+
+static size_t pageSize() {
+  static const size_t page_size = (size_t) ::sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+MappedRegion::MappedRegion()
+    : base_(NULL), base_size_(0), data_(NULL), size_(0), offset_(0), mode_(MAP_MODE_READ_ONLY) {
+}
+
+MappedRegion::MappedRegion(MappedRegion &&obj)
+    : base_(obj.base_), base_size_(obj.base_size_), data_(obj.data_), size_(obj.size_), offset_(obj.offset_), mode_(obj.mode_) {
+  obj.base_ = NULL;
+  obj.base_size_ = 0;
+  obj.data_ = NULL;
+  obj.size_ = 0;
+}
+
+MappedRegion &MappedRegion::operator=(MappedRegion &&obj) {
+  if (this != &obj) {
+    unmap();
+    base_ = obj.base_;
+    base_size_ = obj.base_size_;
+    data_ = obj.data_;
+    size_ = obj.size_;
+    offset_ = obj.offset_;
+    mode_ = obj.mode_;
+    obj.base_ = NULL;
+    obj.base_size_ = 0;
+    obj.data_ = NULL;
+    obj.size_ = 0;
+  }
+  return *this;
+}
+
+MappedRegion::~MappedRegion() {
+  unmap();
+}
+
+int MappedRegion::mapFd(int fd, MapMode mode, int64_t offset, int64_t length) {
+  int prot;
+  int map_flags;
+  struct stat st;
+
+  if (offset < 0) {
+    return EINVAL;
+  }
+
+  if (length < 0 || mode == MAP_MODE_READ_ONLY) {
+    if (::fstat(fd, &st) != 0) {
+      return errno;
+    }
+    if (st.st_size <= offset) {
+      return EINVAL;
+    }
+    if (length < 0) {
+      length = st.st_size - offset;
+    } else if (length > st.st_size - offset) {
+      // pages past the end of file raise SIGBUS, and a read-only mapping can't grow the file
+      return EINVAL;
+    }
+  }
+  if (length == 0 || (uint64_t) length > (uint64_t) SIZE_MAX) {
+    return EINVAL;
+  }
+
+  switch (mode) {
+    case MAP_MODE_READ_ONLY:
+      prot = PROT_READ;
+      map_flags = MAP_SHARED;
+      break;
+    case MAP_MODE_READ_WRITE:
+      prot = PROT_READ | PROT_WRITE;
+      map_flags = MAP_SHARED;
+      break;
+    case MAP_MODE_PRIVATE:
+      prot = PROT_READ | PROT_WRITE;
+      map_flags = MAP_PRIVATE;
+      break;
+    default:
+      return EINVAL;
+  }
+
+  // mmap wants a page aligned offset, so map from the page start and skip the head.
+  size_t head = (size_t) (offset % (int64_t) pageSize());
+  size_t map_size = (size_t) length + head;
+  void *base = ::mmap(NULL, map_size, prot, map_flags, fd, (off_t) (offset - head));
+  if (base == MAP_FAILED) {
+    return errno;
+  }
+
+  unmap();
+  base_ = base;
+  base_size_ = map_size;
+  data_ = (unsigned char *) base + head;
+  size_ = (size_t) length;
+  offset_ = offset;
+  mode_ = mode;
+  return 0;
+}
+
+int MappedRegion::map(FileHandler &handler, MapMode mode, int64_t offset, int64_t length) {
+  posix::PosixFileHandler *posix_handler = dynamic_cast<posix::PosixFileHandler *>(&handler);
+  if (!posix_handler || !posix_handler->isOpen()) {
+    return EBADF;
+  }
+  return mapFd(posix_handler->fd(), mode, offset, length);
+}
+
+int MappedRegion::map(const Path &path, MapMode mode, int64_t offset, int64_t length) {
+  int fd;
+  int rc;
+  int open_flags = O_CLOEXEC | ((mode == MAP_MODE_READ_WRITE) ? O_RDWR : O_RDONLY);
+  do {
+    fd = ::open(path.getSystemString().c_str(), open_flags);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    return errno;
+  }
+  rc = mapFd(fd, mode, offset, length);
+  ::close(fd);
+  return rc;
+}
+
+int MappedRegion::unmap() {
+  int rc = 0;
+  if (base_) {
+    if (::munmap(base_, base_size_) != 0) {
+      rc = errno;
+    }
+  }
+  base_ = NULL;
+  base_size_ = 0;
+  data_ = NULL;
+  size_ = 0;
+  return rc;
+}
+
+int MappedRegion::advise(MapAdvice advice, size_t offset, int64_t length) {
+  int native_advice;
+
+  if (!base_) {
+    return EBADF;
+  }
+  if (offset > size_) {
+    return EINVAL;
+  }
+  if (length < 0 || (uint64_t) length > (uint64_t) (size_ - offset)) {
+    length = (int64_t) (size_ - offset);
+  }
+
+  switch (advice) {
+    case MAP_ADVICE_NORMAL: native_advice = MADV_NORMAL; break;
+    case MAP_ADVICE_SEQUENTIAL: native_advice = MADV_SEQUENTIAL; break;
+    case MAP_ADVICE_RANDOM: native_advice = MADV_RANDOM; break;
+    case MAP_ADVICE_WILLNEED: native_advice = MADV_WILLNEED; break;
+    case MAP_ADVICE_HUGEPAGE:
+#ifdef MADV_HUGEPAGE
+      native_advice = MADV_HUGEPAGE;
+      break;
+#else
+      return ENOTSUP;
+#endif
+    default:
+      return EINVAL;
+  }
+
+  // madvise wants a page aligned start
+  unsigned char *start = data_ + offset;
+  size_t start_head = (size_t) (start - (unsigned char *) base_) % pageSize();
+  start -= start_head;
+  if (::madvise(start, (size_t) length + start_head, native_advice) != 0) {
+    return errno;
+  }
+  return 0;
+}
+
+int MappedRegion::flush(bool async) {
+  if (!base_) {
+    return EBADF;
+  }
+  if (::msync(base_, base_size_, async ? MS_ASYNC : MS_SYNC) != 0) {
+    return errno;
+  }
+  return 0;
+}
+
+bool MappedRegion::isMapped() const {
+  return base_ != NULL;
+}
+
+void *MappedRegion::data() {
+  return data_;
+}
+
+const void *MappedRegion::data() const {
+  return data_;
+}
+
+size_t MappedRegion::size() const {
+  return size_;
+}
+
+int64_t MappedRegion::offset() const {
+  return offset_;
+}
+
+MapMode MappedRegion::mode() const {
+  return mode_;
+}
+
+}
+}
+#endif
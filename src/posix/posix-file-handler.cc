@@ -0,0 +1,1001 @@
+/**
+ * @file	posix-file-handler.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/file-factory.h"
+#include "jcu-file/file-handler.h"
+#include "jcu-file/temp-file-service.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <time.h>
+#include <list>
+
+#ifndef _WIN32
+#include "jcu-file/posix/posix-file-handler.h"
+#include "jcu-file/posix/copy-file.h"
+#include "jcu-file/posix/make-directories.h"
+#include "jcu-file/directory-iterator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+#include <sys/uio.h>
+
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+namespace jcu {
+namespace file {
+
+namespace posix {
+
+static_assert(sizeof(IoVec) == sizeof(struct iovec), "IoVec must match struct iovec");
+static_assert(offsetof(IoVec, base) == offsetof(struct iovec, iov_base), "IoVec must match struct iovec");
+static_assert(offsetof(IoVec, length) == offsetof(struct iovec, iov_len), "IoVec must match struct iovec");
+
+// ADAPTIVE_READAHEAD window bounds, and the DROP_BEHIND granularity
+static const int64_t READAHEAD_MIN_WINDOW = 256 * 1024;
+static const int64_t READAHEAD_MAX_WINDOW = 16 * 1024 * 1024;
+static const int64_t DROP_BEHIND_CHUNK = 8 * 1024 * 1024;
+
+static inline const struct iovec *toIovec(const IoVec *iov) {
+  return reinterpret_cast<const struct iovec *>(iov);
+}
+
+static inline int clampIovCount(int count) {
+  return (count > IOV_MAX) ? IOV_MAX : count;
+}
+
+// Name next to the target that is unique across threads and processes
+static std::string uniqueSiblingName(const std::string &path, const char *suffix) {
+  static std::atomic<unsigned int> counter(0);
+  std::vector<char> fnbuf(path.length() + 48);
+  snprintf(fnbuf.data(), fnbuf.size(), "%s.%d.%u.%s", path.c_str(), (int) ::getpid(), counter++, suffix);
+  return fnbuf.data();
+}
+
+static std::string parentDirectory(const std::string &path) {
+  size_t pos = path.find_last_of('/');
+  if (pos == std::string::npos)
+    return ".";
+  while (pos > 0 && path[pos - 1] == '/')
+    pos--;
+  if (pos == 0)
+    return "/";
+  return path.substr(0, pos);
+}
+
+static int syncDirectory(const std::string &path) {
+  int fd;
+  do {
+    fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return errno;
+  int rc;
+  do {
+    rc = ::fsync(fd);
+  } while (rc != 0 && errno == EINTR);
+  int err = (rc != 0) ? errno : 0;
+  ::close(fd);
+  // some filesystems cannot sync directories, nothing more can be done there
+  if (err == EINVAL || err == EROFS)
+    err = 0;
+  return err;
+}
+
+// Give an O_TMPFILE file a name
+static int linkAnonymous(int fd, const std::string &target) {
+#if defined(__linux__)
+  // AT_EMPTY_PATH needs CAP_DAC_READ_SEARCH, /proc works for everyone else
+  if (::linkat(fd, "", AT_FDCWD, target.c_str(), AT_EMPTY_PATH) == 0)
+    return 0;
+  if (errno == EEXIST)
+    return EEXIST;
+  char proc_path[64];
+  snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+  if (::linkat(AT_FDCWD, proc_path, AT_FDCWD, target.c_str(), AT_SYMLINK_FOLLOW) == 0)
+    return 0;
+  return errno;
+#else
+  (void) fd;
+  (void) target;
+  return ENOTSUP;
+#endif
+}
+
+static FileType fromStatMode(unsigned int mode) {
+  if (S_ISREG(mode)) return FILE_TYPE_REGULAR;
+  if (S_ISDIR(mode)) return FILE_TYPE_DIRECTORY;
+  if (S_ISLNK(mode)) return FILE_TYPE_SYMLINK;
+  if (S_ISBLK(mode)) return FILE_TYPE_BLOCK_DEVICE;
+  if (S_ISCHR(mode)) return FILE_TYPE_CHAR_DEVICE;
+  if (S_ISFIFO(mode)) return FILE_TYPE_FIFO;
+  if (S_ISSOCK(mode)) return FILE_TYPE_SOCKET;
+  return FILE_TYPE_UNKNOWN;
+}
+
+int statAt(int dir_fd, const char *path, FileInfo &info, bool follow_symlinks) {
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+  static std::atomic<bool> no_statx(false);
+  if (!no_statx.load(std::memory_order_relaxed)) {
+    struct statx stx;
+    unsigned int mask = STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_INO | STATX_SIZE | STATX_MTIME | STATX_CTIME;
+    if (::statx(dir_fd, path, follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW, mask, &stx) == 0) {
+      info.type = fromStatMode(stx.stx_mode);
+      info.size = (int64_t) stx.stx_size;
+      info.mtime_ns = (int64_t) stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec;
+      info.ctime_ns = (int64_t) stx.stx_ctime.tv_sec * 1000000000LL + stx.stx_ctime.tv_nsec;
+      info.inode = stx.stx_ino;
+      info.device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+      info.permissions = stx.stx_mode & 07777;
+      info.link_count = stx.stx_nlink;
+      return 0;
+    }
+    if (errno != ENOSYS)
+      return errno;
+    no_statx = true;
+  }
+#endif
+  struct stat st;
+  if (::fstatat(dir_fd, path, &st, follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+    return errno;
+  }
+  info.type = fromStatMode(st.st_mode);
+  info.size = (int64_t) st.st_size;
+#if defined(__APPLE__)
+  info.mtime_ns = (int64_t) st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+  info.ctime_ns = (int64_t) st.st_ctimespec.tv_sec * 1000000000LL + st.st_ctimespec.tv_nsec;
+#else
+  info.mtime_ns = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  info.ctime_ns = (int64_t) st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+#endif
+  info.inode = st.st_ino;
+  info.device = st.st_dev;
+  info.permissions = st.st_mode & 07777;
+  info.link_count = st.st_nlink;
+  return 0;
+}
+
+class PosixFileFactory : public FileFactory {
+ public:
+  PosixFileFactory() {
+  }
+
+  ~PosixFileFactory() {
+  }
+
+  std::unique_ptr<FileHandler> createFileHandle(const Path &file_path) const override {
+    return std::unique_ptr<FileHandler>(new PosixFileHandler(file_path.getSystemString()));
+  }
+
+  int makeDirectory(const Path &path, bool recursive) const override {
+    return posix::makeDirectory(path.getSystemString(), recursive);
+  }
+
+  int makeDirectories(const std::vector<Path> &paths, int threads) const override {
+    return posix::makeDirectories(paths, threads);
+  }
+
+  Path getTempDir(int *perr) const override {
+    const char *temp_dir = ::getenv("TMPDIR");
+    if (!temp_dir || !temp_dir[0])
+      temp_dir = P_tmpdir;
+
+    if (perr)
+      *perr = 0;
+
+    return Path::newFromSystem(temp_dir);
+  }
+
+  Path generateTempPath(const char *prefix, int *perr) const override {
+    if (perr)
+      *perr = 0;
+    return TempFileService::instance().generatePath(prefix);
+  }
+  bool isFile(const Path &path) const override;
+  bool isDirectory(const Path &path) const override;
+  bool isDevice(const Path &path) const override;
+  int readdir(std::list<Path> &out, const Path &path) const override;
+  int readdir(PathTable &table, PathTable::Id dir) const override;
+  int64_t getFileSize(const Path& path) const override;
+  int stat(const Path &path, FileInfo &info, bool follow_symlinks) const override;
+  int copyFile(const Path &src, const Path &dst, int flags) const override;
+  int moveFile(const Path &src, const Path &dst, int flags) const override;
+};
+
+PosixFileHandler::PosixFileHandler(const std::string &path)
+    : path_(path), fd_(-1), flags_(0), create_mode_(0666), anonymous_(false), replace_pending_(false), pending_fd_(-1), direct_(false), alignment_(1),
+      cursor_(0), last_read_end_(-1), run_reads_(0), readahead_end_(0), readahead_window_(0), dropped_end_(0) {
+}
+PosixFileHandler::~PosixFileHandler() {
+  close();
+  discardReplace();
+}
+int PosixFileHandler::removeOld() {
+  struct stat st;
+  if (::lstat(path_.c_str(), &st) == 0) {
+    if (flags_ & RENAME_IF_EXISTS) {
+      // a timestamp would collide for two replacements within a second
+      old_path_ = uniqueSiblingName(path_, "old");
+      if (::rename(path_.c_str(), old_path_.c_str()) != 0) {
+        return errno;
+      }
+    }
+    if (flags_ & REMOVE_IF_EXISTS) {
+      std::string to_remove_file = old_path_.empty() ? path_ : old_path_;
+      ::unlink(to_remove_file.c_str());
+    }
+  }
+  return 0;
+}
+
+int PosixFileHandler::fd() const {
+  return fd_;
+}
+
+void PosixFileHandler::setCreateMode(int mode) {
+  create_mode_ = mode;
+}
+
+int PosixFileHandler::createMode() const {
+  return create_mode_;
+}
+
+int PosixFileHandler::prepareOpen(int flags, std::string &open_path, int &open_flags) {
+  open_flags = O_CLOEXEC;
+
+  flags_ = flags;
+
+  if ((flags & MODE_READ) && (flags & MODE_WRITE))
+    open_flags |= O_RDWR;
+  else if (flags & MODE_WRITE)
+    open_flags |= O_WRONLY;
+  else
+    open_flags |= O_RDONLY;
+  if (flags & MODE_CREATE_NEW)
+    open_flags |= O_CREAT | O_EXCL;
+  else if (flags & MODE_CREATE)
+    open_flags |= O_CREAT | O_TRUNC;
+  else if (!(flags & MODE_EXISTS))
+    open_flags |= O_CREAT;
+  // SHARE_READ has no counterpart: POSIX has no mandatory share modes.
+  // MODE_DIRECT is switched on after the open, see enableDirect().
+
+  if (flags & ATOMIC_REPLACE) {
+    struct stat st;
+    discardReplace();
+    if ((flags & MODE_EXISTS) && ::lstat(path_.c_str(), &st) != 0)
+      return errno;
+    // the target is left alone until commit()
+    open_flags &= ~(O_ACCMODE | O_CREAT | O_TRUNC | O_EXCL);
+    open_flags |= (flags & MODE_READ) ? O_RDWR : O_WRONLY;
+#ifdef O_TMPFILE
+    open_path = parentDirectory(path_);
+    open_flags |= O_TMPFILE;
+    anonymous_ = true;
+    return 0;
+#else
+    return prepareNamedTemp(open_path, open_flags);
+#endif
+  }
+
+  if (flags & USE_TEMPNAME) {
+    open_path = uniqueSiblingName(path_, "new");
+    temp_path_ = open_path;
+  } else {
+    removeOld();
+    open_path = path_;
+  }
+
+  return 0;
+}
+
+int PosixFileHandler::prepareNamedTemp(std::string &open_path, int &open_flags) {
+#ifdef O_TMPFILE
+  open_flags &= ~O_TMPFILE;
+#endif
+  open_flags |= O_CREAT | O_EXCL;
+  open_path = uniqueSiblingName(path_, "new");
+  temp_path_ = open_path;
+  anonymous_ = false;
+  return 0;
+}
+
+void PosixFileHandler::attachFd(int fd) {
+  close();
+  fd_ = fd;
+  if (fd_ >= 0)
+    applyOpenHints();
+}
+
+int PosixFileHandler::detachFd() {
+  int fd = fd_;
+  fd_ = -1;
+  return fd;
+}
+bool PosixFileHandler::isReplacePending() const {
+  return replace_pending_;
+}
+
+int PosixFileHandler::open(int flags) {
+  return openAt(AT_FDCWD, NULL, flags);
+}
+int PosixFileHandler::openAt(int dir_fd, const char *name, int flags) {
+  int open_flags = 0;
+  std::string open_path;
+  int rc = prepareOpen(flags, open_path, open_flags);
+  if (rc)
+    return rc;
+
+  // the file itself is resolved from dir_fd; temp names and O_TMPFILE use full paths
+  int at_fd = AT_FDCWD;
+  const char *at_path = open_path.c_str();
+  if (name && open_path == path_) {
+    at_fd = dir_fd;
+    at_path = name;
+  }
+
+  do {
+    fd_ = ::openat(at_fd, at_path, open_flags, (mode_t) create_mode_);
+  } while (fd_ < 0 && errno == EINTR);
+  if (fd_ < 0 && anonymous_ && (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL)) {
+    // no O_TMPFILE on this kernel or filesystem: use a named temp file
+    prepareNamedTemp(open_path, open_flags);
+    at_fd = AT_FDCWD;
+    at_path = open_path.c_str();
+    do {
+      fd_ = ::openat(at_fd, at_path, open_flags, (mode_t) create_mode_);
+    } while (fd_ < 0 && errno == EINTR);
+  }
+  if (fd_ >= 0) {
+    replace_pending_ = (flags & ATOMIC_REPLACE) != 0;
+    initDirect((flags & MODE_DIRECT) && enableDirect());
+    applyOpenHints();
+    return 0;
+  }
+
+  int err = errno;
+  temp_path_.clear();
+  return err;
+}
+bool PosixFileHandler::enableDirect() {
+#ifdef O_DIRECT
+  // Not passed to open(): O_CREAT creates the file before an O_DIRECT open
+  // is refused, so a cached retry would find it and fail with EEXIST.
+  int fl = ::fcntl(fd_, F_GETFL);
+  // EINVAL: no direct I/O on this filesystem, stay cached
+  return fl >= 0 && ::fcntl(fd_, F_SETFL, fl | O_DIRECT) == 0;
+#else
+  return true;
+#endif
+}
+void PosixFileHandler::initDirect(bool requested) {
+  direct_ = false;
+  alignment_ = 1;
+  if (!requested)
+    return;
+#if defined(__linux__) && defined(O_DIRECT)
+  size_t alignment = 0;
+#if defined(STATX_DIOALIGN)
+  struct statx stx;
+  if (::statx(fd_, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN)) {
+    if (stx.stx_dio_offset_align == 0) {
+      // the open succeeded but this file cannot do direct I/O
+      int fl = ::fcntl(fd_, F_GETFL);
+      if (fl >= 0)
+        ::fcntl(fd_, F_SETFL, fl & ~O_DIRECT);
+      return;
+    }
+    alignment = std::max(stx.stx_dio_offset_align, stx.stx_dio_mem_align);
+  }
+#endif
+  if (!alignment) {
+    // st_blksize is a multiple of the logical block size
+    struct stat st;
+    alignment = (::fstat(fd_, &st) == 0 && st.st_blksize >= 512) ? (size_t) st.st_blksize : 4096;
+  }
+  direct_ = true;
+  alignment_ = alignment;
+#elif defined(F_NOCACHE)
+  // no alignment requirements, only no caching
+  direct_ = ::fcntl(fd_, F_NOCACHE, 1) == 0;
+#endif
+}
+int PosixFileHandler::read(void *buf, int size) {
+  ssize_t n;
+  do {
+    n = ::read(fd_, buf, size);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  if (n > 0 && (flags_ & (ADAPTIVE_READAHEAD | DROP_BEHIND)))
+    onCursorRead(n);
+  return (int) n;
+}
+int PosixFileHandler::write(const void *buf, int size) {
+  ssize_t n;
+  do {
+    n = ::write(fd_, buf, size);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  if (flags_ & (ADAPTIVE_READAHEAD | DROP_BEHIND))
+    cursor_ += n;
+  return (int) n;
+}
+int64_t PosixFileHandler::readAt(void *buf, size_t size, int64_t offset) {
+  ssize_t n;
+  do {
+    n = ::pread(fd_, buf, size, (off_t) offset);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  return n;
+}
+int64_t PosixFileHandler::writeAt(const void *buf, size_t size, int64_t offset) {
+  ssize_t n;
+  do {
+    n = ::pwrite(fd_, buf, size, (off_t) offset);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  return n;
+}
+int64_t PosixFileHandler::read64(void *buf, size_t size) {
+  ssize_t n;
+  do {
+    n = ::read(fd_, buf, size);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  if (n > 0 && (flags_ & (ADAPTIVE_READAHEAD | DROP_BEHIND)))
+    onCursorRead(n);
+  return n;
+}
+int64_t PosixFileHandler::write64(const void *buf, size_t size) {
+  ssize_t n;
+  do {
+    n = ::write(fd_, buf, size);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  if (flags_ & (ADAPTIVE_READAHEAD | DROP_BEHIND))
+    cursor_ += n;
+  return n;
+}
+int64_t PosixFileHandler::readv(const IoVec *iov, int count) {
+  ssize_t n;
+  do {
+    n = ::readv(fd_, toIovec(iov), clampIovCount(count));
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  if (n > 0 && (flags_ & (ADAPTIVE_READAHEAD | DROP_BEHIND)))
+    onCursorRead(n);
+  return n;
+}
+int64_t PosixFileHandler::writev(const IoVec *iov, int count) {
+  ssize_t n;
+  do {
+    n = ::writev(fd_, toIovec(iov), clampIovCount(count));
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  if (flags_ & (ADAPTIVE_READAHEAD | DROP_BEHIND))
+    cursor_ += n;
+  return n;
+}
+int64_t PosixFileHandler::readvAt(const IoVec *iov, int count, int64_t offset) {
+  ssize_t n;
+  do {
+    n = ::preadv(fd_, toIovec(iov), clampIovCount(count), (off_t) offset);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  return n;
+}
+int64_t PosixFileHandler::writevAt(const IoVec *iov, int count, int64_t offset) {
+  ssize_t n;
+  do {
+    n = ::pwritev(fd_, toIovec(iov), clampIovCount(count), (off_t) offset);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -errno;
+  }
+  return n;
+}
+int PosixFileHandler::sync(bool data_only) {
+  int rc;
+  do {
+    rc = data_only ? ::fdatasync(fd_) : ::fsync(fd_);
+  } while (rc != 0 && errno == EINTR);
+  if (rc != 0) {
+    return errno;
+  }
+  return 0;
+}
+int PosixFileHandler::allocate(int64_t offset, int64_t length, bool keep_size) {
+  int rc;
+#if defined(__linux__)
+  do {
+    rc = ::fallocate(fd_, keep_size ? FALLOC_FL_KEEP_SIZE : 0, (off_t) offset, (off_t) length);
+  } while (rc != 0 && errno == EINTR);
+  if (rc == 0)
+    return 0;
+  if (errno != EOPNOTSUPP || keep_size)
+    return errno;
+#else
+  if (keep_size)
+    return EOPNOTSUPP;
+#endif
+  // posix_fallocate writes a byte per block where the filesystem cannot reserve space
+  rc = ::posix_fallocate(fd_, (off_t) offset, (off_t) length);
+  return rc;
+}
+int PosixFileHandler::punchHole(int64_t offset, int64_t length) {
+#if defined(__linux__)
+  int rc;
+  do {
+    rc = ::fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t) offset, (off_t) length);
+  } while (rc != 0 && errno == EINTR);
+  if (rc != 0)
+    return errno;
+  return 0;
+#else
+  (void) offset;
+  (void) length;
+  return EOPNOTSUPP;
+#endif
+}
+int PosixFileHandler::zeroRange(int64_t offset, int64_t length) {
+#if defined(__linux__)
+  int rc;
+  do {
+    rc = ::fallocate(fd_, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, (off_t) offset, (off_t) length);
+  } while (rc != 0 && errno == EINTR);
+  if (rc == 0)
+    return 0;
+  if (errno != EOPNOTSUPP)
+    return errno;
+  // no ZERO_RANGE (e.g. tmpfs): punch, then allocate the range again
+  if (punchHole(offset, length) == 0)
+    return allocate(offset, length, true);
+#endif
+  // write the zeros, but never past the end of the file
+  struct stat st;
+  if (::fstat(fd_, &st) != 0)
+    return errno;
+  int64_t end = std::min<int64_t>(offset + length, st.st_size);
+  std::vector<char> zeros((size_t) std::min<int64_t>(std::max<int64_t>(end - offset, 0), 65536));
+  while (offset < end) {
+    int64_t n = writeAt(zeros.data(), (size_t) std::min<int64_t>(end - offset, (int64_t) zeros.size()), offset);
+    if (n < 0)
+      return (int) -n;
+    offset += n;
+  }
+  return 0;
+}
+int PosixFileHandler::truncate(int64_t size) {
+  int rc;
+  do {
+    rc = ::ftruncate(fd_, (off_t) size);
+  } while (rc != 0 && errno == EINTR);
+  if (rc != 0)
+    return errno;
+  return 0;
+}
+int PosixFileHandler::nextExtent(int64_t offset, int64_t &data_offset, int64_t &data_length) {
+  struct stat st;
+  if (::fstat(fd_, &st) != 0)
+    return errno;
+  data_offset = offset;
+  data_length = 0;
+  if (offset >= (int64_t) st.st_size)
+    return 0;
+#ifdef SEEK_DATA
+  // SEEK_DATA/SEEK_HOLE move the file position, read()/write() users must not notice
+  off_t saved = ::lseek(fd_, 0, SEEK_CUR);
+  off_t data = ::lseek(fd_, (off_t) offset, SEEK_DATA);
+  int err = (data < 0) ? errno : 0;
+  off_t hole = (data < 0) ? -1 : ::lseek(fd_, data, SEEK_HOLE);
+  if (saved >= 0)
+    ::lseek(fd_, saved, SEEK_SET);
+  if (data < 0) {
+    if (err == ENXIO) {
+      // only a hole up to the end
+      data_offset = st.st_size;
+      return 0;
+    }
+    if (err != EINVAL && err != EOPNOTSUPP)
+      return err;
+  } else {
+    if (hole < 0 || (int64_t) hole > (int64_t) st.st_size)
+      hole = st.st_size;
+    data_offset = data;
+    data_length = (int64_t) hole - (int64_t) data;
+    return 0;
+  }
+#endif
+  data_length = (int64_t) st.st_size - offset;
+  return 0;
+}
+int PosixFileHandler::advise(int64_t offset, int64_t length, AccessPattern pattern) {
+#if defined(POSIX_FADV_NORMAL)
+  int advice;
+  switch (pattern) {
+    case ACCESS_NORMAL: advice = POSIX_FADV_NORMAL; break;
+    case ACCESS_SEQUENTIAL: advice = POSIX_FADV_SEQUENTIAL; break;
+    case ACCESS_RANDOM: advice = POSIX_FADV_RANDOM; break;
+    case ACCESS_WILLNEED: advice = POSIX_FADV_WILLNEED; break;
+    case ACCESS_DONTNEED: advice = POSIX_FADV_DONTNEED; break;
+    default: return EINVAL;
+  }
+  // returns the error instead of setting errno
+  return ::posix_fadvise(fd_, (off_t) offset, (off_t) length, advice);
+#else
+  if (pattern == ACCESS_WILLNEED)
+    return prefetch(offset, length);
+  if (pattern < ACCESS_NORMAL || pattern > ACCESS_DONTNEED)
+    return EINVAL;
+  return 0;
+#endif
+}
+int PosixFileHandler::prefetch(int64_t offset, int64_t length) {
+  if (offset < 0 || length < 0)
+    return EINVAL;
+#if defined(__linux__)
+  if (::readahead(fd_, (off64_t) offset, (size_t) length) == 0)
+    return 0;
+  if (errno != EINVAL)
+    return errno;
+  // not a regular file on a filesystem readahead() supports
+#endif
+#if defined(POSIX_FADV_WILLNEED)
+  return ::posix_fadvise(fd_, (off_t) offset, (off_t) length, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+  struct radvisory ra;
+  ra.ra_offset = (off_t) offset;
+  ra.ra_count = (int) std::min<int64_t>(length, INT_MAX);
+  if (::fcntl(fd_, F_RDADVISE, &ra) != 0)
+    return errno;
+  return 0;
+#else
+  return 0;
+#endif
+}
+void PosixFileHandler::applyOpenHints() {
+  cursor_ = 0;
+  last_read_end_ = -1;
+  run_reads_ = 0;
+  readahead_end_ = 0;
+  readahead_window_ = READAHEAD_MIN_WINDOW;
+  dropped_end_ = 0;
+  if (flags_ & HINT_SEQUENTIAL)
+    advise(0, 0, ACCESS_SEQUENTIAL);
+  else if (flags_ & HINT_RANDOM)
+    advise(0, 0, ACCESS_RANDOM);
+}
+void PosixFileHandler::onCursorRead(int64_t n) {
+  int64_t pos = cursor_;
+  cursor_ += n;
+
+  if (flags_ & ADAPTIVE_READAHEAD) {
+    if (pos != last_read_end_) {
+      // first read, or the cursor moved in between: a new run starts
+      run_reads_ = 0;
+      readahead_end_ = cursor_;
+      readahead_window_ = READAHEAD_MIN_WINDOW;
+    }
+    last_read_end_ = cursor_;
+    // start prefetching on the second read of a run, and again whenever
+    // half of the window has been consumed
+    if (++run_reads_ >= 2 && cursor_ + readahead_window_ / 2 >= readahead_end_) {
+      int64_t start = std::max(readahead_end_, cursor_);
+      if (prefetch(start, readahead_window_) == 0)
+        readahead_end_ = start + readahead_window_;
+      readahead_window_ = std::min(readahead_window_ * 2, READAHEAD_MAX_WINDOW);
+    }
+  }
+
+  if (flags_ & DROP_BEHIND) {
+    if (cursor_ < dropped_end_)
+      dropped_end_ = cursor_ - (cursor_ % DROP_BEHIND_CHUNK);
+    // whole chunks only, the chunk under the cursor may still be read again
+    int64_t end = cursor_ - (cursor_ % DROP_BEHIND_CHUNK);
+    if (end > dropped_end_) {
+      advise(dropped_end_, end - dropped_end_, ACCESS_DONTNEED);
+      dropped_end_ = end;
+    }
+  }
+}
+int PosixFileHandler::replaceTarget(const std::string &staged) {
+  if (flags_ & RENAME_IF_EXISTS) {
+    old_path_ = uniqueSiblingName(path_, "old");
+#if defined(__linux__) && defined(SYS_renameat2)
+    // swap in one step, the staged name then holds the previous file
+    if (::syscall(SYS_renameat2, AT_FDCWD, staged.c_str(), AT_FDCWD, path_.c_str(), RENAME_EXCHANGE) == 0) {
+      if (::rename(staged.c_str(), old_path_.c_str()) != 0)
+        return errno;
+      if (flags_ & REMOVE_IF_EXISTS)
+        ::unlink(old_path_.c_str());
+      return 0;
+    }
+    if (errno != ENOENT && errno != EINVAL && errno != ENOSYS)
+      return errno;
+#endif
+    if (::link(path_.c_str(), old_path_.c_str()) != 0) {
+      if (errno != ENOENT)
+        return errno;
+      old_path_.clear();
+    } else if (flags_ & REMOVE_IF_EXISTS) {
+      ::unlink(old_path_.c_str());
+    }
+  }
+  if (::rename(staged.c_str(), path_.c_str()) != 0)
+    return errno;
+  return 0;
+}
+
+int PosixFileHandler::commitReplace() {
+  int rc;
+  int fd = (fd_ >= 0) ? fd_ : pending_fd_;
+
+  if (!replace_pending_)
+    return 0;
+  if (fd < 0)
+    return EBADF;
+
+  if (!(flags_ & NO_SYNC_DATA)) {
+    do {
+      rc = ::fdatasync(fd);
+    } while (rc != 0 && errno == EINTR);
+    if (rc != 0)
+      return errno;
+  }
+
+  std::string staged = temp_path_;
+  bool published = false;
+  if (anonymous_) {
+    // linking fails with EEXIST when there is something to replace
+    rc = linkAnonymous(fd, path_);
+    if (rc == 0) {
+      published = true;
+      old_path_.clear();
+    } else if (rc != EEXIST) {
+      return rc;
+    } else {
+      do {
+        staged = uniqueSiblingName(path_, "new");
+        rc = linkAnonymous(fd, staged);
+      } while (rc == EEXIST);
+      if (rc)
+        return rc;
+    }
+  }
+
+  if (!published) {
+    rc = replaceTarget(staged);
+    if (rc) {
+      if (anonymous_)
+        ::unlink(staged.c_str());
+      return rc;
+    }
+  }
+
+  replace_pending_ = false;
+  temp_path_.clear();
+  if (pending_fd_ >= 0) {
+    ::close(pending_fd_);
+    pending_fd_ = -1;
+  }
+
+  if (!(flags_ & NO_SYNC_DIRECTORY))
+    return syncDirectory(parentDirectory(path_));
+  return 0;
+}
+
+void PosixFileHandler::discardReplace() {
+  if (pending_fd_ >= 0) {
+    ::close(pending_fd_);
+    pending_fd_ = -1;
+  }
+  if (replace_pending_ && !temp_path_.empty()) {
+    ::unlink(temp_path_.c_str());
+    temp_path_.clear();
+  }
+  replace_pending_ = false;
+  anonymous_ = false;
+}
+
+int PosixFileHandler::commit() {
+  int rc;
+
+  if (flags_ & ATOMIC_REPLACE)
+    return commitReplace();
+
+  if (!temp_path_.empty()) {
+    rc = removeOld();
+    if (rc)
+      return rc;
+
+    // Like MoveFileEx without MOVEFILE_REPLACE_EXISTING, never replace an existing file.
+    if (::link(temp_path_.c_str(), path_.c_str()) == 0) {
+      ::unlink(temp_path_.c_str());
+    } else {
+      if (errno == EEXIST)
+        return errno;
+      // Filesystems without hard links: check and rename instead.
+      struct stat st;
+      if (::lstat(path_.c_str(), &st) == 0)
+        return EEXIST;
+      if (::rename(temp_path_.c_str(), path_.c_str()) != 0)
+        return errno;
+    }
+    temp_path_.clear();
+  }
+
+  return 0;
+}
+int PosixFileHandler::close() {
+  if (fd_ >= 0) {
+    if (replace_pending_) {
+      // keep the temp file reachable for commit() after close()
+      pending_fd_ = fd_;
+    } else {
+      ::close(fd_);
+    }
+  }
+  fd_ = -1;
+  return 0;
+}
+bool PosixFileHandler::isOpen() const {
+  return fd_ >= 0;
+}
+Path PosixFileHandler::getOldName() const {
+  return Path::newFromSystem(old_path_);
+}
+bool PosixFileHandler::isDirect() const {
+  return direct_;
+}
+size_t PosixFileHandler::getAlignment() const {
+  return alignment_;
+}
+int64_t PosixFileHandler::getFileSize() const {
+  struct stat st;
+  if (::fstat(fd_, &st) == 0) {
+    return st.st_size;
+  }
+  return -((int) errno);
+}
+
+bool PosixFileFactory::isFile(const Path &path) const {
+  struct stat st;
+  if (::stat(path.getSystemString().c_str(), &st) != 0) {
+    return false;
+  }
+  return !(S_ISDIR(st.st_mode) || S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode));
+}
+
+bool PosixFileFactory::isDirectory(const Path &path) const {
+  struct stat st;
+  if (::stat(path.getSystemString().c_str(), &st) != 0) {
+    return false;
+  }
+  return S_ISDIR(st.st_mode);
+}
+
+bool PosixFileFactory::isDevice(const Path &path) const {
+  struct stat st;
+  if (::stat(path.getSystemString().c_str(), &st) != 0) {
+    return false;
+  }
+  return S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode);
+}
+
+int PosixFileFactory::readdir(std::list<Path> &out, const Path &path) const {
+  std::string str_dir = path.getSystemString();
+  size_t dir_len;
+  DirectoryIterator iter;
+  int rc;
+
+  if (str_dir.empty()) {
+    return -1;
+  }
+
+  rc = iter.open(path);
+  if (rc) {
+    return rc;
+  }
+
+  if (str_dir.at(str_dir.length() - 1) != '/') {
+    str_dir.append("/");
+  }
+  dir_len = str_dir.length();
+
+  for (const DirectoryEntry &entry : iter) {
+    str_dir.resize(dir_len);
+    str_dir.append(entry.name());
+    out.emplace_back(Path::newFromSystem(str_dir));
+  }
+
+  return iter.error();
+}
+
+int PosixFileFactory::readdir(PathTable &table, PathTable::Id dir) const {
+  std::string str_dir;
+  DirectoryIterator iter;
+  int rc;
+
+  table.appendPath(dir, str_dir);
+  if (str_dir.empty()) {
+    return -1;
+  }
+
+  rc = iter.open(Path::newFromSystem(std::move(str_dir)));
+  if (rc) {
+    return rc;
+  }
+
+  for (const DirectoryEntry &entry : iter) {
+    if (table.add(dir, entry.name()) == PathTable::NO_ID) {
+      return ENAMETOOLONG;
+    }
+  }
+
+  return iter.error();
+}
+
+int64_t PosixFileFactory::getFileSize(const Path& path) const {
+  struct stat st;
+  if (::stat(path.getSystemString().c_str(), &st) == 0) {
+    return st.st_size;
+  }
+  return -((int) errno);
+}
+
+int PosixFileFactory::stat(const Path &path, FileInfo &info, bool follow_symlinks) const {
+  return statAt(AT_FDCWD, path.getSystemString().c_str(), info, follow_symlinks);
+}
+
+int PosixFileFactory::copyFile(const Path &src, const Path &dst, int flags) const {
+  return posix::copyFile(src, dst, flags);
+}
+
+int PosixFileFactory::moveFile(const Path &src, const Path &dst, int flags) const {
+  return posix::moveFile(src, dst, flags);
+}
+}
+
+FileFactory *fs() {
+  static std::unique_ptr<posix::PosixFileFactory> file_factory(new posix::PosixFileFactory());
+  return file_factory.get();
+}
+
+}
+}
+#endif
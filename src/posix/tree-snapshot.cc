@@ -0,0 +1,568 @@
+/**
+ * @file	tree-snapshot.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/tree-snapshot.h"
+
+#ifndef _WIN32
+#include "jcu-file/directory-iterator.h"
+#include "jcu-file/file-factory.h"
+#include "jcu-file/posix/posix-file-handler.h"
+#include "../parallel-for.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+namespace jcu {
+namespace file {
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'J', 'C', 'U', 'S', 'N', 'A', 'P', '1'};
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+// FAT keeps mtimes in 2 second steps; a directory changed this close to
+// the previous scan may have changed again without a new mtime
+const int64_t RACY_WINDOW_NS = 2000000000LL;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t entry_size;
+  uint64_t entry_count;
+  uint64_t name_size;
+  int64_t scan_time_ns;
+};
+
+struct Child {
+  // into Listing::names, each name is followed by a NUL
+  uint32_t name_offset;
+  uint32_t name_length;
+  FileType type;
+  int64_t size;
+  int64_t mtime_ns;
+  uint64_t inode;
+  // the same entry in the previous snapshot
+  uint32_t previous;
+};
+
+struct Listing {
+  std::string names;
+  std::vector<Child> children;
+
+  std::string_view name(const Child &child) const {
+    return std::string_view(names.data() + child.name_offset, child.name_length);
+  }
+
+  Child &add(std::string_view name) {
+    children.emplace_back();
+    Child &child = children.back();
+    child.name_offset = (uint32_t) names.size();
+    child.name_length = (uint32_t) name.size();
+    child.previous = TreeSnapshot::NO_ENTRY;
+    names.append(name.data(), name.size());
+    names.push_back('\0');
+    return child;
+  }
+};
+
+struct DirTask {
+  std::string path;
+  uint32_t index;
+  uint32_t previous;
+};
+
+void setInfo(Child &child, const FileInfo &info) {
+  child.type = info.type;
+  child.size = info.size;
+  child.mtime_ns = info.mtime_ns;
+  child.inode = info.inode;
+}
+
+bool isFatal(int err) {
+  // running out of descriptors or memory would leave holes in the snapshot
+  return err == EMFILE || err == ENFILE || err == ENOMEM;
+}
+
+// Take the entries of an unchanged directory from the previous snapshot
+int reuseListing(int fd, const TreeSnapshot &previous, uint32_t dir, const TreeSnapshotOptions &options, Listing &out) {
+  const TreeSnapshot::Entry &old_dir = previous.entry(dir);
+  FileInfo info;
+  for (uint32_t i = old_dir.first_child; i < old_dir.first_child + old_dir.child_count; i++) {
+    const TreeSnapshot::Entry &old = previous.entry(i);
+    Child &child = out.add(previous.name(i));
+    child.previous = i;
+    if (old.type == FILE_TYPE_DIRECTORY || options.stat_unchanged) {
+      // directories always, their own mtime decides about their entries
+      int rc = posix::statAt(fd, out.names.data() + child.name_offset, info, false);
+      if (rc)
+        return rc;
+      setInfo(child, info);
+    } else {
+      child.type = (FileType) old.type;
+      child.size = old.size;
+      child.mtime_ns = old.mtime_ns;
+      child.inode = old.inode;
+    }
+  }
+  return 0;
+}
+
+int readListing(int fd, const TreeSnapshot *previous, uint32_t dir, Listing &out) {
+  int iter_fd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (iter_fd < 0)
+    return errno;
+  DirectoryIterator iter;
+  int rc = iter.openFd(iter_fd);
+  if (rc)
+    return rc;
+
+  FileInfo info;
+  for (const DirectoryEntry &entry : iter) {
+    rc = posix::statAt(fd, entry.c_name(), info, false);
+    if (rc == ENOENT)
+      continue;
+    Child &child = out.add(entry.name());
+    if (rc) {
+      info = FileInfo();
+      info.type = entry.type();
+      info.inode = entry.inode();
+    }
+    setInfo(child, info);
+  }
+  if (iter.error())
+    return iter.error();
+
+  const Listing &listing = out;
+  std::sort(out.children.begin(), out.children.end(), [&listing](const Child &a, const Child &b) {
+    return listing.name(a) < listing.name(b);
+  });
+  if (previous && dir != TreeSnapshot::NO_ENTRY) {
+    for (Child &child : out.children) {
+      if (child.type == FILE_TYPE_DIRECTORY)
+        child.previous = previous->findChild(dir, out.name(child));
+    }
+  }
+  return 0;
+}
+
+int listDirectory(const DirTask &task, const TreeSnapshot::Entry &self, const TreeSnapshot *previous,
+                  const TreeSnapshotOptions &options, Listing &out, bool &listed) {
+  int fd;
+  do {
+    // below the root only the directory that was stat'ed is listed
+    fd = ::open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | (task.index ? O_NOFOLLOW : 0));
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return errno;
+
+  int rc = -1;
+  if (previous && task.previous != TreeSnapshot::NO_ENTRY) {
+    const TreeSnapshot::Entry &old = previous->entry(task.previous);
+    if (old.type == FILE_TYPE_DIRECTORY && old.inode == self.inode && old.mtime_ns == self.mtime_ns &&
+        old.mtime_ns < previous->scanTime() - RACY_WINDOW_NS) {
+      rc = reuseListing(fd, *previous, task.previous, options, out);
+    }
+  }
+  if (rc != 0) {
+    // changed, new, or an entry vanished while it was being reused
+    out.names.clear();
+    out.children.clear();
+    rc = readListing(fd, previous, task.previous, out);
+    listed = true;
+  }
+  ::close(fd);
+  return rc;
+}
+
+void reportSubtree(const TreeSnapshot &snapshot, uint32_t index, SnapshotChange change, std::vector<SnapshotDiff> &out) {
+  const TreeSnapshot::Entry &entry = snapshot.entry(index);
+  out.push_back(SnapshotDiff{change, snapshot.relativePath(index), (FileType) entry.type});
+  for (uint32_t i = entry.first_child; i < entry.first_child + entry.child_count; i++)
+    reportSubtree(snapshot, i, change, out);
+}
+
+void diffChildren(const TreeSnapshot &before, uint32_t before_dir, const TreeSnapshot &after, uint32_t after_dir,
+                  std::vector<SnapshotDiff> &out) {
+  const TreeSnapshot::Entry &bdir = before.entry(before_dir);
+  const TreeSnapshot::Entry &adir = after.entry(after_dir);
+  uint32_t i = bdir.first_child, i_end = bdir.first_child + bdir.child_count;
+  uint32_t j = adir.first_child, j_end = adir.first_child + adir.child_count;
+
+  // both lists are sorted by name
+  while (i < i_end || j < j_end) {
+    int cmp;
+    if (i == i_end)
+      cmp = 1;
+    else if (j == j_end)
+      cmp = -1;
+    else
+      cmp = before.name(i).compare(after.name(j));
+
+    if (cmp < 0) {
+      reportSubtree(before, i++, SNAPSHOT_REMOVED, out);
+    } else if (cmp > 0) {
+      reportSubtree(after, j++, SNAPSHOT_ADDED, out);
+    } else {
+      const TreeSnapshot::Entry &b = before.entry(i);
+      const TreeSnapshot::Entry &a = after.entry(j);
+      if (a.type != b.type) {
+        reportSubtree(before, i, SNAPSHOT_REMOVED, out);
+        reportSubtree(after, j, SNAPSHOT_ADDED, out);
+      } else if (a.type == FILE_TYPE_DIRECTORY) {
+        diffChildren(before, i, after, j, out);
+      } else if (a.size != b.size || a.mtime_ns != b.mtime_ns || a.inode != b.inode) {
+        out.push_back(SnapshotDiff{SNAPSHOT_MODIFIED, after.relativePath(j), (FileType) a.type});
+      }
+      i++;
+      j++;
+    }
+  }
+}
+
+int writeAll(FileHandler &handler, const void *data, size_t size, int64_t &offset) {
+  const char *p = (const char *) data;
+  while (size > 0) {
+    int64_t n = handler.writeAt(p, size, offset);
+    if (n < 0)
+      return (int) -n;
+    if (n == 0)
+      return EIO;
+    p += n;
+    size -= (size_t) n;
+    offset += n;
+  }
+  return 0;
+}
+
+}
+
+const uint32_t TreeSnapshot::NO_ENTRY;
+
+TreeSnapshot::TreeSnapshot()
+    : entry_data_(NULL), entry_count_(0), name_data_(NULL), name_size_(0), scan_time_ns_(0), listed_directories_(0) {
+}
+
+TreeSnapshot::TreeSnapshot(TreeSnapshot &&obj)
+    : entries_(std::move(obj.entries_)),
+      names_(std::move(obj.names_)),
+      region_(std::move(obj.region_)),
+      entry_data_(obj.entry_data_),
+      entry_count_(obj.entry_count_),
+      name_data_(obj.name_data_),
+      name_size_(obj.name_size_),
+      scan_time_ns_(obj.scan_time_ns_),
+      listed_directories_(obj.listed_directories_) {
+  // short names may have lived inside the moved string
+  if (!region_.isMapped())
+    useOwned();
+  obj.clear();
+}
+
+TreeSnapshot &TreeSnapshot::operator=(TreeSnapshot &&obj) {
+  if (this != &obj) {
+    entries_ = std::move(obj.entries_);
+    names_ = std::move(obj.names_);
+    region_ = std::move(obj.region_);
+    entry_data_ = obj.entry_data_;
+    entry_count_ = obj.entry_count_;
+    name_data_ = obj.name_data_;
+    name_size_ = obj.name_size_;
+    scan_time_ns_ = obj.scan_time_ns_;
+    listed_directories_ = obj.listed_directories_;
+    if (!region_.isMapped())
+      useOwned();
+    obj.clear();
+  }
+  return *this;
+}
+
+void TreeSnapshot::useOwned() {
+  entry_data_ = entries_.data();
+  entry_count_ = entries_.size();
+  name_data_ = names_.data();
+  name_size_ = names_.size();
+}
+
+void TreeSnapshot::clear() {
+  std::vector<Entry>().swap(entries_);
+  std::string().swap(names_);
+  region_.unmap();
+  useOwned();
+  scan_time_ns_ = 0;
+  listed_directories_ = 0;
+}
+
+int TreeSnapshot::scan(const Path &root, const TreeSnapshotOptions &options) {
+  return build(root, NULL, options);
+}
+
+int TreeSnapshot::rescan(const TreeSnapshot &previous, const TreeSnapshotOptions &options) {
+  if (previous.size() == 0)
+    return EINVAL;
+  return build(previous.root(), &previous, options);
+}
+
+int TreeSnapshot::build(const Path &root, const TreeSnapshot *previous, const TreeSnapshotOptions &options) {
+  int64_t scan_time = (int64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+  const std::string &root_path = root.getSystemString();
+  FileInfo info;
+  int rc = posix::statAt(AT_FDCWD, root_path.c_str(), info, true);
+  if (rc)
+    return rc;
+  if (!info.isDirectory())
+    return ENOTDIR;
+  if (root_path.size() > 0xffffffffu)
+    return ENAMETOOLONG;
+
+  std::vector<Entry> entries;
+  std::string names(root_path);
+  Entry root_entry = {info.inode, info.size, info.mtime_ns, NO_ENTRY, 0, (uint32_t) root_path.size(),
+                      (uint32_t) info.type, 0, 0};
+  entries.push_back(root_entry);
+
+  // one level of the tree at a time, so each directory's children can be
+  // appended next to each other
+  std::vector<DirTask> level(1, DirTask{root_path, 0, previous ? 0 : NO_ENTRY});
+  std::vector<DirTask> next_level;
+  std::vector<Listing> listings;
+  std::atomic<size_t> listed(0);
+  while (!level.empty()) {
+    listings.clear();
+    listings.resize(level.size());
+
+    rc = parallelFor(level.size(), options.threads, [&](size_t i) {
+      bool was_listed = false;
+      int list_rc = listDirectory(level[i], entries[level[i].index], previous, options, listings[i], was_listed);
+      if (was_listed)
+        listed++;
+      if (list_rc && (level[i].index == 0 || isFatal(list_rc)))
+        return list_rc;
+      if (list_rc) {
+        // unreadable or gone; keep it as an empty directory
+        listings[i].children.clear();
+      }
+      return 0;
+    });
+    if (rc)
+      return rc;
+
+    next_level.clear();
+    for (size_t i = 0; i < level.size(); i++) {
+      const Listing &listing = listings[i];
+      if (entries.size() + listing.children.size() >= NO_ENTRY)
+        return EOVERFLOW;
+      Entry &dir = entries[level[i].index];
+      dir.first_child = (uint32_t) entries.size();
+      dir.child_count = (uint32_t) listing.children.size();
+      for (const Child &child : listing.children) {
+        std::string_view name = listing.name(child);
+        if (names.size() + name.size() > 0xffffffffu)
+          return EOVERFLOW;
+        Entry entry = {child.inode, child.size, child.mtime_ns, level[i].index, (uint32_t) names.size(),
+                       (uint32_t) name.size(), (uint32_t) child.type, 0, 0};
+        names.append(name.data(), name.size());
+        if (child.type == FILE_TYPE_DIRECTORY) {
+          std::string path(level[i].path);
+          if (path.empty() || path.back() != '/')
+            path.push_back('/');
+          path.append(name.data(), name.size());
+          next_level.push_back(DirTask{std::move(path), (uint32_t) entries.size(), child.previous});
+        }
+        entries.push_back(entry);
+      }
+    }
+    level.swap(next_level);
+  }
+
+  // previous may be this snapshot, so it is only replaced now
+  entries_.swap(entries);
+  names_.swap(names);
+  region_.unmap();
+  useOwned();
+  scan_time_ns_ = scan_time;
+  listed_directories_ = listed.load();
+  return 0;
+}
+
+int TreeSnapshot::save(const Path &path) const {
+  if (entry_count_ == 0)
+    return EINVAL;
+
+  std::unique_ptr<FileHandler> handler(fs()->createFileHandle(path));
+  int rc = handler->open(MODE_WRITE | ATOMIC_REPLACE);
+  if (rc)
+    return rc;
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.byte_order = SNAPSHOT_BYTE_ORDER;
+  header.entry_size = sizeof(Entry);
+  header.entry_count = entry_count_;
+  header.name_size = name_size_;
+  header.scan_time_ns = scan_time_ns_;
+
+  int64_t offset = 0;
+  rc = writeAll(*handler, &header, sizeof(header), offset);
+  if (!rc)
+    rc = writeAll(*handler, entry_data_, entry_count_ * sizeof(Entry), offset);
+  if (!rc)
+    rc = writeAll(*handler, name_data_, name_size_, offset);
+  if (!rc)
+    rc = handler->commit();
+  handler->close();
+  return rc;
+}
+
+int TreeSnapshot::load(const Path &path) {
+  MappedRegion region;
+  int rc = region.map(path, MAP_MODE_READ_ONLY);
+  if (rc)
+    return rc;
+
+  const char *data = (const char *) region.data();
+  size_t size = region.size();
+  FileHeader header;
+  if (size < sizeof(header))
+    return EINVAL;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.byte_order != SNAPSHOT_BYTE_ORDER || header.entry_size != sizeof(Entry) ||
+      header.entry_count == 0 || header.entry_count >= NO_ENTRY || header.name_size > 0xffffffffu ||
+      size - sizeof(header) != header.entry_count * sizeof(Entry) + header.name_size)
+    return EINVAL;
+
+  // check every link once so the accessors and diff() can trust them
+  const Entry *entries = (const Entry *) (data + sizeof(header));
+  size_t count = (size_t) header.entry_count;
+  for (size_t i = 0; i < count; i++) {
+    const Entry &entry = entries[i];
+    if ((uint64_t) entry.name_offset + entry.name_length > header.name_size)
+      return EINVAL;
+    if ((i == 0) ? (entry.parent != NO_ENTRY) : (entry.parent >= i))
+      return EINVAL;
+    if (entry.child_count) {
+      if (entry.first_child <= i || (uint64_t) entry.first_child + entry.child_count > count)
+        return EINVAL;
+      for (uint32_t c = entry.first_child; c < entry.first_child + entry.child_count; c++) {
+        if (entries[c].parent != i)
+          return EINVAL;
+      }
+    }
+  }
+
+  clear();
+  region_ = std::move(region);
+  entry_data_ = entries;
+  entry_count_ = count;
+  name_data_ = data + sizeof(header) + count * sizeof(Entry);
+  name_size_ = (size_t) header.name_size;
+  scan_time_ns_ = header.scan_time_ns;
+  return 0;
+}
+
+Path TreeSnapshot::root() const {
+  if (entry_count_ == 0)
+    return Path();
+  std::string_view root_name = name(0);
+  return Path::newFromSystem(std::string(root_name.data(), root_name.size()));
+}
+
+int64_t TreeSnapshot::scanTime() const {
+  return scan_time_ns_;
+}
+
+size_t TreeSnapshot::listedDirectories() const {
+  return listed_directories_;
+}
+
+size_t TreeSnapshot::size() const {
+  return entry_count_;
+}
+
+const TreeSnapshot::Entry &TreeSnapshot::entry(uint32_t index) const {
+  return entry_data_[index];
+}
+
+std::string_view TreeSnapshot::name(uint32_t index) const {
+  const Entry &e = entry_data_[index];
+  return std::string_view(name_data_ + e.name_offset, e.name_length);
+}
+
+Path TreeSnapshot::relativePath(uint32_t index) const {
+  std::vector<uint32_t> chain;
+  for (uint32_t i = index; i != 0 && i != NO_ENTRY; i = entry_data_[i].parent)
+    chain.push_back(i);
+  std::string path;
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    if (!path.empty())
+      path.push_back('/');
+    std::string_view part = name(*it);
+    path.append(part.data(), part.size());
+  }
+  return Path::newFromSystem(std::move(path));
+}
+
+uint32_t TreeSnapshot::find(const Path &relative) const {
+  if (entry_count_ == 0)
+    return NO_ENTRY;
+  const std::string &path = relative.getSystemString();
+  uint32_t index = 0;
+  size_t pos = 0;
+  while (pos < path.size() && index != NO_ENTRY) {
+    size_t end = path.find('/', pos);
+    if (end == std::string::npos)
+      end = path.size();
+    if (end > pos)
+      index = findChild(index, std::string_view(path.data() + pos, end - pos));
+    pos = end + 1;
+  }
+  return index;
+}
+
+uint32_t TreeSnapshot::findChild(uint32_t directory, std::string_view child_name) const {
+  const Entry &dir = entry_data_[directory];
+  uint32_t lo = dir.first_child;
+  uint32_t hi = dir.first_child + dir.child_count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    int cmp = name(mid).compare(child_name);
+    if (cmp == 0)
+      return mid;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return NO_ENTRY;
+}
+
+void TreeSnapshot::diff(const TreeSnapshot &before, const TreeSnapshot &after, std::vector<SnapshotDiff> &out) {
+  if (before.size() == 0 || after.size() == 0) {
+    const TreeSnapshot &side = (before.size() == 0) ? after : before;
+    if (side.size() == 0)
+      return;
+    const Entry &root = side.entry(0);
+    for (uint32_t i = root.first_child; i < root.first_child + root.child_count; i++)
+      reportSubtree(side, i, (before.size() == 0) ? SNAPSHOT_ADDED : SNAPSHOT_REMOVED, out);
+    return;
+  }
+  diffChildren(before, 0, after, 0, out);
+}
+
+}
+}
+#endif
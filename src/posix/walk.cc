@@ -0,0 +1,393 @@
+/**
+ * @file	walk.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/walk.h"
+
+#ifndef _WIN32
+#include "jcu-file/directory-iterator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace jcu {
+namespace file {
+
+namespace {
+
+FileType fromStatMode(mode_t mode) {
+  if (S_ISREG(mode)) return FILE_TYPE_REGULAR;
+  if (S_ISDIR(mode)) return FILE_TYPE_DIRECTORY;
+  if (S_ISLNK(mode)) return FILE_TYPE_SYMLINK;
+  if (S_ISBLK(mode)) return FILE_TYPE_BLOCK_DEVICE;
+  if (S_ISCHR(mode)) return FILE_TYPE_CHAR_DEVICE;
+  if (S_ISFIFO(mode)) return FILE_TYPE_FIFO;
+  if (S_ISSOCK(mode)) return FILE_TYPE_SOCKET;
+  return FILE_TYPE_UNKNOWN;
+}
+
+// Listing of one directory, kept for the ordered mode
+struct DirNode {
+  struct Child {
+    std::string name;
+    FileType type;
+    uint64_t inode;
+    std::unique_ptr<DirNode> dir;
+  };
+  std::vector<Child> children;
+};
+
+struct DirTask {
+  std::string path;
+  int depth;
+  DirNode *node;
+  PathTable::Id table_id;
+};
+
+// Names of one directory, added to the table under a single lock
+struct TableBatch {
+  std::string names;
+  std::vector<std::pair<size_t, bool>> entries;
+};
+
+class Walker {
+ private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<DirTask> tasks;
+  };
+
+  const WalkVisitor &visitor_;
+  const WalkOptions &options_;
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::atomic<int64_t> pending_;
+  // tasks sitting in the queues, what idle workers wait on
+  std::atomic<int64_t> queued_;
+  std::atomic<int> idle_;
+  std::atomic<bool> stop_;
+  std::atomic<int> first_error_;
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+  std::mutex visited_mutex_;
+  std::set<std::pair<uint64_t, uint64_t>> visited_;
+  PathTable *table_;
+  std::mutex table_mutex_;
+
+  void setError(int err) {
+    int expected = 0;
+    first_error_.compare_exchange_strong(expected, err);
+  }
+
+  void push(size_t worker, DirTask &&task) {
+    pending_++;
+    {
+      std::unique_lock<std::mutex> lock(queues_[worker]->mutex);
+      queues_[worker]->tasks.emplace_back(std::move(task));
+      queued_++;
+    }
+    // an idle worker bumps idle_ before checking queued_, so one of the two sees the other
+    if (idle_.load() > 0)
+      wakeIdle(false);
+  }
+
+  void wakeIdle(bool all) {
+    {
+      // a waiter holds the mutex from its check to its wait, so taking it here loses no wakeup
+      std::unique_lock<std::mutex> lock(idle_mutex_);
+    }
+    if (all)
+      idle_cv_.notify_all();
+    else
+      idle_cv_.notify_one();
+  }
+
+  bool pop(size_t worker, DirTask &task) {
+    {
+      // own queue: newest first, stays depth-first and cache warm
+      WorkerQueue &own = *queues_[worker];
+      std::unique_lock<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty()) {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        queued_--;
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues_.size(); i++) {
+      // steal the oldest task, which is the biggest subtree
+      WorkerQueue &victim = *queues_[(worker + i) % queues_.size()];
+      std::unique_lock<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        queued_--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool markVisited(const struct stat &st) {
+    std::unique_lock<std::mutex> lock(visited_mutex_);
+    return visited_.emplace((uint64_t) st.st_dev, (uint64_t) st.st_ino).second;
+  }
+
+  bool shouldDescend(const WalkEntry &entry) {
+    if (options_.max_depth >= 0 && entry.depth >= options_.max_depth)
+      return false;
+    if (options_.directory_filter && !options_.directory_filter(entry))
+      return false;
+    return true;
+  }
+
+  void flushTableBatch(size_t worker, DirTask &task, TableBatch &batch, std::string &path_buf, size_t dir_len) {
+    std::vector<std::pair<size_t, PathTable::Id>> subdirs;
+    {
+      std::unique_lock<std::mutex> lock(table_mutex_);
+      for (size_t i = 0; i < batch.entries.size(); i++) {
+        size_t begin = batch.entries[i].first;
+        size_t end = (i + 1 < batch.entries.size()) ? batch.entries[i + 1].first : batch.names.length();
+        PathTable::Id id = table_->add(task.table_id, std::string_view(batch.names).substr(begin, end - begin));
+        if (id == PathTable::NO_ID) {
+          setError(ENAMETOOLONG);
+          continue;
+        }
+        if (batch.entries[i].second)
+          subdirs.emplace_back(i, id);
+      }
+    }
+    for (auto &subdir : subdirs) {
+      size_t begin = batch.entries[subdir.first].first;
+      size_t end = (subdir.first + 1 < batch.entries.size()) ? batch.entries[subdir.first + 1].first : batch.names.length();
+      path_buf.resize(dir_len);
+      path_buf.append(batch.names, begin, end - begin);
+      push(worker, DirTask{path_buf, task.depth + 1, NULL, subdir.second});
+    }
+    batch.names.clear();
+    batch.entries.clear();
+  }
+
+  void processDirectory(size_t worker, DirTask &task, DirectoryIterator &iter, std::string &path_buf, TableBatch &batch) {
+    int rc = iter.open(Path::newFromSystem(task.path));
+    if (rc) {
+      setError(rc);
+      return;
+    }
+
+    path_buf = task.path;
+    if (path_buf.empty() || path_buf[path_buf.length() - 1] != '/')
+      path_buf.push_back('/');
+    size_t dir_len = path_buf.length();
+
+    for (const DirectoryEntry &dir_entry : iter) {
+      if (stop_.load(std::memory_order_relaxed))
+        break;
+
+      path_buf.resize(dir_len);
+      path_buf.append(dir_entry.name());
+
+      WalkEntry entry;
+      entry.path = path_buf;
+      entry.name = std::string_view(path_buf).substr(dir_len);
+      entry.type = dir_entry.type();
+      entry.inode = dir_entry.inode();
+      entry.depth = task.depth + 1;
+
+      struct stat st;
+      bool have_stat = false;
+      if (entry.type == FILE_TYPE_UNKNOWN
+          || (entry.type == FILE_TYPE_SYMLINK && options_.symlinks == SYMLINK_FOLLOW)) {
+        int stat_flags = (options_.symlinks == SYMLINK_FOLLOW) ? 0 : AT_SYMLINK_NOFOLLOW;
+        if (::fstatat(AT_FDCWD, path_buf.c_str(), &st, stat_flags) == 0) {
+          entry.type = fromStatMode(st.st_mode);
+          have_stat = true;
+        }
+      }
+
+      bool descend = false;
+      if (entry.type == FILE_TYPE_DIRECTORY && shouldDescend(entry)) {
+        descend = true;
+        if (options_.symlinks == SYMLINK_FOLLOW) {
+          if (!have_stat && ::stat(path_buf.c_str(), &st) != 0)
+            descend = false;
+          else if (!markVisited(st))
+            descend = false;
+        }
+      }
+
+      if (table_) {
+        batch.entries.emplace_back(batch.names.length(), descend);
+        batch.names.append(entry.name);
+      } else if (task.node) {
+        task.node->children.emplace_back();
+        DirNode::Child &child = task.node->children.back();
+        child.name.assign(entry.name.data(), entry.name.length());
+        child.type = entry.type;
+        child.inode = entry.inode;
+        if (descend)
+          child.dir.reset(new DirNode());
+      } else {
+        if (!visitor_(entry)) {
+          stop_ = true;
+          break;
+        }
+        if (descend) {
+          push(worker, DirTask{std::string(entry.path), entry.depth, NULL, PathTable::NO_ID});
+        }
+      }
+    }
+    if (iter.error())
+      setError(iter.error());
+
+    if (table_)
+      flushTableBatch(worker, task, batch, path_buf, dir_len);
+
+    if (task.node) {
+      std::sort(task.node->children.begin(), task.node->children.end(), [](const DirNode::Child &a, const DirNode::Child &b) {
+        return a.name < b.name;
+      });
+      for (auto &child : task.node->children) {
+        if (child.dir) {
+          path_buf.resize(dir_len);
+          path_buf.append(child.name);
+          push(worker, DirTask{path_buf, task.depth + 1, child.dir.get(), PathTable::NO_ID});
+        }
+      }
+    }
+    iter.close();
+  }
+
+  void workerMain(size_t worker) {
+    DirectoryIterator iter;
+    std::string path_buf;
+    TableBatch batch;
+    DirTask task;
+    for (;;) {
+      if (pop(worker, task)) {
+        if (!stop_.load(std::memory_order_relaxed))
+          processDirectory(worker, task, iter, path_buf, batch);
+        if (--pending_ == 0)
+          wakeIdle(true);
+        continue;
+      }
+      if (pending_.load() == 0)
+        break;
+      idle_++;
+      {
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_cv_.wait(lock, [this]() { return queued_.load() > 0 || pending_.load() == 0; });
+      }
+      idle_--;
+    }
+  }
+
+  bool emit(DirNode &node, std::string &path_buf, int depth) {
+    if (path_buf.empty() || path_buf[path_buf.length() - 1] != '/')
+      path_buf.push_back('/');
+    size_t dir_len = path_buf.length();
+    for (auto &child : node.children) {
+      path_buf.resize(dir_len);
+      path_buf.append(child.name);
+      WalkEntry entry;
+      entry.path = path_buf;
+      entry.name = std::string_view(path_buf).substr(dir_len);
+      entry.type = child.type;
+      entry.inode = child.inode;
+      entry.depth = depth;
+      if (!visitor_(entry))
+        return false;
+      if (child.dir && !emit(*child.dir, path_buf, depth + 1))
+        return false;
+    }
+    return true;
+  }
+
+ public:
+  Walker(const WalkVisitor &visitor, const WalkOptions &options, PathTable *table = NULL)
+      : visitor_(visitor), options_(options), pending_(0), queued_(0), idle_(0), stop_(false), first_error_(0), table_(table) {
+  }
+
+  int run(const Path &root, PathTable::Id *root_id = NULL) {
+    struct stat st;
+    if (::stat(root.getSystemString().c_str(), &st) != 0)
+      return errno;
+    if (!S_ISDIR(st.st_mode))
+      return ENOTDIR;
+    if (options_.symlinks == SYMLINK_FOLLOW)
+      markVisited(st);
+
+    int threads = options_.threads;
+    if (threads <= 0)
+      threads = (int) std::thread::hardware_concurrency();
+    if (threads <= 0)
+      threads = 1;
+    for (int i = 0; i < threads; i++) {
+      queues_.emplace_back(new WorkerQueue());
+    }
+
+    PathTable::Id table_root = PathTable::NO_ID;
+    if (table_) {
+      table_root = table_->add(root);
+      if (table_root == PathTable::NO_ID)
+        return ENAMETOOLONG;
+      if (root_id)
+        *root_id = table_root;
+    }
+
+    std::unique_ptr<DirNode> root_node;
+    if (options_.ordered && !table_)
+      root_node.reset(new DirNode());
+    // the root's children are at depth 1, so max_depth 0 lists nothing
+    if (options_.max_depth != 0)
+      push(0, DirTask{root.getSystemString(), 0, root_node.get(), table_root});
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; i++) {
+      workers.emplace_back(&Walker::workerMain, this, (size_t) i);
+    }
+    workerMain(0);
+    for (auto &worker : workers) {
+      worker.join();
+    }
+
+    if (root_node) {
+      std::string path_buf(root.getSystemString());
+      emit(*root_node, path_buf, 1);
+    }
+
+    return first_error_.load();
+  }
+};
+
+}
+
+int walk(const Path &root, const WalkVisitor &visitor, const WalkOptions &options) {
+  Walker walker(visitor, options);
+  return walker.run(root);
+}
+
+int walk(const Path &root, PathTable &table, const WalkOptions &options, PathTable::Id *root_id) {
+  WalkVisitor visitor;
+  Walker walker(visitor, options, &table);
+  return walker.run(root, root_id);
+}
+
+}
+}
+#endif
@@ -0,0 +1,365 @@
+/**
+ * @file	temp-file-service.cc
+ * @author	Joseph Lee <development@jc-lab.net>
+ * @date	2019/11/12
+ * @copyright Copyright (C) 2019 jc-lab. All rights reserved.
+ */
+
+#include "jcu-file/temp-file-service.h"
+
+#include <jcu-random/secure-random-factory.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <mutex>
+#include <string>
+
+#ifdef _WIN32
+#include "jcu-file/win32/win-file-handler.h"
+#else
+#include "jcu-file/posix/posix-file-handler.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace jcu {
+namespace file {
+
+namespace {
+
+// attempts before giving up on finding a free name
+const int MAX_ATTEMPTS = 16;
+
+inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+/**
+ * Per-thread name source: a random seed drawn once per thread and a
+ * counter. mix64 is a bijection, so one thread never repeats a name.
+ */
+struct NameGenerator {
+  bool seeded;
+  uint64_t seed;
+  uint64_t counter;
+};
+
+uint64_t nextNameValue() {
+  thread_local NameGenerator generator = {false, 0, 0};
+  if (!generator.seeded) {
+    static std::mutex seed_mutex;
+    static std::unique_ptr<jcu::random::SecureRandom> secure_random;
+    std::lock_guard<std::mutex> lock(seed_mutex);
+    if (!secure_random)
+      secure_random = jcu::random::getSecureRandomFactory()->create();
+    generator.seed = (((uint64_t) (uint32_t) secure_random->nextInt()) << 32) | (uint32_t) secure_random->nextInt();
+    generator.seeded = true;
+  }
+  return mix64(generator.seed + (++generator.counter) * 0x9e3779b97f4a7c15ULL);
+}
+
+bool isExistsError(int err) {
+#ifdef _WIN32
+  return err == ERROR_FILE_EXISTS || err == ERROR_ALREADY_EXISTS;
+#else
+  return err == EEXIST;
+#endif
+}
+
+int removeFile(const Path &path) {
+#ifdef _WIN32
+  if (!::DeleteFile(path.getSystemString().c_str()))
+    return ::GetLastError();
+#else
+  if (::unlink(path.getSystemString().c_str()) != 0)
+    return errno;
+#endif
+  return 0;
+}
+
+#ifdef _WIN32
+int removeTree(const std::basic_string<TCHAR> &path) {
+  int rc = 0;
+  WIN32_FIND_DATA find_data;
+  std::basic_string<TCHAR> pattern = path + _T("\\*");
+  HANDLE find = ::FindFirstFile(pattern.c_str(), &find_data);
+  if (find != INVALID_HANDLE_VALUE) {
+    do {
+      std::basic_string<TCHAR> name(find_data.cFileName);
+      if (name == _T(".") || name == _T(".."))
+        continue;
+      std::basic_string<TCHAR> child = path + _T("\\") + name;
+      int child_rc = 0;
+      // do not follow junctions out of the tree
+      if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && !(find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+        child_rc = removeTree(child);
+      } else if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        if (!::RemoveDirectory(child.c_str()))
+          child_rc = ::GetLastError();
+      } else if (!::DeleteFile(child.c_str())) {
+        child_rc = ::GetLastError();
+      }
+      if (child_rc && !rc)
+        rc = child_rc;
+    } while (::FindNextFile(find, &find_data));
+    ::FindClose(find);
+  }
+  if (!::RemoveDirectory(path.c_str()) && !rc)
+    rc = ::GetLastError();
+  return rc;
+}
+#else
+int removeTreeAt(int dir_fd, const char *name) {
+  if (::unlinkat(dir_fd, name, 0) == 0)
+    return 0;
+  // Linux reports EISDIR for directories, POSIX allows EPERM
+  if (errno != EISDIR && errno != EPERM)
+    return errno;
+
+  int fd;
+  do {
+    fd = ::openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return errno;
+  DIR *dir = ::fdopendir(fd);
+  if (!dir) {
+    int err = errno;
+    ::close(fd);
+    return err;
+  }
+  int rc = 0;
+  while (struct dirent *entry = ::readdir(dir)) {
+    const char *child = entry->d_name;
+    if (child[0] == '.' && (child[1] == 0 || (child[1] == '.' && child[2] == 0)))
+      continue;
+    int child_rc = removeTreeAt(fd, child);
+    if (child_rc && !rc)
+      rc = child_rc;
+  }
+  ::closedir(dir);
+  if (::unlinkat(dir_fd, name, AT_REMOVEDIR) != 0 && !rc)
+    rc = errno;
+  return rc;
+}
+#endif
+
+}
+
+TempFile::TempFile() {
+}
+
+TempFile::TempFile(TempFile &&other) noexcept
+    : handler_(std::move(other.handler_)), path_(std::move(other.path_)) {
+  other.path_ = Path();
+}
+
+TempFile &TempFile::operator=(TempFile &&other) noexcept {
+  if (this != &other) {
+    remove();
+    handler_ = std::move(other.handler_);
+    path_ = std::move(other.path_);
+    other.path_ = Path();
+  }
+  return *this;
+}
+
+TempFile::~TempFile() {
+  remove();
+}
+
+std::unique_ptr<FileHandler> TempFile::keep() {
+  path_ = Path();
+  return std::move(handler_);
+}
+
+int TempFile::remove() {
+  int rc = 0;
+  if (handler_) {
+    handler_->close();
+    handler_.reset();
+  }
+  if (!path_.isEmpty()) {
+    rc = removeFile(path_);
+    path_ = Path();
+  }
+  return rc;
+}
+
+TempDirectory::TempDirectory() {
+}
+
+TempDirectory::TempDirectory(TempDirectory &&other) noexcept
+    : path_(std::move(other.path_)) {
+  other.path_ = Path();
+}
+
+TempDirectory &TempDirectory::operator=(TempDirectory &&other) noexcept {
+  if (this != &other) {
+    remove();
+    path_ = std::move(other.path_);
+    other.path_ = Path();
+  }
+  return *this;
+}
+
+TempDirectory::~TempDirectory() {
+  remove();
+}
+
+Path TempDirectory::keep() {
+  Path path(std::move(path_));
+  path_ = Path();
+  return path;
+}
+
+int TempDirectory::remove() {
+  if (path_.isEmpty())
+    return 0;
+#ifdef _WIN32
+  int rc = removeTree(path_.getSystemString());
+#else
+  int rc = removeTreeAt(AT_FDCWD, path_.getSystemString().c_str());
+#endif
+  path_ = Path();
+  return rc;
+}
+
+TempFileService::TempFileService(const Path &directory, FileFactory *factory)
+    : factory_(factory ? factory : fs()), directory_(directory) {
+  if (directory_.isEmpty())
+    directory_ = factory_->getTempDir();
+}
+
+TempFileService &TempFileService::instance() {
+  static TempFileService service;
+  return service;
+}
+
+const Path &TempFileService::directory() const {
+  return directory_;
+}
+
+Path TempFileService::generatePath(const char *prefix) const {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%016llx.tmp", (unsigned long long) nextNameValue());
+  return Path::join(directory_, Path::newFromUtf8(std::string(prefix ? prefix : "") + buffer));
+}
+
+int TempFileService::createFile(TempFile &out, const char *prefix, int flags) const {
+  int rc = 0;
+  for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+    Path path(generatePath(prefix));
+    std::unique_ptr<FileHandler> handler(factory_->createFileHandle(path));
+#ifndef _WIN32
+    // private like mkstemp: created 0600, never readable by others in between
+    posix::PosixFileHandler *posix_handler = dynamic_cast<posix::PosixFileHandler *>(handler.get());
+    if (posix_handler)
+      posix_handler->setCreateMode(0600);
+#endif
+    rc = handler->open(flags | MODE_CREATE_NEW);
+    if (rc == 0) {
+      out.remove();
+      out.handler_ = std::move(handler);
+      out.path_ = std::move(path);
+      return 0;
+    }
+    if (!isExistsError(rc))
+      break;
+  }
+  return rc;
+}
+
+int TempFileService::createAnonymousFile(TempFile &out) const {
+#ifdef _WIN32
+  int rc = 0;
+  for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+    Path path(generatePath("anon"));
+    HANDLE handle = ::CreateFile(path.getSystemString().c_str(),
+                                 GENERIC_READ | GENERIC_WRITE,
+                                 FILE_SHARE_DELETE,
+                                 NULL,
+                                 CREATE_NEW,
+                                 FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                                 NULL);
+    if (handle != INVALID_HANDLE_VALUE) {
+      std::unique_ptr<win32::WinFileHandler> handler(new win32::WinFileHandler(path.getSystemString()));
+      handler->attachHandle(handle);
+      out.remove();
+      out.handler_ = std::move(handler);
+      return 0;
+    }
+    rc = (int) ::GetLastError();
+    if (!isExistsError(rc))
+      break;
+  }
+  return rc;
+#else
+  const std::string &dir = directory_.getSystemString();
+  int fd = -1;
+  int err = 0;
+#ifdef O_TMPFILE
+  do {
+    fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  } while (fd < 0 && errno == EINTR);
+  err = (fd < 0) ? errno : 0;
+  // filesystems without O_TMPFILE fall through to a named file
+  if (fd < 0 && err != EOPNOTSUPP && err != EISDIR && err != EINVAL)
+    return err;
+#endif
+  for (int attempt = 0; fd < 0 && attempt < MAX_ATTEMPTS; attempt++) {
+    Path path(generatePath("anon"));
+    do {
+      fd = ::open(path.getSystemString().c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    } while (fd < 0 && errno == EINTR);
+    if (fd >= 0) {
+      ::unlink(path.getSystemString().c_str());
+      break;
+    }
+    err = errno;
+    if (err != EEXIST)
+      return err;
+  }
+  if (fd < 0)
+    return err;
+
+  std::unique_ptr<posix::PosixFileHandler> handler(new posix::PosixFileHandler(dir));
+  handler->attachFd(fd);
+  out.remove();
+  out.handler_ = std::move(handler);
+  return 0;
+#endif
+}
+
+int TempFileService::createDirectory(TempDirectory &out, const char *prefix) const {
+  int rc = 0;
+  for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+    Path path(generatePath(prefix));
+#ifdef _WIN32
+    rc = ::CreateDirectory(path.getSystemString().c_str(), NULL) ? 0 : (int) ::GetLastError();
+#else
+    rc = (::mkdir(path.getSystemString().c_str(), 0700) == 0) ? 0 : errno;
+#endif
+    if (rc == 0) {
+      out.remove();
+      out.path_ = std::move(path);
+      return 0;
+    }
+    if (!isExistsError(rc))
+      break;
+  }
+  return rc;
+}
+
+}
+}
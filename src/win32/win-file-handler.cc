@@ -7,9 +7,10 @@
 
 #include "jcu-file/file-factory.h"
 #include "jcu-file/file-handler.h"
+#include "jcu-file/temp-file-service.h"
 
-#include <jcu-random/secure-random-factory.h>
-
+#include <algorithm>
+#include <atomic>
 #include <sstream>
 #include <vector>
 #include <time.h>
@@ -18,43 +19,60 @@
 #ifdef _WIN32
 #include "jcu-file/win32/win-file-handler.h"
 
+#include <winioctl.h>
+
 namespace jcu {
 namespace file {
 
 namespace win32 {
 
 class WinFileFactory : public FileFactory {
- private:
-  std::unique_ptr<jcu::random::SecureRandom> secure_random_;
-
  public:
   WinFileFactory() {
-    secure_random_ = std::move(jcu::random::getSecureRandomFactory()->create());
   }
 
   ~WinFileFactory() {
   }
 
-  unsigned int genRandomUint() const {
-    return (unsigned int) secure_random_->nextInt();
-  }
-
   std::unique_ptr<FileHandler> createFileHandle(const Path &file_path) const override {
     return std::unique_ptr<FileHandler>(new WinFileHandler(file_path.getSystemString()));
   }
 
   int makeDirectory(const Path &path, bool recursive) const override {
-    int rc = 0;
-    DWORD dwFileAttri = ::GetFileAttributes(path.getSystemString().c_str());
-    if (dwFileAttri == INVALID_FILE_ATTRIBUTES) {
-      if (recursive) {
-        rc = makeDirectory(path.parent(), recursive);
-        if (rc != 0)
-          return rc;
-      }
-      if (!::CreateDirectory(path.getSystemString().c_str(), NULL)) {
-        return ::GetLastError();
-      }
+    // try the leaf first, walk up only when a parent is missing
+    if (::CreateDirectory(path.getSystemString().c_str(), NULL))
+      return 0;
+    DWORD dwError = ::GetLastError();
+    if (dwError == ERROR_ALREADY_EXISTS)
+      return 0;
+    if (dwError != ERROR_PATH_NOT_FOUND || !recursive)
+      return dwError;
+    Path parent_path(path.parent());
+    if (parent_path.isEmpty() || parent_path == path)
+      return dwError;
+    int rc = makeDirectory(parent_path, recursive);
+    if (rc != 0)
+      return rc;
+    if (!::CreateDirectory(path.getSystemString().c_str(), NULL)) {
+      dwError = ::GetLastError();
+      if (dwError != ERROR_ALREADY_EXISTS)
+        return dwError;
+    }
+    return 0;
+  }
+
+  int makeDirectories(const std::vector<Path> &paths, int threads) const override {
+    // no *at calls: sorted order creates each parent before its children
+    (void) threads;
+    std::vector<Path> sorted(paths);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    for (const Path &path : sorted) {
+      if (path.isEmpty())
+        continue;
+      int rc = makeDirectory(path, true);
+      if (rc != 0)
+        return rc;
     }
     return 0;
   }
@@ -77,44 +95,44 @@ class WinFileFactory : public FileFactory {
   }
 
   Path generateTempPath(const char *prefix, int *perr) const override {
-    int err = 0;
-    Path tempDir(getTempDir(&err));
-    if (err) {
-      if (perr)
-        *perr = err;
-      return Path();
-    }
-
-    std::string cstrPrefix(prefix);
-    std::basic_string<TCHAR> tstrPrefix(cstrPrefix.begin(), cstrPrefix.end());
-
-    TCHAR szBuffer[MAX_PATH];
-    UINT nResult = GetTempFileName(tempDir.getSystemString().c_str(), tstrPrefix.c_str(), genRandomUint(), szBuffer);
-    if (nResult == 0) {
-      if (perr)
-        *perr = (int) ::GetLastError();
-      return Path();
-    }
-
-    return Path::newFromSystem(szBuffer);
+    if (perr)
+      *perr = 0;
+    return TempFileService::instance().generatePath(prefix);
   }
   bool isFile(const Path &path) const override;
   bool isDirectory(const Path &path) const override;
   bool isDevice(const Path &path) const override;
   int readdir(std::list<Path> &out, const Path &path) const override;
+  int readdir(PathTable &table, PathTable::Id dir) const override;
   int64_t getFileSize(const Path& path) const override;
+  int stat(const Path &path, FileInfo &info, bool follow_symlinks) const override;
+  int copyFile(const Path &src, const Path &dst, int flags) const override;
+  int moveFile(const Path &src, const Path &dst, int flags) const override;
 };
 
+static std::basic_string<TCHAR> uniqueSiblingName(const std::basic_string<TCHAR> &path, const TCHAR *suffix) {
+  static std::atomic<unsigned int> counter(0);
+  std::vector<TCHAR> fnbuf(path.length() + 48);
+  _stprintf_s(fnbuf.data(), fnbuf.size(), _T("%s.%u.%u.%s"), path.c_str(), (unsigned int) ::GetCurrentProcessId(), counter++, suffix);
+  return fnbuf.data();
+}
+
 WinFileHandler::WinFileHandler(const std::basic_string<TCHAR> &path)
-    : path_(path), flags_(0), handle_(NULL) {
+    : path_(path), flags_(0), handle_(NULL), direct_(false), alignment_(1) {
+}
+WinFileHandler::~WinFileHandler() {
+  close();
+  // uncommitted ATOMIC_REPLACE data is discarded
+  if ((flags_ & ATOMIC_REPLACE) && !temp_path_.empty()) {
+    ::DeleteFile(temp_path_.c_str());
+  }
 }
 int WinFileHandler::removeOld() {
   DWORD dwOldFileAttri = ::GetFileAttributes(path_.c_str());
   if (dwOldFileAttri != INVALID_FILE_ATTRIBUTES) {
     if (flags_ & RENAME_IF_EXISTS) {
-      std::vector<TCHAR> fnbuf(1024);
-      _stprintf_s(fnbuf.data(), fnbuf.size(), _T("%s.%u.old"), path_.c_str(), (unsigned int) time(NULL));
-      old_path_ = fnbuf.data();
+      // a timestamp would collide for two replacements within a second
+      old_path_ = uniqueSiblingName(path_, _T("old"));
       if (!::MoveFileEx(path_.c_str(), old_path_.c_str(), 0)) {
         return ::GetLastError();
       }
@@ -133,6 +151,11 @@ HANDLE WinFileHandler::handle() const {
   return handle_;
 }
 
+void WinFileHandler::attachHandle(HANDLE handle) {
+  close();
+  handle_ = handle;
+}
+
 int WinFileHandler::open(int flags) {
   DWORD dwDesiredAccess = 0;
   DWORD dwShareMode = 0;
@@ -145,7 +168,9 @@ int WinFileHandler::open(int flags) {
     dwDesiredAccess |= GENERIC_READ;
   if (flags & MODE_WRITE)
     dwDesiredAccess |= GENERIC_WRITE;
-  if (flags & MODE_CREATE)
+  if (flags & MODE_CREATE_NEW)
+    dwCreationDisposition = CREATE_NEW;
+  else if (flags & MODE_CREATE)
     dwCreationDisposition = CREATE_ALWAYS;
   else if (flags & MODE_EXISTS)
     dwCreationDisposition = OPEN_EXISTING;
@@ -154,28 +179,69 @@ int WinFileHandler::open(int flags) {
   if (flags & SHARE_READ)
     dwShareMode = FILE_SHARE_READ;
 
-  if (flags & USE_TEMPNAME) {
-    std::vector<TCHAR> fnbuf(1024);
-    _stprintf_s(fnbuf.data(), fnbuf.size(), _T("%s.%u.new"), path_.c_str(), (unsigned int) time(NULL));
-    open_path = fnbuf.data();
+  if (flags & ATOMIC_REPLACE) {
+    if ((flags & MODE_EXISTS) && ::GetFileAttributes(path_.c_str()) == INVALID_FILE_ATTRIBUTES)
+      return ::GetLastError();
+    // Windows has no anonymous files: write a unique sibling, the target is left alone until commit()
+    dwDesiredAccess |= GENERIC_WRITE;
+    dwCreationDisposition = CREATE_NEW;
+    open_path = uniqueSiblingName(path_, _T("new"));
+    temp_path_ = open_path;
+  } else if (flags & USE_TEMPNAME) {
+    open_path = uniqueSiblingName(path_, _T("new"));
     temp_path_ = open_path;
   } else {
     removeOld();
     open_path = path_;
   }
 
+  DWORD dwFlagsAndAttributes = FILE_ATTRIBUTE_NORMAL;
+  if (flags & MODE_DIRECT)
+    dwFlagsAndAttributes |= FILE_FLAG_NO_BUFFERING;
+  if (flags & (HINT_SEQUENTIAL | ADAPTIVE_READAHEAD))
+    dwFlagsAndAttributes |= FILE_FLAG_SEQUENTIAL_SCAN;
+  else if (flags & HINT_RANDOM)
+    dwFlagsAndAttributes |= FILE_FLAG_RANDOM_ACCESS;
+
   handle_ = ::CreateFile(open_path.c_str(),
                          dwDesiredAccess,
                          dwShareMode,
                          NULL,
                          dwCreationDisposition,
-                         FILE_ATTRIBUTE_NORMAL,
+                         dwFlagsAndAttributes,
                          NULL);
-  if (handle_ && (handle_ != INVALID_HANDLE_VALUE))
+  if ((!handle_ || handle_ == INVALID_HANDLE_VALUE) && (dwFlagsAndAttributes & FILE_FLAG_NO_BUFFERING)
+      && ::GetLastError() == ERROR_INVALID_PARAMETER) {
+    // filesystem without unbuffered I/O: fall back to the cache manager
+    dwFlagsAndAttributes &= ~FILE_FLAG_NO_BUFFERING;
+    handle_ = ::CreateFile(open_path.c_str(),
+                           dwDesiredAccess,
+                           dwShareMode,
+                           NULL,
+                           dwCreationDisposition,
+                           dwFlagsAndAttributes,
+                           NULL);
+  }
+  if (handle_ && (handle_ != INVALID_HANDLE_VALUE)) {
+    initDirect((dwFlagsAndAttributes & FILE_FLAG_NO_BUFFERING) != 0);
     return 0;
+  }
 
   return ::GetLastError();
 }
+void WinFileHandler::initDirect(bool requested) {
+  direct_ = requested;
+  alignment_ = 1;
+  if (!requested)
+    return;
+  FILE_STORAGE_INFO storage_info = {0};
+  if (::GetFileInformationByHandleEx(handle_, FileStorageInfo, &storage_info, sizeof(storage_info))
+      && storage_info.LogicalBytesPerSector) {
+    alignment_ = storage_info.LogicalBytesPerSector;
+  } else {
+    alignment_ = 4096;
+  }
+}
 int WinFileHandler::read(void *buf, int size) {
   DWORD dwReadBytes = 0;
   if (!ReadFile(handle_, buf, size, &dwReadBytes, NULL)) {
@@ -190,9 +256,266 @@ int WinFileHandler::write(const void *buf, int size) {
   }
   return dwWrittenBytes;
 }
+// ReadFile/WriteFile with an OVERLAPPED offset still move the file pointer
+// of a synchronous handle, so readAt/writeAt put it back afterwards. The I/O
+// manager serializes synchronous handles anyway; the lock only keeps two
+// calls from restoring each other's pointer.
+int64_t WinFileHandler::readAt(void *buf, size_t size, int64_t offset) {
+  OVERLAPPED overlapped = {0};
+  DWORD dwReadBytes = 0;
+  LARGE_INTEGER cursor = {0};
+  LARGE_INTEGER zero = {0};
+  overlapped.Offset = (DWORD) (offset & 0xffffffffLL);
+  overlapped.OffsetHigh = (DWORD) ((offset >> 32) & 0xffffffffLL);
+  if (size > MAXDWORD)
+    size = MAXDWORD;
+  std::unique_lock<std::mutex> lock(cursor_mutex_);
+  if (!::SetFilePointerEx(handle_, zero, &cursor, FILE_CURRENT)) {
+    return -((int64_t) ::GetLastError());
+  }
+  BOOL bResult = ReadFile(handle_, buf, (DWORD) size, &dwReadBytes, &overlapped);
+  DWORD dwError = bResult ? 0 : ::GetLastError();
+  ::SetFilePointerEx(handle_, cursor, NULL, FILE_BEGIN);
+  if (!bResult) {
+    if (dwError == ERROR_HANDLE_EOF)
+      return 0;
+    return -((int64_t) dwError);
+  }
+  return dwReadBytes;
+}
+int64_t WinFileHandler::writeAt(const void *buf, size_t size, int64_t offset) {
+  OVERLAPPED overlapped = {0};
+  DWORD dwWrittenBytes = 0;
+  LARGE_INTEGER cursor = {0};
+  LARGE_INTEGER zero = {0};
+  overlapped.Offset = (DWORD) (offset & 0xffffffffLL);
+  overlapped.OffsetHigh = (DWORD) ((offset >> 32) & 0xffffffffLL);
+  if (size > MAXDWORD)
+    size = MAXDWORD;
+  std::unique_lock<std::mutex> lock(cursor_mutex_);
+  if (!::SetFilePointerEx(handle_, zero, &cursor, FILE_CURRENT)) {
+    return -((int64_t) ::GetLastError());
+  }
+  BOOL bResult = WriteFile(handle_, buf, (DWORD) size, &dwWrittenBytes, &overlapped);
+  DWORD dwError = bResult ? 0 : ::GetLastError();
+  ::SetFilePointerEx(handle_, cursor, NULL, FILE_BEGIN);
+  if (!bResult) {
+    return -((int64_t) dwError);
+  }
+  return dwWrittenBytes;
+}
+int64_t WinFileHandler::read64(void *buf, size_t size) {
+  int64_t total = 0;
+  while (size > 0) {
+    DWORD dwChunk = (size > MAXDWORD) ? MAXDWORD : (DWORD) size;
+    DWORD dwReadBytes = 0;
+    if (!ReadFile(handle_, buf, dwChunk, &dwReadBytes, NULL)) {
+      if (total > 0)
+        break;
+      return -((int64_t) ::GetLastError());
+    }
+    total += dwReadBytes;
+    if (dwReadBytes < dwChunk)
+      break;
+    buf = (char *) buf + dwReadBytes;
+    size -= dwReadBytes;
+  }
+  return total;
+}
+int64_t WinFileHandler::write64(const void *buf, size_t size) {
+  int64_t total = 0;
+  while (size > 0) {
+    DWORD dwChunk = (size > MAXDWORD) ? MAXDWORD : (DWORD) size;
+    DWORD dwWrittenBytes = 0;
+    if (!WriteFile(handle_, buf, dwChunk, &dwWrittenBytes, NULL)) {
+      if (total > 0)
+        break;
+      return -((int64_t) ::GetLastError());
+    }
+    total += dwWrittenBytes;
+    if (dwWrittenBytes < dwChunk)
+      break;
+    buf = (const char *) buf + dwWrittenBytes;
+    size -= dwWrittenBytes;
+  }
+  return total;
+}
+// ReadFileScatter/WriteFileGather need unbuffered page-sized buffers, so loop instead.
+int64_t WinFileHandler::readv(const IoVec *iov, int count) {
+  int64_t total = 0;
+  for (int i = 0; i < count; i++) {
+    int64_t n = read64(iov[i].base, iov[i].length);
+    if (n < 0)
+      return (total > 0) ? total : n;
+    total += n;
+    if ((size_t) n < iov[i].length)
+      break;
+  }
+  return total;
+}
+int64_t WinFileHandler::writev(const IoVec *iov, int count) {
+  int64_t total = 0;
+  for (int i = 0; i < count; i++) {
+    int64_t n = write64(iov[i].base, iov[i].length);
+    if (n < 0)
+      return (total > 0) ? total : n;
+    total += n;
+    if ((size_t) n < iov[i].length)
+      break;
+  }
+  return total;
+}
+int64_t WinFileHandler::readvAt(const IoVec *iov, int count, int64_t offset) {
+  int64_t total = 0;
+  for (int i = 0; i < count; i++) {
+    int64_t n = readAt(iov[i].base, iov[i].length, offset + total);
+    if (n < 0)
+      return (total > 0) ? total : n;
+    total += n;
+    if ((size_t) n < iov[i].length)
+      break;
+  }
+  return total;
+}
+int64_t WinFileHandler::writevAt(const IoVec *iov, int count, int64_t offset) {
+  int64_t total = 0;
+  for (int i = 0; i < count; i++) {
+    int64_t n = writeAt(iov[i].base, iov[i].length, offset + total);
+    if (n < 0)
+      return (total > 0) ? total : n;
+    total += n;
+    if ((size_t) n < iov[i].length)
+      break;
+  }
+  return total;
+}
+int WinFileHandler::sync(bool data_only) {
+  if (!::FlushFileBuffers(handle_)) {
+    return ::GetLastError();
+  }
+  return 0;
+}
+int WinFileHandler::allocate(int64_t offset, int64_t length, bool keep_size) {
+  LARGE_INTEGER size = {0};
+  if (!::GetFileSizeEx(handle_, &size))
+    return ::GetLastError();
+  int64_t end = offset + length;
+  if (!keep_size && end > size.QuadPart) {
+    int rc = truncate(end);
+    if (rc)
+      return rc;
+  }
+  // reserves clusters, beyond the end of file when keep_size is set
+  FILE_ALLOCATION_INFO info;
+  info.AllocationSize.QuadPart = end;
+  if (end > size.QuadPart && !::SetFileInformationByHandle(handle_, FileAllocationInfo, &info, sizeof(info)))
+    return ::GetLastError();
+  return 0;
+}
+int WinFileHandler::punchHole(int64_t offset, int64_t length) {
+  DWORD dwBytes = 0;
+  FILE_SET_SPARSE_BUFFER sparse = {TRUE};
+  if (!::DeviceIoControl(handle_, FSCTL_SET_SPARSE, &sparse, sizeof(sparse), NULL, 0, &dwBytes, NULL))
+    return ::GetLastError();
+  return zeroRange(offset, length);
+}
+int WinFileHandler::zeroRange(int64_t offset, int64_t length) {
+  // deallocates on sparse files, writes zeros otherwise
+  DWORD dwBytes = 0;
+  FILE_ZERO_DATA_INFORMATION zero;
+  zero.FileOffset.QuadPart = offset;
+  zero.BeyondFinalZero.QuadPart = offset + length;
+  if (!::DeviceIoControl(handle_, FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), NULL, 0, &dwBytes, NULL))
+    return ::GetLastError();
+  return 0;
+}
+int WinFileHandler::truncate(int64_t size) {
+  FILE_END_OF_FILE_INFO info;
+  info.EndOfFile.QuadPart = size;
+  if (!::SetFileInformationByHandle(handle_, FileEndOfFileInfo, &info, sizeof(info)))
+    return ::GetLastError();
+  return 0;
+}
+int WinFileHandler::nextExtent(int64_t offset, int64_t &data_offset, int64_t &data_length) {
+  LARGE_INTEGER size = {0};
+  if (!::GetFileSizeEx(handle_, &size))
+    return ::GetLastError();
+  data_offset = offset;
+  data_length = 0;
+  if (offset >= size.QuadPart)
+    return 0;
+
+  FILE_ALLOCATED_RANGE_BUFFER query;
+  FILE_ALLOCATED_RANGE_BUFFER range;
+  DWORD dwBytes = 0;
+  query.FileOffset.QuadPart = offset;
+  query.Length.QuadPart = size.QuadPart - offset;
+  if (!::DeviceIoControl(handle_, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), &range, sizeof(range), &dwBytes, NULL)) {
+    DWORD dwError = ::GetLastError();
+    // ERROR_MORE_DATA still fills the first range
+    if (dwError != ERROR_MORE_DATA) {
+      if (dwError == ERROR_INVALID_FUNCTION) {
+        data_length = size.QuadPart - offset;
+        return 0;
+      }
+      return dwError;
+    }
+  }
+  if (dwBytes < sizeof(range)) {
+    data_offset = size.QuadPart;
+    return 0;
+  }
+  data_offset = (range.FileOffset.QuadPart > offset) ? range.FileOffset.QuadPart : offset;
+  data_length = range.FileOffset.QuadPart + range.Length.QuadPart - data_offset;
+  return 0;
+}
+int WinFileHandler::advise(int64_t offset, int64_t length, AccessPattern pattern) {
+  // the cache manager only takes hints at open (HINT_SEQUENTIAL/HINT_RANDOM)
+  (void) offset;
+  (void) length;
+  if (pattern < ACCESS_NORMAL || pattern > ACCESS_DONTNEED)
+    return ERROR_INVALID_PARAMETER;
+  return 0;
+}
+int WinFileHandler::prefetch(int64_t offset, int64_t length) {
+  if (offset < 0 || length < 0)
+    return ERROR_INVALID_PARAMETER;
+  return 0;
+}
+int WinFileHandler::commitReplace() {
+  if (temp_path_.empty())
+    return 0;
+
+  if (handle_ && (handle_ != INVALID_HANDLE_VALUE)) {
+    if (!(flags_ & NO_SYNC_DATA) && !::FlushFileBuffers(handle_))
+      return ::GetLastError();
+    // an open file cannot be renamed
+    CloseHandle(handle_);
+    handle_ = NULL;
+  }
+
+  if ((flags_ & RENAME_IF_EXISTS) && (::GetFileAttributes(path_.c_str()) != INVALID_FILE_ATTRIBUTES)) {
+    old_path_ = uniqueSiblingName(path_, _T("old"));
+    if (!::ReplaceFile(path_.c_str(), temp_path_.c_str(), old_path_.c_str(), 0, NULL, NULL))
+      return ::GetLastError();
+    if (flags_ & REMOVE_IF_EXISTS)
+      ::DeleteFile(old_path_.c_str());
+  } else {
+    DWORD dwMoveFlags = MOVEFILE_REPLACE_EXISTING;
+    if (!(flags_ & NO_SYNC_DIRECTORY))
+      dwMoveFlags |= MOVEFILE_WRITE_THROUGH;
+    if (!::MoveFileEx(temp_path_.c_str(), path_.c_str(), dwMoveFlags))
+      return ::GetLastError();
+  }
+  temp_path_.clear();
+  return 0;
+}
 int WinFileHandler::commit() {
   int rc;
 
+  if (flags_ & ATOMIC_REPLACE)
+    return commitReplace();
+
   if (!temp_path_.empty()) {
     rc = removeOld();
     if (rc)
@@ -207,6 +530,9 @@ int WinFileHandler::commit() {
 }
 int WinFileHandler::close() {
   if (handle_ && (handle_ != INVALID_HANDLE_VALUE)) {
+    // data cannot be flushed once the handle is gone, do it before commit() needs it
+    if ((flags_ & ATOMIC_REPLACE) && !(flags_ & NO_SYNC_DATA) && !temp_path_.empty())
+      ::FlushFileBuffers(handle_);
     CloseHandle(handle_);
   }
   handle_ = NULL;
@@ -218,6 +544,12 @@ bool WinFileHandler::isOpen() const {
 Path WinFileHandler::getOldName() const {
   return Path::newFromSystem(old_path_);
 }
+bool WinFileHandler::isDirect() const {
+  return direct_;
+}
+size_t WinFileHandler::getAlignment() const {
+  return alignment_;
+}
 int64_t WinFileHandler::getFileSize() const {
   LARGE_INTEGER filesize = { 0 };
   if (::GetFileSizeEx(handle_, &filesize)) {
@@ -290,6 +622,42 @@ int WinFileFactory::readdir(std::list<Path> &out, const Path &path) const {
   return 0;
 }
 
+int WinFileFactory::readdir(PathTable &table, PathTable::Id dir) const {
+  std::basic_string<TCHAR> str_dir;
+  WIN32_FIND_DATA ffd = {0};
+  HANDLE find_handle;
+  int rc = 0;
+
+  table.appendPath(dir, str_dir);
+  if (str_dir.empty()) {
+    return -1;
+  }
+
+  const TCHAR last_chr = str_dir.at(str_dir.length() - 1);
+  if (last_chr != _T('\\') && last_chr != _T('/')) {
+    str_dir.append(_T("\\"));
+  }
+  str_dir.append(_T("*"));
+
+  find_handle = ::FindFirstFile(str_dir.c_str(), &ffd);
+  if (!find_handle || find_handle == INVALID_HANDLE_VALUE) {
+    return ::GetLastError();
+  }
+
+  do {
+    if (_tcscmp(ffd.cFileName, _T(".")) && _tcscmp(ffd.cFileName, _T(".."))) {
+      if (table.add(dir, ffd.cFileName) == PathTable::NO_ID) {
+        rc = ERROR_FILENAME_EXCED_RANGE;
+        break;
+      }
+    }
+  } while (FindNextFile(find_handle, &ffd));
+
+  ::FindClose(find_handle);
+
+  return rc;
+}
+
 int64_t WinFileFactory::getFileSize(const Path& path) const {
   WIN32_FILE_ATTRIBUTE_DATA data = { 0 };
   if(::GetFileAttributesEx(
@@ -303,6 +671,75 @@ int64_t WinFileFactory::getFileSize(const Path& path) const {
   return -((int)::GetLastError());
 }
 
+static int64_t fileTimeToUnixNs(const FILETIME &ft) {
+  int64_t ticks = (int64_t) ((((uint64_t) ft.dwHighDateTime) << 32) | ((uint64_t) ft.dwLowDateTime));
+  return (ticks - 116444736000000000LL) * 100;
+}
+
+int WinFileFactory::stat(const Path &path, FileInfo &info, bool follow_symlinks) const {
+  BY_HANDLE_FILE_INFORMATION file_info = { 0 };
+  DWORD dwFlags = FILE_FLAG_BACKUP_SEMANTICS;
+  if (!follow_symlinks)
+    dwFlags |= FILE_FLAG_OPEN_REPARSE_POINT;
+  HANDLE handle = ::CreateFile(path.getSystemString().c_str(),
+                               0,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               NULL,
+                               OPEN_EXISTING,
+                               dwFlags,
+                               NULL);
+  if (!handle || handle == INVALID_HANDLE_VALUE) {
+    return ::GetLastError();
+  }
+  if (!::GetFileInformationByHandle(handle, &file_info)) {
+    DWORD dwError = ::GetLastError();
+    ::CloseHandle(handle);
+    return dwError;
+  }
+  ::CloseHandle(handle);
+
+  if (file_info.dwFileAttributes & FILE_ATTRIBUTE_DEVICE)
+    info.type = FILE_TYPE_CHAR_DEVICE;
+  else if (file_info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+    info.type = FILE_TYPE_DIRECTORY;
+  else if (!follow_symlinks && (file_info.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+    info.type = FILE_TYPE_SYMLINK;
+  else
+    info.type = FILE_TYPE_REGULAR;
+  info.size = ((((int64_t) file_info.nFileSizeHigh) & 0xffffffffLL) << 32) |
+    (((int64_t) file_info.nFileSizeLow) & 0xffffffffLL);
+  info.mtime_ns = fileTimeToUnixNs(file_info.ftLastWriteTime);
+  info.ctime_ns = fileTimeToUnixNs(file_info.ftCreationTime);
+  info.inode = (((uint64_t) file_info.nFileIndexHigh) << 32) | ((uint64_t) file_info.nFileIndexLow);
+  info.device = file_info.dwVolumeSerialNumber;
+  info.permissions = (file_info.dwFileAttributes & FILE_ATTRIBUTE_READONLY) ? 0555 : 0777;
+  info.link_count = file_info.nNumberOfLinks;
+  return 0;
+}
+
+int WinFileFactory::copyFile(const Path &src, const Path &dst, int flags) const {
+  // CopyFileEx already keeps attributes, timestamps and sparse ranges, and
+  // uses block cloning (ReFS) or server-side copy (SMB) when available.
+  // COPY_NO_REFLINK and COPY_PARALLEL have no counterpart here.
+  DWORD dwCopyFlags = 0;
+  if (!(flags & COPY_OVERWRITE))
+    dwCopyFlags |= COPY_FILE_FAIL_IF_EXISTS;
+  if (!::CopyFileEx(src.getSystemString().c_str(), dst.getSystemString().c_str(), NULL, NULL, NULL, dwCopyFlags)) {
+    return ::GetLastError();
+  }
+  return 0;
+}
+
+int WinFileFactory::moveFile(const Path &src, const Path &dst, int flags) const {
+  DWORD dwMoveFlags = MOVEFILE_COPY_ALLOWED | MOVEFILE_WRITE_THROUGH;
+  if (flags & COPY_OVERWRITE)
+    dwMoveFlags |= MOVEFILE_REPLACE_EXISTING;
+  if (!::MoveFileEx(src.getSystemString().c_str(), dst.getSystemString().c_str(), dwMoveFlags)) {
+    return ::GetLastError();
+  }
+  return 0;
+}
+
 }
 
 FileFactory *fs() {
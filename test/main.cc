@@ -1,13 +1,44 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <string>
 #include <map>
+#include <mutex>
+#include <set>
 #include <list>
+#include <thread>
+#include <vector>
 
 #include <test-config.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <gtest/gtest.h>
 
 #include <jcu-file/path.h>
 #include <jcu-file/file-factory.h>
+#include <jcu-file/mapped-region.h>
+#include <jcu-file/async-file-engine.h>
+#include <jcu-file/buffered-stream.h>
+#include <jcu-file/directory-iterator.h>
+#include <jcu-file/walk.h>
+#include <jcu-file/cached-file-factory.h>
+#include <jcu-file/path-table.h>
+#include <jcu-file/path-set.h>
+#include <jcu-file/durability-batch.h>
+#include <jcu-file/extent-iterator.h>
+#include <jcu-file/aligned-buffer-pool.h>
+#include <jcu-file/temp-file-service.h>
+#include <jcu-file/directory.h>
+#include <jcu-file/file-watcher.h>
+#include <jcu-file/file-hasher.h>
+#include <jcu-file/tree-snapshot.h>
 
 using namespace jcu::file;
 
@@ -22,6 +53,54 @@ TEST(PathTest, parent) {
   EXPECT_EQ(c.parent().toUtf8(), a.toUtf8());
 }
 
+TEST(PathTest, filenameExtensionStem) {
+  Path path = Path::newFromUtf8("dir/sub/archive.tar.gz");
+  EXPECT_EQ(path.filename(), "archive.tar.gz");
+  EXPECT_EQ(path.extension(), ".gz");
+  EXPECT_EQ(path.stem(), "archive.tar");
+
+  Path dot_file = Path::newFromUtf8("home/.profile");
+  EXPECT_EQ(dot_file.filename(), ".profile");
+  EXPECT_EQ(dot_file.extension(), "");
+  EXPECT_EQ(dot_file.stem(), ".profile");
+
+  EXPECT_EQ(Path::newFromUtf8("plain").extension(), "");
+}
+
+#ifndef _WIN32
+TEST(PathTest, components) {
+  std::vector<std::string> parts;
+  Path path = Path::newFromUtf8("/usr//local/lib/");
+  for (auto part : path.components()) {
+    parts.emplace_back(part);
+  }
+  std::vector<std::string> expected = {"usr", "local", "lib"};
+  EXPECT_EQ(parts, expected);
+  EXPECT_TRUE(Path().components().begin() == Path().components().end());
+}
+
+TEST(PathTest, builderAndMove) {
+  PathBuilder builder(Path::newFromUtf8("/var/lib/jcu-file"));
+  size_t mark = builder.length();
+  builder.append("a").append(Path::newFromUtf8("b"));
+  EXPECT_EQ(builder.str(), "/var/lib/jcu-file/a/b");
+  builder.pop();
+  EXPECT_EQ(builder.str(), "/var/lib/jcu-file/a");
+  builder.truncate(mark);
+  builder.append("c");
+  EXPECT_EQ(builder.toPath().toUtf8(), "/var/lib/jcu-file/c");
+
+  Path taken = builder.take();
+  EXPECT_EQ(taken.toUtf8(), "/var/lib/jcu-file/c");
+  EXPECT_EQ(builder.length(), 0);
+
+  const char *data = taken.getSystemString().data();
+  Path moved(std::move(taken));
+  EXPECT_EQ(moved.getSystemString().data(), data);
+  EXPECT_TRUE(&moved.toUtf8() == &moved.getSystemString());
+}
+#endif
+
 } // namespace
 
 // FileSystemTest
@@ -29,14 +108,45 @@ namespace {
 
 std::string getTestFilesDir() {
   std::string temp = TEST_FILES_DIR;
+#ifdef _WIN32
   for (auto it = temp.begin(); it != temp.end(); it++) {
     if (*it == '/') {
       *it = '\\';
     }
   }
+#endif
   return temp;
 }
 
+// removed with everything in it at the end of the test
+TempDirectory makeScratchDir() {
+  TempDirectory dir;
+  EXPECT_EQ(TempFileService::instance().createDirectory(dir, "jcu-file-test-"), 0);
+  return dir;
+}
+
+// create or truncate `path` holding `data`
+void writeFile(const Path &path, const std::string &data) {
+  auto file_handle = fs()->createFileHandle(path);
+  ASSERT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+  ASSERT_EQ(file_handle->write64(data.data(), data.size()), (int64_t) data.size());
+  file_handle->close();
+}
+
+// whole contents of `path`, empty if it can't be opened
+std::string readWhole(const Path &path) {
+  std::string out;
+  auto file_handle = fs()->createFileHandle(path);
+  if (file_handle->open(jcu::file::MODE_EXISTS | jcu::file::MODE_READ))
+    return out;
+  char buf[4096];
+  int n;
+  while ((n = file_handle->read(buf, sizeof(buf))) > 0) {
+    out.append(buf, n);
+  }
+  return out;
+}
+
 TEST(FileSystemTest, getFileSizeFile1) {
   std::string test_dir = getTestFilesDir();
   std::string filename = "file-1";
@@ -87,6 +197,47 @@ TEST(FileSystemTest, readdir) {
   EXPECT_EQ(result_mask, expect_mask);
 }
 
+TEST(FileSystemTest, makeDirectory) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  Path deep = Path::join(root, Path::newFromUtf8("a/b/c/d"));
+  EXPECT_NE(file_factory->makeDirectory(deep), 0);
+  EXPECT_EQ(file_factory->makeDirectory(deep, true), 0);
+  EXPECT_TRUE(file_factory->isDirectory(deep));
+  EXPECT_EQ(file_factory->makeDirectory(deep, true), 0);
+  EXPECT_EQ(file_factory->makeDirectory(deep), 0);
+}
+
+TEST(FileSystemTest, makeDirectories) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  std::vector<Path> paths;
+  for (int i = 0; i < 16; i++) {
+    for (int j = 0; j < 16; j++) {
+      char name[32];
+      snprintf(name, sizeof(name), "shards/%02x/%02x", i, j);
+      paths.push_back(Path::join(root, Path::newFromUtf8(name)));
+    }
+  }
+  // duplicates and already existing paths are fine
+  paths.push_back(paths.front());
+  paths.push_back(root);
+
+  EXPECT_EQ(file_factory->makeDirectories(paths, 0), 0);
+  for (const Path &path : paths) {
+    EXPECT_TRUE(file_factory->isDirectory(path));
+  }
+  EXPECT_EQ(file_factory->makeDirectories(paths), 0);
+
+  // one path is a plain mkdir -p
+  Path single = Path::join(root, Path::newFromUtf8("single/x/y"));
+  EXPECT_EQ(file_factory->makeDirectories(std::vector<Path>{single}), 0);
+  EXPECT_TRUE(file_factory->isDirectory(single));
+  EXPECT_EQ(file_factory->makeDirectories(std::vector<Path>()), 0);
+}
+
 } // namespace
 
 // FileHandleTest
@@ -122,4 +273,1596 @@ TEST(FileHandleTest, getFileSizeFile2) {
   EXPECT_EQ(size, 0);
 }
 
+TEST(FileHandleTest, writeAndRead) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("rw"));
+
+  auto writer = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(writer->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+  EXPECT_EQ(writer->write("hello world", 11), 11);
+  EXPECT_EQ(writer->close(), 0);
+  EXPECT_FALSE(writer->isOpen());
+
+  char buf[32] = {0};
+  auto reader = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(reader->open(jcu::file::MODE_EXISTS | jcu::file::MODE_READ), 0);
+  EXPECT_EQ(reader->read(buf, sizeof(buf)), 11);
+  EXPECT_EQ(std::string(buf), "hello world");
+  EXPECT_EQ(reader->read(buf, sizeof(buf)), 0);
+}
+
+TEST(FileHandleTest, openExistsMissing) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("missing"));
+  auto file_handle = file_factory->createFileHandle(file_path);
+  EXPECT_NE(file_handle->open(jcu::file::MODE_EXISTS | jcu::file::MODE_READ), 0);
+  EXPECT_FALSE(file_handle->isOpen());
+  EXPECT_FALSE(file_factory->isFile(file_path));
+}
+
+TEST(FileHandleTest, commitTempNameRenameIfExists) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("target"));
+
+  auto first = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(first->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+  EXPECT_EQ(first->write("old", 3), 3);
+  first->close();
+
+  auto second = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(second->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE | jcu::file::USE_TEMPNAME | jcu::file::RENAME_IF_EXISTS), 0);
+  EXPECT_EQ(second->write("new data", 8), 8);
+  EXPECT_EQ(file_factory->getFileSize(file_path), 3);
+  second->close();
+  EXPECT_EQ(second->commit(), 0);
+
+  EXPECT_EQ(file_factory->getFileSize(file_path), 8);
+  EXPECT_FALSE(second->getOldName().isEmpty());
+  EXPECT_EQ(file_factory->getFileSize(second->getOldName()), 3);
+
+  // a second replacement within the same second keeps both backups
+  auto third = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(third->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE | jcu::file::USE_TEMPNAME | jcu::file::RENAME_IF_EXISTS), 0);
+  EXPECT_EQ(third->write("x", 1), 1);
+  third->close();
+  EXPECT_EQ(third->commit(), 0);
+  EXPECT_EQ(file_factory->getFileSize(file_path), 1);
+  EXPECT_NE(third->getOldName(), second->getOldName());
+  EXPECT_EQ(file_factory->getFileSize(third->getOldName()), 8);
+  EXPECT_EQ(file_factory->getFileSize(second->getOldName()), 3);
+}
+
+TEST(FileHandleTest, atomicReplace) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path dir = scratch.path();
+  auto file_path = Path::join(dir, Path::newFromUtf8("state"));
+
+  auto first = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(first->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+  EXPECT_EQ(first->write("old", 3), 3);
+  first->close();
+
+  auto second = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(second->open(jcu::file::MODE_WRITE | jcu::file::ATOMIC_REPLACE), 0);
+  EXPECT_EQ(second->write("new data", 8), 8);
+  EXPECT_EQ(file_factory->getFileSize(file_path), 3);
+  second->close();
+  EXPECT_EQ(second->commit(), 0);
+  EXPECT_EQ(file_factory->getFileSize(file_path), 8);
+
+  // dropped without commit: nothing changes and nothing is left behind
+  {
+    auto dropped = file_factory->createFileHandle(file_path);
+    EXPECT_EQ(dropped->open(jcu::file::MODE_WRITE | jcu::file::ATOMIC_REPLACE | jcu::file::NO_SYNC_DATA), 0);
+    EXPECT_EQ(dropped->write("x", 1), 1);
+  }
+  EXPECT_EQ(file_factory->getFileSize(file_path), 8);
+
+  auto third = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(third->open(jcu::file::MODE_WRITE | jcu::file::ATOMIC_REPLACE | jcu::file::RENAME_IF_EXISTS | jcu::file::NO_SYNC_DIRECTORY), 0);
+  EXPECT_EQ(third->write("third", 5), 5);
+  EXPECT_EQ(third->commit(), 0);
+  third->close();
+  EXPECT_EQ(file_factory->getFileSize(file_path), 5);
+  EXPECT_EQ(file_factory->getFileSize(third->getOldName()), 8);
+
+  std::list<Path> files;
+  EXPECT_EQ(file_factory->readdir(files, dir), 0);
+  EXPECT_EQ(files.size(), 2);
+}
+
+TEST(FileHandleTest, atomicReplaceNewFile) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("fresh"));
+
+  auto file_handle = file_factory->createFileHandle(file_path);
+  EXPECT_NE(file_handle->open(jcu::file::MODE_EXISTS | jcu::file::MODE_WRITE | jcu::file::ATOMIC_REPLACE), 0);
+  EXPECT_EQ(file_handle->open(jcu::file::MODE_WRITE | jcu::file::ATOMIC_REPLACE), 0);
+  EXPECT_EQ(file_handle->write("abc", 3), 3);
+  EXPECT_FALSE(file_factory->isFile(file_path));
+  EXPECT_EQ(file_handle->commit(), 0);
+  EXPECT_EQ(file_factory->getFileSize(file_path), 3);
+  EXPECT_TRUE(file_handle->getOldName().isEmpty());
+}
+
+TEST(FileHandleTest, allocateTruncateAndExtents) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("extents"));
+  const int64_t block = 1 << 20;
+
+  auto file_handle = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_READ | jcu::file::MODE_WRITE), 0);
+  EXPECT_EQ(file_handle->allocate(0, block, true), 0);
+  EXPECT_EQ(file_handle->getFileSize(), 0);
+  EXPECT_EQ(file_handle->allocate(0, block), 0);
+  EXPECT_EQ(file_handle->getFileSize(), block);
+  EXPECT_EQ(file_handle->truncate(4 * block), 0);
+  EXPECT_EQ(file_handle->getFileSize(), 4 * block);
+
+  std::vector<char> data(block, 'x');
+  EXPECT_EQ(file_handle->writeAt(data.data(), data.size(), 2 * block), block);
+
+  int rc = file_handle->punchHole(0, block);
+  if (rc == 0) {
+    std::vector<FileExtent> extents;
+    ExtentIterator iter(*file_handle);
+    while (iter.next()) {
+      extents.push_back(iter.extent());
+    }
+    EXPECT_EQ(iter.error(), 0);
+    ASSERT_EQ(extents.size(), 1);
+    EXPECT_EQ(extents[0].offset, 2 * block);
+    EXPECT_EQ(extents[0].length, block);
+
+    // the extent lookup leaves the file position alone
+    EXPECT_EQ(file_handle->write("ab", 2), 2);
+    ExtentIterator again(*file_handle);
+    EXPECT_TRUE(again.next());
+    EXPECT_EQ(file_handle->write("cd", 2), 2);
+    char buf[4];
+    EXPECT_EQ(file_handle->readAt(buf, 4, 0), 4);
+    EXPECT_EQ(std::string(buf, 4), "abcd");
+  }
+
+  EXPECT_EQ(file_handle->zeroRange(2 * block, 16), 0);
+  char buf[17];
+  EXPECT_EQ(file_handle->readAt(buf, 17, 2 * block), 17);
+  EXPECT_EQ(std::string(buf, 17), std::string(16, '\0') + "x");
+  EXPECT_EQ(file_handle->getFileSize(), 4 * block);
+}
+
+TEST(FileHandleTest, directIoWithBufferPool) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("direct"));
+
+  auto file_handle = file_factory->createFileHandle(file_path);
+  ASSERT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_READ | jcu::file::MODE_WRITE | jcu::file::MODE_DIRECT), 0);
+  size_t alignment = file_handle->getAlignment();
+  if (file_handle->isDirect()) {
+    EXPECT_GE(alignment, 512);
+    EXPECT_EQ(alignment & (alignment - 1), 0);
+  } else {
+    // the filesystem refused direct I/O, the file is still usable
+    EXPECT_EQ(alignment, 1);
+  }
+
+  AlignedBufferPool pool(64 * 1024 + 1, std::max<size_t>(alignment, 4096));
+  EXPECT_EQ(pool.bufferSize() % pool.alignment(), 0);
+  EXPECT_GE(pool.bufferSize(), 64 * 1024 + 1);
+  {
+    AlignedBuffer buffer = pool.acquire();
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(((uintptr_t) buffer.data()) % pool.alignment(), 0);
+    memset(buffer.data(), 'd', buffer.size());
+    EXPECT_EQ(file_handle->writeAt(buffer.data(), buffer.size(), 0), (int64_t) buffer.size());
+  }
+  {
+    AlignedBuffer buffer = pool.acquire();
+    memset(buffer.data(), 0, buffer.size());
+    EXPECT_EQ(file_handle->readAt(buffer.data(), buffer.size(), 0), (int64_t) buffer.size());
+    EXPECT_EQ(((const char *) buffer.data())[buffer.size() - 1], 'd');
+  }
+  EXPECT_EQ(file_handle->close(), 0);
+}
+
+#ifndef _WIN32
+TEST(FileHandleTest, directIoFallback) {
+  // character devices cannot do direct I/O: the open falls back to the page cache
+  auto null_handle = fs()->createFileHandle(Path::newFromUtf8("/dev/null"));
+  ASSERT_EQ(null_handle->open(jcu::file::MODE_WRITE | jcu::file::MODE_EXISTS | jcu::file::MODE_DIRECT), 0);
+  EXPECT_FALSE(null_handle->isDirect());
+  EXPECT_EQ(null_handle->getAlignment(), 1);
+  EXPECT_EQ(null_handle->write("x", 1), 1);
+  EXPECT_EQ(null_handle->close(), 0);
+
+  // creating opens must not leave a stray file behind whether or not the filesystem accepts it
+  TempDirectory scratch = makeScratchDir();
+  Path dir = scratch.path();
+  Path created = Path::join(dir, Path::newFromUtf8("created"));
+  auto created_handle = fs()->createFileHandle(created);
+  ASSERT_EQ(created_handle->open(jcu::file::MODE_CREATE_NEW | jcu::file::MODE_WRITE | jcu::file::MODE_DIRECT), 0);
+  EXPECT_EQ(created_handle->close(), 0);
+  Path replaced = Path::join(dir, Path::newFromUtf8("replaced"));
+  auto replaced_handle = fs()->createFileHandle(replaced);
+  ASSERT_EQ(replaced_handle->open(jcu::file::MODE_WRITE | jcu::file::ATOMIC_REPLACE | jcu::file::MODE_DIRECT), 0);
+  EXPECT_EQ(replaced_handle->commit(), 0);
+  EXPECT_EQ(replaced_handle->close(), 0);
+
+  std::list<Path> names;
+  EXPECT_EQ(fs()->readdir(names, dir), 0);
+  EXPECT_EQ(names.size(), 2u);
+}
+#endif
+
+TEST(FileHandleTest, alignedBufferPoolReuse) {
+  AlignedBufferPool pool(4096, 4096, 1);
+  void *first;
+  {
+    AlignedBuffer buffer = pool.acquire();
+    first = buffer.data();
+  }
+  AlignedBuffer again = pool.acquire();
+  EXPECT_EQ(again.data(), first);
+  AlignedBuffer other = pool.acquire();
+  EXPECT_NE(other.data(), first);
+
+  // buffers may outlive their pool
+  std::unique_ptr<AlignedBufferPool> short_lived(new AlignedBufferPool(8192));
+  AlignedBuffer orphan = short_lived->acquire();
+  short_lived.reset();
+  memset(orphan.data(), 0, orphan.size());
+  orphan.release();
+  EXPECT_FALSE(orphan);
+}
+
+TEST(FileHandleTest, accessHintsAndAdaptiveReadahead) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("stream"));
+  const int chunk = 64 * 1024;
+  const int chunks = 320;
+
+  {
+    auto file_handle = file_factory->createFileHandle(file_path);
+    ASSERT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+    std::vector<char> data(chunk);
+    for (int i = 0; i < chunks; i++) {
+      memset(data.data(), 'a' + (i % 26), data.size());
+      ASSERT_EQ(file_handle->write(data.data(), chunk), chunk);
+    }
+    EXPECT_EQ(file_handle->sync(true), 0);
+  }
+
+  auto file_handle = file_factory->createFileHandle(file_path);
+  ASSERT_EQ(file_handle->open(jcu::file::MODE_READ | jcu::file::HINT_SEQUENTIAL
+                                  | jcu::file::ADAPTIVE_READAHEAD | jcu::file::DROP_BEHIND), 0);
+  EXPECT_EQ(file_handle->advise(0, 0, jcu::file::ACCESS_RANDOM), 0);
+  EXPECT_EQ(file_handle->advise(0, 0, jcu::file::ACCESS_SEQUENTIAL), 0);
+  EXPECT_EQ(file_handle->prefetch(0, chunk), 0);
+  EXPECT_NE(file_handle->advise(0, 0, (jcu::file::AccessPattern) 100), 0);
+
+  // the hints never change what is read
+  std::vector<char> buffer(chunk);
+  for (int i = 0; i < chunks; i++) {
+    ASSERT_EQ(file_handle->read(buffer.data(), chunk), chunk);
+    EXPECT_EQ(buffer[0], 'a' + (i % 26));
+    EXPECT_EQ(buffer[chunk - 1], 'a' + (i % 26));
+    if (i == chunks / 2) {
+      // a positional read in the middle of the run does not move the cursor
+      EXPECT_EQ(file_handle->readAt(buffer.data(), 1, 0), 1);
+      EXPECT_EQ(buffer[0], 'a');
+    }
+  }
+  EXPECT_EQ(file_handle->read(buffer.data(), chunk), 0);
+  EXPECT_EQ(file_handle->advise(0, 0, jcu::file::ACCESS_DONTNEED), 0);
+}
+
+TEST(FileHandleTest, readAtWriteAtConcurrent) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("positional"));
+  const int block_size = 4096;
+  const int block_count = 64;
+
+  auto file_handle = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_READ | jcu::file::MODE_WRITE), 0);
+
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; t++) {
+    writers.emplace_back([&, t]() {
+      std::vector<unsigned char> block(block_size);
+      for (int i = t; i < block_count; i += 4) {
+        std::fill(block.begin(), block.end(), (unsigned char) i);
+        EXPECT_EQ(file_handle->writeAt(block.data(), block.size(), (int64_t) i * block_size), block_size);
+      }
+    });
+  }
+  for (auto &t : writers) t.join();
+  EXPECT_EQ(file_handle->getFileSize(), (int64_t) block_size * block_count);
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&, t]() {
+      std::vector<unsigned char> block(block_size);
+      for (int i = block_count - 1 - t; i >= 0; i -= 4) {
+        EXPECT_EQ(file_handle->readAt(block.data(), block.size(), (int64_t) i * block_size), block_size);
+        EXPECT_EQ(block.front(), (unsigned char) i);
+        EXPECT_EQ(block.back(), (unsigned char) i);
+      }
+    });
+  }
+  for (auto &t : readers) t.join();
+
+  char tail;
+  EXPECT_EQ(file_handle->readAt(&tail, 1, (int64_t) block_size * block_count), 0);
+}
+
+TEST(FileHandleTest, readAtWriteAtKeepCursor) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("cursor"));
+
+  auto file_handle = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_READ | jcu::file::MODE_WRITE), 0);
+  EXPECT_EQ(file_handle->write("hello", 5), 5);
+  EXPECT_EQ(file_handle->writeAt("tail", 4, 16), 4);
+  char buf[4];
+  EXPECT_EQ(file_handle->readAt(buf, 4, 16), 4);
+  // both left the cursor right after "hello"
+  EXPECT_EQ(file_handle->write("world", 5), 5);
+  EXPECT_EQ(readWhole(file_path).substr(0, 10), "helloworld");
+}
+
+TEST(FileHandleTest, writevReadvAt) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("vectored"));
+
+  auto file_handle = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_READ | jcu::file::MODE_WRITE), 0);
+
+  char header[] = "HEAD";
+  char payload[] = "payload";
+  char trailer[] = "TAIL";
+  IoVec out[] = {
+    {header, 4},
+    {payload, 7},
+    {trailer, 4},
+  };
+  EXPECT_EQ(file_handle->writev(out, 3), 15);
+  EXPECT_EQ(file_handle->write64("!", 1), 1);
+  EXPECT_EQ(file_handle->getFileSize(), 16);
+
+  char a[4] = {0};
+  char b[12] = {0};
+  IoVec in[] = {
+    {a, sizeof(a)},
+    {b, sizeof(b)},
+  };
+  EXPECT_EQ(file_handle->readvAt(in, 2, 0), 16);
+  EXPECT_EQ(std::string(a, 4), "HEAD");
+  EXPECT_EQ(std::string(b, 12), "payloadTAIL!");
+  EXPECT_EQ(file_handle->readvAt(in, 2, 11), 5);
+  EXPECT_EQ(std::string(a, 4), "TAIL");
+}
+
+} // namespace
+
+// MappedRegionTest
+namespace {
+
+#ifndef _WIN32
+TEST(MappedRegionTest, mapPathReadOnly) {
+  std::string test_dir = getTestFilesDir();
+  auto file_path = Path::join(Path::newFromUtf8(test_dir), Path::newFromUtf8("file-1"));
+
+  MappedRegion region;
+  EXPECT_EQ(region.map(file_path, MAP_MODE_READ_ONLY), 0);
+  EXPECT_TRUE(region.isMapped());
+  EXPECT_EQ(region.size(), 11);
+  EXPECT_EQ(region.advise(MAP_ADVICE_SEQUENTIAL), 0);
+
+  MappedRegion window;
+  EXPECT_EQ(window.map(file_path, MAP_MODE_READ_ONLY, 3, 4), 0);
+  EXPECT_EQ(window.size(), 4);
+  EXPECT_EQ(memcmp(window.data(), (const char *) region.data() + 3, 4), 0);
+
+  MappedRegion past_end;
+  EXPECT_EQ(past_end.map(file_path, MAP_MODE_READ_ONLY, 8, 4), EINVAL);
+  EXPECT_FALSE(past_end.isMapped());
+  EXPECT_EQ(past_end.map(file_path, MAP_MODE_READ_ONLY, 8, 3), 0);
+
+  MappedRegion empty;
+  EXPECT_NE(empty.map(Path::join(Path::newFromUtf8(test_dir), Path::newFromUtf8("file-2")), MAP_MODE_READ_ONLY), 0);
+  EXPECT_FALSE(empty.isMapped());
+}
+
+TEST(MappedRegionTest, mapHandlerReadWriteFlush) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("mapped"));
+  auto file_handle = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_READ | jcu::file::MODE_WRITE), 0);
+  std::vector<char> zeros(10000, '0');
+  EXPECT_EQ(file_handle->write64(zeros.data(), zeros.size()), 10000);
+
+  MappedRegion region;
+  EXPECT_EQ(region.map(*file_handle, MAP_MODE_READ_WRITE, 5000, 8), 0);
+  memcpy(region.data(), "mmapped!", 8);
+  EXPECT_EQ(region.flush(), 0);
+
+  MappedRegion moved(std::move(region));
+  EXPECT_FALSE(region.isMapped());
+  EXPECT_TRUE(moved.isMapped());
+  EXPECT_EQ(moved.unmap(), 0);
+
+  char buf[8];
+  EXPECT_EQ(file_handle->readAt(buf, sizeof(buf), 5000), 8);
+  EXPECT_EQ(std::string(buf, 8), "mmapped!");
+}
+#endif
+
+} // namespace
+
+// AsyncFileEngineTest
+namespace {
+
+void runAsyncEngineRoundTrip(AsyncEngineType type) {
+  AsyncEngineOptions options;
+  options.type = type;
+  options.queue_depth = 8;
+  options.threads = 2;
+  int err = 0;
+  auto engine = AsyncFileEngine::create(options, &err);
+  ASSERT_TRUE(engine != nullptr);
+  EXPECT_EQ(err, 0);
+  EXPECT_EQ(engine->type(), type);
+
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("async"));
+  auto file_handle = file_factory->createFileHandle(file_path);
+
+  auto opened = engine->open(*file_handle, jcu::file::MODE_CREATE | jcu::file::MODE_READ | jcu::file::MODE_WRITE);
+  EXPECT_EQ(engine->submit(), 0);
+  EXPECT_EQ(opened.get(), 0);
+  EXPECT_TRUE(file_handle->isOpen());
+
+  const int block_count = 32;
+  std::vector<std::vector<char>> blocks(block_count);
+  std::atomic<int> written(0);
+  for (int i = 0; i < block_count; i++) {
+    blocks[i].assign(512, (char) ('a' + (i % 26)));
+    EXPECT_EQ(engine->writeAt(*file_handle, blocks[i].data(), blocks[i].size(), (int64_t) i * 512, [&written](int64_t result) {
+      if (result == 512)
+        written++;
+    }), 0);
+  }
+  // queued in the same batch, the sync still runs after every write
+  std::atomic<int> written_before_sync(-1);
+  auto synced = engine->sync(*file_handle, true);
+  EXPECT_EQ(engine->sync(*file_handle, true, [&](int64_t) {
+    written_before_sync = written.load();
+  }), 0);
+  engine->drain();
+  EXPECT_EQ(written.load(), block_count);
+  EXPECT_EQ(written_before_sync.load(), block_count);
+  EXPECT_EQ(synced.get(), 0);
+  EXPECT_EQ(file_handle->getFileSize(), (int64_t) block_count * 512);
+
+  // the close waits for the reads queued with it
+  std::vector<char> buf(512 * 4);
+  std::vector<std::future<int64_t>> reads;
+  for (int i = 0; i < 4; i++) {
+    reads.push_back(engine->readAt(*file_handle, buf.data() + i * 512, 512, 512 * (27 + i)));
+  }
+  auto closed = engine->close(*file_handle);
+  engine->drain();
+  for (auto &read : reads) {
+    EXPECT_EQ(read.get(), 512);
+  }
+  EXPECT_EQ(buf[0], 'b');
+  EXPECT_EQ(buf[512 * 3], 'e');
+  EXPECT_EQ(closed.get(), 0);
+  EXPECT_FALSE(file_handle->isOpen());
+}
+
+// ATOMIC_REPLACE keeps the file for commit() when the engine closes it
+void runAsyncEngineAtomicReplace(AsyncEngineType type) {
+  AsyncEngineOptions options;
+  options.type = type;
+  int err = 0;
+  auto engine = AsyncFileEngine::create(options, &err);
+  ASSERT_TRUE(engine != nullptr);
+
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("replaced"));
+  writeFile(file_path, "old");
+
+  auto file_handle = file_factory->createFileHandle(file_path);
+  auto opened = engine->open(*file_handle, jcu::file::MODE_WRITE | jcu::file::ATOMIC_REPLACE);
+  EXPECT_EQ(engine->submit(), 0);
+  EXPECT_EQ(opened.get(), 0);
+  auto written = engine->writeAt(*file_handle, "new data", 8, 0);
+  auto closed = engine->close(*file_handle);
+  engine->drain();
+  EXPECT_EQ(written.get(), 8);
+  EXPECT_EQ(closed.get(), 0);
+  EXPECT_FALSE(file_handle->isOpen());
+  EXPECT_EQ(file_factory->getFileSize(file_path), 3);
+
+  EXPECT_EQ(file_handle->commit(), 0);
+  EXPECT_EQ(readWhole(file_path), "new data");
+}
+
+TEST(AsyncFileEngineTest, threadPool) {
+  runAsyncEngineRoundTrip(ASYNC_ENGINE_THREAD_POOL);
+  runAsyncEngineAtomicReplace(ASYNC_ENGINE_THREAD_POOL);
+}
+
+#if defined(__linux__)
+TEST(AsyncFileEngineTest, ioUring) {
+  AsyncEngineOptions options;
+  options.type = ASYNC_ENGINE_IO_URING;
+  int err = 0;
+  if (!AsyncFileEngine::create(options, &err)) {
+    GTEST_SKIP() << "io_uring not available: " << err;
+  }
+  runAsyncEngineRoundTrip(ASYNC_ENGINE_IO_URING);
+  runAsyncEngineAtomicReplace(ASYNC_ENGINE_IO_URING);
+}
+#endif
+
+} // namespace
+
+// BufferedStreamTest
+namespace {
+
+TEST(BufferedStreamTest, writeCommitAndReadBack) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("buffered"));
+  std::string big(100, 'x');
+
+  auto out_handle = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(out_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE | jcu::file::USE_TEMPNAME), 0);
+  {
+    BufferedWriter writer(*out_handle, 16);
+    EXPECT_EQ(writer.write("first line\n", 11), 11);
+    EXPECT_EQ(writer.write("second\r\n", 8), 8);
+    EXPECT_EQ(writer.write(big.data(), big.size()), 100);
+    EXPECT_EQ(writer.write("\nlast", 5), 5);
+    EXPECT_FALSE(file_factory->isFile(file_path));
+    EXPECT_EQ(writer.commit(), 0);
+  }
+  EXPECT_EQ(file_factory->getFileSize(file_path), 124);
+
+  auto in_handle = file_factory->createFileHandle(file_path);
+  EXPECT_EQ(in_handle->open(jcu::file::MODE_EXISTS | jcu::file::MODE_READ), 0);
+  BufferedReader reader(*in_handle, 16);
+  std::string line;
+
+  const void *peeked = NULL;
+  EXPECT_EQ(reader.peek(&peeked, 5), 5);
+  EXPECT_EQ(std::string((const char *) peeked, 5), "first");
+
+  EXPECT_EQ(reader.readLine(line), 11);
+  EXPECT_EQ(line, "first line");
+  EXPECT_EQ(reader.readLine(line), 8);
+  EXPECT_EQ(line, "second");
+
+  std::vector<char> buf(100);
+  EXPECT_EQ(reader.readExact(buf.data(), buf.size()), 100);
+  EXPECT_EQ(std::string(buf.data(), buf.size()), big);
+
+  EXPECT_EQ(reader.readLine(line), 1);
+  EXPECT_EQ(line, "");
+  EXPECT_EQ(reader.readLine(line), 4);
+  EXPECT_EQ(line, "last");
+  EXPECT_EQ(reader.readLine(line), 0);
+  EXPECT_EQ(reader.read(buf.data(), buf.size()), 0);
+}
+
+} // namespace
+
+// DirectoryIteratorTest
+namespace {
+
+#ifndef _WIN32
+TEST(DirectoryIteratorTest, entryTypes) {
+  std::string test_dir = getTestFilesDir();
+  DirectoryIterator iter;
+  EXPECT_EQ(iter.open(Path::newFromUtf8(test_dir), 4096), 0);
+
+  std::map<std::string, FileType> entries;
+  for (const DirectoryEntry &entry : iter) {
+    entries.emplace(std::string(entry.name()), entry.type());
+  }
+  EXPECT_EQ(iter.error(), 0);
+
+  EXPECT_EQ(entries.size(), 4);
+  ASSERT_TRUE(entries.count("file-1"));
+  ASSERT_TRUE(entries.count("dir-a"));
+  if (entries["file-1"] != FILE_TYPE_UNKNOWN) {
+    EXPECT_EQ(entries["file-1"], FILE_TYPE_REGULAR);
+    EXPECT_EQ(entries["dir-a"], FILE_TYPE_DIRECTORY);
+  }
+}
+
+TEST(DirectoryIteratorTest, manyEntriesSmallBuffer) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path dir = scratch.path();
+  for (int i = 0; i < 500; i++) {
+    auto file_handle = file_factory->createFileHandle(Path::join(dir, Path::newFromUtf8("entry-" + std::to_string(i))));
+    EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+  }
+
+  DirectoryIterator iter;
+  EXPECT_EQ(iter.open(dir, 4096), 0);
+  int count = 0;
+  while (iter.next()) {
+    EXPECT_EQ(iter.entry().name().substr(0, 6), "entry-");
+    count++;
+  }
+  EXPECT_EQ(iter.error(), 0);
+  EXPECT_EQ(count, 500);
+
+  DirectoryIterator missing;
+  EXPECT_NE(missing.open(Path::join(dir, Path::newFromUtf8("missing"))), 0);
+  EXPECT_TRUE(missing.begin() == missing.end());
+}
+#endif
+
+} // namespace
+
+// WalkTest
+namespace {
+
+#ifndef _WIN32
+TempDirectory makeWalkTree() {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  const char *dirs[] = {"a", "a/aa", "a/aa/aaa", "b", "b/bb", "c"};
+  for (const char *dir : dirs) {
+    EXPECT_EQ(file_factory->makeDirectory(Path::join(root, Path::newFromUtf8(dir))), 0);
+  }
+  const char *files[] = {"f0", "a/f1", "a/aa/f2", "a/aa/aaa/f3", "b/f4", "b/bb/f5", "c/f6"};
+  for (const char *file : files) {
+    auto file_handle = file_factory->createFileHandle(Path::join(root, Path::newFromUtf8(file)));
+    EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+  }
+  return scratch;
+}
+
+TEST(WalkTest, parallelVisitsEverything) {
+  TempDirectory scratch = makeWalkTree();
+  Path root = scratch.path();
+  std::string prefix = root.toUtf8() + "/";
+
+  std::mutex mutex;
+  std::set<std::string> seen;
+  WalkOptions options;
+  options.threads = 4;
+  EXPECT_EQ(walk(root, [&](const WalkEntry &entry) {
+    std::unique_lock<std::mutex> lock(mutex);
+    EXPECT_EQ(entry.path.substr(0, prefix.length()), prefix);
+    seen.emplace(std::string(entry.path.substr(prefix.length())));
+    return true;
+  }, options), 0);
+
+  EXPECT_EQ(seen.size(), 13);
+  EXPECT_TRUE(seen.count("a/aa/aaa/f3"));
+  EXPECT_TRUE(seen.count("b/bb"));
+}
+
+TEST(WalkTest, orderedWithDepthAndFilter) {
+  TempDirectory scratch = makeWalkTree();
+  Path root = scratch.path();
+  std::string prefix = root.toUtf8() + "/";
+
+  std::vector<std::string> seen;
+  WalkOptions options;
+  options.threads = 3;
+  options.ordered = true;
+  options.max_depth = 2;
+  options.directory_filter = [](const WalkEntry &dir) {
+    return dir.name != "b";
+  };
+  EXPECT_EQ(walk(root, [&](const WalkEntry &entry) {
+    seen.emplace_back(std::string(entry.path.substr(prefix.length())));
+    return true;
+  }, options), 0);
+
+  std::vector<std::string> expected = {"a", "a/aa", "a/f1", "b", "c", "c/f6", "f0"};
+  EXPECT_EQ(seen, expected);
+
+  EXPECT_NE(walk(Path::join(root, Path::newFromUtf8("missing")), [](const WalkEntry &) { return true; }), 0);
+}
+
+TEST(WalkTest, maxDepthLimitsVisitedEntries) {
+  TempDirectory scratch = makeWalkTree();
+  Path root = scratch.path();
+
+  WalkOptions options;
+  options.threads = 3;
+  options.max_depth = 0;
+  int visited = 0;
+  EXPECT_EQ(walk(root, [&](const WalkEntry &) {
+    visited++;
+    return true;
+  }, options), 0);
+  EXPECT_EQ(visited, 0);
+
+  options.max_depth = 1;
+  std::mutex mutex;
+  int deepest = 0;
+  EXPECT_EQ(walk(root, [&](const WalkEntry &entry) {
+    std::unique_lock<std::mutex> lock(mutex);
+    deepest = std::max(deepest, entry.depth);
+    return true;
+  }, options), 0);
+  EXPECT_EQ(deepest, 1);
+}
+#endif
+
+} // namespace
+
+// FileInfoTest
+namespace {
+
+TEST(FileInfoTest, statFileAndDirectory) {
+  std::string test_dir = getTestFilesDir();
+  auto file_factory = fs();
+
+  FileInfo info;
+  EXPECT_EQ(file_factory->stat(Path::join(Path::newFromUtf8(test_dir), Path::newFromUtf8("file-1")), info), 0);
+  EXPECT_EQ(info.type, FILE_TYPE_REGULAR);
+  EXPECT_EQ(info.size, 11);
+  EXPECT_GT(info.mtime_ns, 0);
+  EXPECT_NE(info.inode, 0);
+  EXPECT_GE(info.link_count, 1);
+  EXPECT_TRUE(info.isFile());
+
+  EXPECT_EQ(file_factory->stat(Path::join(Path::newFromUtf8(test_dir), Path::newFromUtf8("dir-a")), info), 0);
+  EXPECT_TRUE(info.isDirectory());
+
+  EXPECT_NE(file_factory->stat(Path::join(Path::newFromUtf8(test_dir), Path::newFromUtf8("missing")), info), 0);
+}
+
+TEST(FileInfoTest, cachedFactoryTtlAndInvalidate) {
+  CachedFileFactory cached(fs(), std::chrono::hours(1));
+  TempDirectory scratch = makeScratchDir();
+  auto file_path = Path::join(scratch.path(), Path::newFromUtf8("cached"));
+
+  EXPECT_FALSE(cached.isFile(file_path));
+  auto file_handle = cached.createFileHandle(file_path);
+  EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+  EXPECT_EQ(file_handle->write("abc", 3), 3);
+  file_handle->close();
+
+  // negative result is still cached
+  EXPECT_FALSE(cached.isFile(file_path));
+  cached.invalidate(file_path);
+  EXPECT_TRUE(cached.isFile(file_path));
+  EXPECT_EQ(cached.getFileSize(file_path), 3);
+
+  CachedFileFactory expiring(fs(), std::chrono::milliseconds(0));
+  EXPECT_EQ(expiring.getFileSize(file_path), 3);
+}
+
+TEST(FileInfoTest, cachedFactoryMoveDirectory) {
+  CachedFileFactory cached(fs(), std::chrono::hours(1));
+  TempDirectory scratch = makeScratchDir();
+  auto src_dir = Path::join(scratch.path(), Path::newFromUtf8("src"));
+  auto dst_dir = Path::join(scratch.path(), Path::newFromUtf8("dst"));
+  auto src_file = Path::join(src_dir, Path::newFromUtf8("file"));
+  auto dst_file = Path::join(dst_dir, Path::newFromUtf8("file"));
+  auto sibling = Path::join(scratch.path(), Path::newFromUtf8("srcfile"));
+  EXPECT_EQ(cached.makeDirectory(src_dir), 0);
+  writeFile(src_file, "abc");
+
+  EXPECT_TRUE(cached.isFile(src_file));
+  EXPECT_FALSE(cached.isFile(dst_file));
+  EXPECT_FALSE(cached.isFile(sibling));
+  writeFile(sibling, "x");
+  EXPECT_EQ(cached.moveFile(src_dir, dst_dir), 0);
+  EXPECT_FALSE(cached.isFile(src_file));
+  EXPECT_TRUE(cached.isFile(dst_file));
+  // only the moved subtree is dropped, a sibling sharing the prefix stays cached
+  EXPECT_FALSE(cached.isFile(sibling));
+}
+
+} // namespace
+
+// PathTableTest
+namespace {
+
+TEST(PathTableTest, addFindAndRebuild) {
+  PathTable table;
+  auto id = table.add(Path::newFromUtf8("/var/lib/jcu-file/data.bin"));
+  ASSERT_NE(id, PathTable::NO_ID);
+  EXPECT_EQ(table.path(id).toUtf8(), "/var/lib/jcu-file/data.bin");
+  EXPECT_EQ(table.name(id), "data.bin");
+  EXPECT_EQ(table.path(table.parent(id)).toUtf8(), "/var/lib/jcu-file");
+  EXPECT_EQ(table.size(), 5);
+
+  // shared prefixes and names are stored once
+  auto other = table.add(Path::newFromUtf8("/var/lib/other/data.bin"));
+  EXPECT_EQ(table.size(), 7);
+  EXPECT_EQ(table.add(Path::newFromUtf8("/var/lib/jcu-file/data.bin")), id);
+  EXPECT_EQ(table.find(Path::newFromUtf8("/var/lib/other/data.bin")), other);
+  EXPECT_EQ(table.find(Path::newFromUtf8("/var/lib/missing")), PathTable::NO_ID);
+
+  auto relative = table.add(Path::newFromUtf8("var/lib"));
+  EXPECT_NE(relative, table.parent(table.parent(id)));
+  EXPECT_EQ(table.path(relative).toUtf8(), "var/lib");
+}
+
+TEST(PathTableTest, manyEntries) {
+  PathTable table;
+  auto root = table.add(Path::newFromUtf8("/data"));
+  std::vector<PathTable::Id> ids;
+  for (int i = 0; i < 100000; i++) {
+    std::string name = "entry-" + std::to_string(i);
+    ids.push_back(table.add(root, name));
+  }
+  EXPECT_EQ(table.size(), 100002);
+  EXPECT_EQ(table.path(ids[12345]).toUtf8(), "/data/entry-12345");
+  EXPECT_EQ(table.find(Path::newFromUtf8("/data/entry-99999")), ids[99999]);
+  EXPECT_LT(table.memoryUsage() / table.size(), 64);
+}
+
+#ifndef _WIN32
+TEST(PathTableTest, fillFromReaddirAndWalk) {
+  TempDirectory scratch = makeWalkTree();
+  Path root = scratch.path();
+
+  PathTable listed;
+  auto dir = listed.add(root);
+  EXPECT_EQ(fs()->readdir(listed, dir), 0);
+  EXPECT_NE(listed.find(dir, "f0"), PathTable::NO_ID);
+  EXPECT_NE(listed.find(dir, "a"), PathTable::NO_ID);
+
+  PathTable walked;
+  PathTable::Id root_id = PathTable::NO_ID;
+  WalkOptions options;
+  options.threads = 4;
+  EXPECT_EQ(walk(root, walked, options, &root_id), 0);
+  EXPECT_EQ(walked.find(root), root_id);
+  auto leaf = walked.find(Path::join(root, Path::newFromUtf8("a/aa/aaa/f3")));
+  ASSERT_NE(leaf, PathTable::NO_ID);
+  EXPECT_EQ(walked.path(leaf).toUtf8(), root.toUtf8() + "/a/aa/aaa/f3");
+  EXPECT_EQ(walked.size(), listed.size() - 4 + 13);
+}
+#endif
+
+} // namespace
+
+// PathSetTest
+namespace {
+
+TEST(PathSetTest, equalityOrderingAndHash) {
+  auto a = Path::newFromUtf8("/var/lib/a");
+  auto a2 = Path::newFromUtf8(std::string("/var/lib/a"));
+  auto b = Path::newFromUtf8("/var/lib/b");
+  EXPECT_TRUE(a == a2);
+  EXPECT_TRUE(a != b);
+  EXPECT_TRUE(a < b);
+  EXPECT_EQ(std::hash<Path>()(a), std::hash<Path>()(a2));
+  EXPECT_EQ(a.hash(), a.hash());
+
+  Path copied(a);
+  EXPECT_EQ(copied.hash(), a.hash());
+  copied = b;
+  EXPECT_EQ(copied.hash(), b.hash());
+
+  auto messy = Path::newFromUtf8("/var//lib/./a/");
+  EXPECT_FALSE(a == messy);
+  EXPECT_EQ(a.compare(messy, true), 0);
+  EXPECT_LT(a.compare(b, true), 0);
+  EXPECT_NE(a.compare(Path::newFromUtf8("var/lib/a"), true), 0);
+  EXPECT_LT(Path::newFromUtf8("/var/lib").compare(a, true), 0);
+}
+
+TEST(PathSetTest, setAndMap) {
+  PathSet set;
+  EXPECT_TRUE(set.insert(Path::newFromUtf8("/a")));
+  EXPECT_FALSE(set.insert(Path::newFromUtf8("/a")));
+  EXPECT_TRUE(set.contains(Path::newFromUtf8("/a")));
+  EXPECT_FALSE(set.contains(Path::newFromUtf8("/b")));
+
+  PathMap<int> map;
+  for (int i = 0; i < 10000; i++) {
+    map[Path::newFromUtf8("/data/" + std::to_string(i))] = i;
+  }
+  EXPECT_EQ(map.size(), 10000);
+  for (int i = 0; i < 10000; i += 2) {
+    EXPECT_TRUE(map.erase(Path::newFromUtf8("/data/" + std::to_string(i))));
+  }
+  EXPECT_EQ(map.size(), 5000);
+  for (int i = 0; i < 10000; i++) {
+    const int *value = map.find(Path::newFromUtf8("/data/" + std::to_string(i)));
+    if (i % 2) {
+      ASSERT_NE(value, nullptr);
+      EXPECT_EQ(*value, i);
+    } else {
+      EXPECT_EQ(value, nullptr);
+    }
+  }
+  EXPECT_FALSE(map.insert(Path::newFromUtf8("/data/1"), 100));
+  EXPECT_EQ(map[Path::newFromUtf8("/data/1")], 1);
+
+  int sum = 0;
+  for (const auto &entry : map) {
+    sum += entry.second;
+  }
+  EXPECT_EQ(sum, 25000000);
+}
+
+} // namespace
+
+// DurabilityBatchTest
+namespace {
+
+TEST(DurabilityBatchTest, flushFilesAndDirectories) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path dir = scratch.path();
+
+  std::vector<std::unique_ptr<FileHandler>> handles;
+  DurabilityBatch batch(4);
+  std::atomic<int> callbacks(0);
+  for (int i = 0; i < 16; i++) {
+    handles.emplace_back(file_factory->createFileHandle(Path::join(dir, Path::newFromUtf8("shard-" + std::to_string(i)))));
+    EXPECT_EQ(handles.back()->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+    EXPECT_EQ(handles.back()->write("data", 4), 4);
+    batch.add(*handles.back(), true, [&](int64_t result) {
+      EXPECT_EQ(result, 0);
+      callbacks++;
+    });
+    batch.addDirectory(dir);
+  }
+  EXPECT_EQ(batch.size(), 32);
+  EXPECT_EQ(batch.flush(), 0);
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(callbacks.load(), 16);
+
+  batch.addDirectory(Path::join(dir, Path::newFromUtf8("missing")), [&](int64_t result) {
+    EXPECT_LT(result, 0);
+    callbacks++;
+  });
+  EXPECT_NE(batch.flush(), 0);
+  EXPECT_EQ(callbacks.load(), 17);
+}
+
+TEST(DurabilityBatchTest, schedulerGroupCommit) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path dir = scratch.path();
+
+  SyncSchedulerOptions options;
+  options.max_delay = std::chrono::milliseconds(1000);
+  options.max_pending = 8;
+  SyncScheduler scheduler(options);
+
+  std::vector<std::unique_ptr<FileHandler>> handles;
+  std::atomic<int> callbacks(0);
+  for (int i = 0; i < 8; i++) {
+    handles.emplace_back(file_factory->createFileHandle(Path::join(dir, Path::newFromUtf8("f" + std::to_string(i)))));
+    EXPECT_EQ(handles.back()->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+    scheduler.submit(*handles.back(), true, [&](int64_t result) {
+      EXPECT_EQ(result, 0);
+      callbacks++;
+    });
+  }
+  // max_pending reached: committed without waiting for max_delay
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+  while (callbacks.load() < 8 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(callbacks.load(), 8);
+
+  scheduler.submitDirectory(dir, [&](int64_t result) {
+    EXPECT_EQ(result, 0);
+    callbacks++;
+  });
+  scheduler.flush();
+  EXPECT_EQ(callbacks.load(), 9);
+}
+
+} // namespace
+
+// CopyFileTest
+namespace {
+
+TEST(CopyFileTest, copyAndMove) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path dir = scratch.path();
+  auto src = Path::join(dir, Path::newFromUtf8("src"));
+  auto dst = Path::join(dir, Path::newFromUtf8("dst"));
+  auto moved = Path::join(dir, Path::newFromUtf8("moved"));
+
+  std::string data;
+  for (int i = 0; i < 100000; i++) {
+    data.push_back((char) ('a' + i % 26));
+  }
+  writeFile(src, data);
+
+  EXPECT_EQ(file_factory->copyFile(src, dst), 0);
+  EXPECT_EQ(readWhole(dst), data);
+  EXPECT_NE(file_factory->copyFile(src, dst), 0);
+  EXPECT_EQ(file_factory->copyFile(src, dst, COPY_OVERWRITE | COPY_NO_REFLINK), 0);
+  EXPECT_EQ(readWhole(dst), data);
+  EXPECT_NE(file_factory->copyFile(src, src, COPY_OVERWRITE), 0);
+  EXPECT_EQ(readWhole(src), data);
+
+  EXPECT_NE(file_factory->moveFile(dst, src), 0);
+  EXPECT_EQ(file_factory->moveFile(dst, moved), 0);
+  EXPECT_FALSE(file_factory->isFile(dst));
+  EXPECT_EQ(readWhole(moved), data);
+  EXPECT_EQ(file_factory->moveFile(moved, src, COPY_OVERWRITE), 0);
+  EXPECT_EQ(readWhole(src), data);
+}
+
+#ifndef _WIN32
+TEST(CopyFileTest, sparseAndMetadata) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path dir = scratch.path();
+  auto src = Path::join(dir, Path::newFromUtf8("sparse"));
+  auto dst = Path::join(dir, Path::newFromUtf8("sparse-copy"));
+  const int64_t hole_offset = 64LL << 20;
+
+  auto file_handle = file_factory->createFileHandle(src);
+  EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+  EXPECT_EQ(file_handle->writeAt("head", 4, 0), 4);
+  EXPECT_EQ(file_handle->writeAt("tail", 4, hole_offset), 4);
+  file_handle->close();
+  ASSERT_EQ(::chmod(src.getSystemString().c_str(), 0640), 0);
+
+  EXPECT_EQ(file_factory->copyFile(src, dst, COPY_NO_REFLINK | COPY_PRESERVE_METADATA), 0);
+
+  FileInfo src_info, dst_info;
+  EXPECT_EQ(file_factory->stat(src, src_info), 0);
+  EXPECT_EQ(file_factory->stat(dst, dst_info), 0);
+  EXPECT_EQ(dst_info.size, hole_offset + 4);
+  EXPECT_EQ(dst_info.permissions, 0640);
+  EXPECT_EQ(dst_info.mtime_ns, src_info.mtime_ns);
+
+  struct stat st;
+  ASSERT_EQ(::stat(dst.getSystemString().c_str(), &st), 0);
+  EXPECT_LT((int64_t) st.st_blocks * 512, hole_offset);
+
+  char buf[4];
+  auto reader = file_factory->createFileHandle(dst);
+  EXPECT_EQ(reader->open(jcu::file::MODE_EXISTS | jcu::file::MODE_READ), 0);
+  EXPECT_EQ(reader->readAt(buf, 4, hole_offset), 4);
+  EXPECT_EQ(std::string(buf, 4), "tail");
+  EXPECT_EQ(reader->readAt(buf, 4, 0), 4);
+  EXPECT_EQ(std::string(buf, 4), "head");
+}
+#endif
+
+} // namespace
+
+// TempFileServiceTest
+namespace {
+
+TEST(TempFileServiceTest, scopedFilesAndDirectories) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  TempFileService service(scratch.path());
+  Path file_path;
+  {
+    TempFile temp;
+    ASSERT_EQ(service.createFile(temp, "scratch-"), 0);
+    file_path = temp.path();
+    EXPECT_TRUE(file_factory->isFile(file_path));
+#ifndef _WIN32
+    struct stat st;
+    ASSERT_EQ(::stat(file_path.getSystemString().c_str(), &st), 0);
+    EXPECT_EQ(st.st_mode & 0777, 0600u);
+#endif
+    EXPECT_EQ(temp->write("data", 4), 4);
+    EXPECT_EQ(file_factory->getFileSize(file_path), 4);
+  }
+  EXPECT_FALSE(file_factory->isFile(file_path));
+
+  {
+    TempFile temp;
+    ASSERT_EQ(service.createFile(temp), 0);
+    file_path = temp.path();
+    auto handler = temp.keep();
+    EXPECT_TRUE(handler->isOpen());
+  }
+  EXPECT_TRUE(file_factory->isFile(file_path));
+
+  {
+    TempFile temp;
+    ASSERT_EQ(service.createAnonymousFile(temp), 0);
+    EXPECT_TRUE(temp.path().isEmpty());
+    EXPECT_EQ(temp->writeAt("anon", 4, 0), 4);
+    char buf[4];
+    EXPECT_EQ(temp->readAt(buf, 4, 0), 4);
+    EXPECT_EQ(std::string(buf, 4), "anon");
+  }
+
+  Path dir_path;
+  {
+    TempDirectory temp;
+    ASSERT_EQ(service.createDirectory(temp, "dir-"), 0);
+    dir_path = temp.path();
+    Path nested = Path::join(dir_path, Path::newFromUtf8("a/b"));
+    EXPECT_EQ(file_factory->makeDirectory(nested, true), 0);
+    auto file_handle = file_factory->createFileHandle(Path::join(nested, Path::newFromUtf8("f")));
+    EXPECT_EQ(file_handle->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+    file_handle->close();
+  }
+  EXPECT_FALSE(file_factory->isDirectory(dir_path));
+}
+
+TEST(TempFileServiceTest, concurrentCreate) {
+  TempDirectory scratch = makeScratchDir();
+  TempFileService service(scratch.path());
+  const int threads = 8;
+  const int per_thread = 200;
+  std::mutex mutex;
+  std::set<Path> names;
+  std::atomic<int> failures(0);
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&]() {
+      std::vector<TempFile> files(per_thread);
+      for (auto &file : files) {
+        if (service.createFile(file, "c-") != 0)
+          failures++;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto &file : files)
+        names.insert(file.path());
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  EXPECT_EQ(failures.load(), 0);
+  EXPECT_EQ(names.size(), (size_t) threads * per_thread);
+
+  // every file was removed with its scope
+  std::list<Path> left;
+  EXPECT_EQ(fs()->readdir(left, service.directory()), 0);
+  EXPECT_TRUE(left.empty());
+}
+
+} // namespace
+
+#ifndef _WIN32
+// DirectoryTest
+namespace {
+
+TEST(DirectoryTest, relativeOperations) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  Directory dir;
+  ASSERT_EQ(dir.open(root), 0);
+  EXPECT_TRUE(dir.isOpen());
+
+  EXPECT_EQ(dir.makeDirectory(Path::newFromUtf8("sub")), 0);
+  EXPECT_NE(dir.makeDirectory(Path::newFromUtf8("sub")), 0);
+
+  std::unique_ptr<FileHandler> file_handle;
+  ASSERT_EQ(dir.openFile(Path::newFromUtf8("sub/a.txt"), jcu::file::MODE_CREATE | jcu::file::MODE_WRITE, file_handle), 0);
+  EXPECT_EQ(file_handle->write("hello", 5), 5);
+  EXPECT_EQ(file_handle->close(), 0);
+  EXPECT_EQ(file_factory->getFileSize(Path::join(root, Path::newFromUtf8("sub/a.txt"))), 5);
+
+  Directory sub;
+  ASSERT_EQ(dir.openDirectory(Path::newFromUtf8("sub"), sub), 0);
+  EXPECT_EQ(sub.path(), Path::join(root, Path::newFromUtf8("sub")));
+  FileInfo info;
+  EXPECT_EQ(sub.stat(Path::newFromUtf8("a.txt"), info), 0);
+  EXPECT_TRUE(info.isFile());
+  EXPECT_EQ(info.size, 5);
+  EXPECT_NE(sub.stat(Path::newFromUtf8("missing"), info), 0);
+
+  // USE_TEMPNAME still commits under the right name
+  ASSERT_EQ(sub.openFile(Path::newFromUtf8("b.txt"), jcu::file::MODE_CREATE | jcu::file::MODE_WRITE | jcu::file::USE_TEMPNAME, file_handle), 0);
+  EXPECT_EQ(file_handle->write("b", 1), 1);
+  EXPECT_EQ(file_handle->close(), 0);
+  EXPECT_EQ(file_handle->commit(), 0);
+  EXPECT_EQ(sub.stat(Path::newFromUtf8("b.txt"), info), 0);
+
+  EXPECT_EQ(sub.rename(Path::newFromUtf8("a.txt"), Path::newFromUtf8("c.txt")), 0);
+  EXPECT_EQ(sub.rename(Path::newFromUtf8("c.txt"), dir, Path::newFromUtf8("d.txt")), 0);
+  EXPECT_EQ(dir.stat(Path::newFromUtf8("d.txt"), info), 0);
+
+  std::set<std::string> names;
+  DirectoryIterator iter;
+  ASSERT_EQ(dir.list(iter), 0);
+  for (const DirectoryEntry &entry : iter) {
+    names.insert(std::string(entry.name()));
+  }
+  EXPECT_EQ(iter.error(), 0);
+  EXPECT_EQ(names, (std::set<std::string>{"d.txt", "sub"}));
+
+  EXPECT_NE(dir.removeDirectory(Path::newFromUtf8("sub")), 0);
+  EXPECT_EQ(sub.unlink(Path::newFromUtf8("b.txt")), 0);
+  EXPECT_EQ(dir.removeDirectory(Path::newFromUtf8("sub")), 0);
+  EXPECT_EQ(dir.unlink(Path::newFromUtf8("d.txt")), 0);
+  EXPECT_FALSE(file_factory->isDirectory(Path::join(root, Path::newFromUtf8("sub"))));
+}
+
+} // namespace
+#endif
+
+#if defined(__linux__)
+// FileWatcherTest
+namespace {
+
+// Merge batches until `path` shows up or the time runs out
+int collectEvents(FileWatcher &watcher, const Path &path, std::map<Path, int> &seen) {
+  std::vector<WatchEvent> batch;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (std::chrono::steady_clock::now() < deadline) {
+    EXPECT_EQ(watcher.readEvents(batch, 200), 0);
+    for (const WatchEvent &event : batch)
+      seen[event.path] |= event.events;
+    if (seen.count(path))
+      return seen[path];
+  }
+  return 0;
+}
+
+TEST(FileWatcherTest, coalescesEvents) {
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  FileWatcherOptions options;
+  options.coalesce_window = std::chrono::milliseconds(100);
+  FileWatcher watcher(options);
+  ASSERT_EQ(watcher.add(root), 0);
+  EXPECT_GE(watcher.fd(), 0);
+
+  Path transient = Path::join(root, Path::newFromUtf8("transient"));
+  Path kept = Path::join(root, Path::newFromUtf8("kept"));
+  writeFile(transient, "x");
+  ASSERT_EQ(::unlink(transient.getSystemString().c_str()), 0);
+  writeFile(kept, "hello");
+
+  std::map<Path, int> seen;
+  int events = collectEvents(watcher, kept, seen);
+  EXPECT_TRUE(events & WATCH_CREATED);
+  EXPECT_TRUE(events & WATCH_CLOSED_WRITE);
+  EXPECT_EQ(seen.count(transient), 0);
+
+  EXPECT_EQ(watcher.remove(root), 0);
+  EXPECT_NE(watcher.remove(root), 0);
+}
+
+TEST(FileWatcherTest, recursiveFollowsNewDirectories) {
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  FileWatcher watcher;
+  ASSERT_EQ(watcher.add(root, true), 0);
+
+  Path sub = Path::join(root, Path::newFromUtf8("sub"));
+  ASSERT_EQ(fs()->makeDirectory(sub), 0);
+  Path inner = Path::join(sub, Path::newFromUtf8("inner"));
+  writeFile(inner, "data");
+
+  std::map<Path, int> seen;
+  EXPECT_TRUE(collectEvents(watcher, inner, seen) & WATCH_CREATED);
+  EXPECT_TRUE(seen[sub] & WATCH_CREATED);
+
+  // the new directory is watched from now on
+  seen.clear();
+  Path later = Path::join(sub, Path::newFromUtf8("later"));
+  writeFile(later, "data");
+  EXPECT_TRUE(collectEvents(watcher, later, seen) & WATCH_CREATED);
+}
+
+TEST(FileWatcherTest, callback) {
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  FileWatcherOptions options;
+  options.coalesce_window = std::chrono::milliseconds(10);
+  FileWatcher watcher(options);
+  ASSERT_EQ(watcher.add(root), 0);
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::set<Path> seen;
+  ASSERT_EQ(watcher.start([&](const std::vector<WatchEvent> &events) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const WatchEvent &event : events)
+      seen.insert(event.path);
+    cv.notify_all();
+  }), 0);
+
+  Path file = Path::join(root, Path::newFromUtf8("file"));
+  writeFile(file, "x");
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    EXPECT_TRUE(cv.wait_for(lock, std::chrono::seconds(5), [&]() { return seen.count(file) > 0; }));
+  }
+  watcher.stop();
+}
+
+TEST(FileWatcherTest, callbackAfterCancelledWindow) {
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  FileWatcherOptions options;
+  options.coalesce_window = std::chrono::milliseconds(50);
+  FileWatcher watcher(options);
+  ASSERT_EQ(watcher.add(root), 0);
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::set<Path> seen;
+  ASSERT_EQ(watcher.start([&](const std::vector<WatchEvent> &events) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const WatchEvent &event : events)
+      seen.insert(event.path);
+    cv.notify_all();
+  }), 0);
+
+  // the window ends with nothing to deliver; the next event needs a new timer
+  Path transient = Path::join(root, Path::newFromUtf8("transient"));
+  writeFile(transient, "x");
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(::unlink(transient.getSystemString().c_str()), 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+  Path file = Path::join(root, Path::newFromUtf8("file"));
+  writeFile(file, "x");
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    EXPECT_TRUE(cv.wait_for(lock, std::chrono::seconds(2), [&]() { return seen.count(file) > 0; }));
+    EXPECT_EQ(seen.count(transient), 0);
+  }
+  watcher.stop();
+}
+
+} // namespace
+#endif
+
+// FileHasherTest
+namespace {
+
+std::string hashHex(HashAlgorithm algorithm, const std::string &data) {
+  Hasher hasher(algorithm);
+  hasher.update(data.data(), data.size());
+  return hasher.digest().toHex();
+}
+
+std::string patternData(size_t size) {
+  std::string data(size, '\0');
+  uint32_t x = 2463534242u;
+  for (size_t i = 0; i < size; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    data[i] = (char) x;
+  }
+  return data;
+}
+
+TEST(FileHasherTest, knownVectors) {
+  EXPECT_EQ(hashHex(HASH_CRC32C, ""), "00000000");
+  EXPECT_EQ(hashHex(HASH_CRC32C, "123456789"), "e3069283");
+  EXPECT_EQ(hashHex(HASH_XXH3_64, ""), "2d06800538d394c2");
+  EXPECT_EQ(hashHex(HASH_XXH3_64, "abc"), "78af5f94892f3950");
+  EXPECT_EQ(hashHex(HASH_SHA256, ""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  EXPECT_EQ(hashHex(HASH_SHA256, "abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+  HashValue parsed;
+  EXPECT_TRUE(HashValue::fromHex(HASH_CRC32C, "E3069283", parsed));
+  EXPECT_EQ(parsed.toHex(), "e3069283");
+  EXPECT_FALSE(HashValue::fromHex(HASH_SHA256, "e3069283", parsed));
+}
+
+TEST(FileHasherTest, incrementalMatchesOneShot) {
+  std::string data = patternData(100003);
+  for (int algorithm = HASH_CRC32C; algorithm <= HASH_SHA256; algorithm++) {
+    std::string expected = hashHex((HashAlgorithm) algorithm, data);
+    Hasher hasher((HashAlgorithm) algorithm);
+    size_t piece = 1;
+    for (size_t offset = 0; offset < data.size(); piece = piece * 3 + 1) {
+      size_t n = std::min(piece % 4099, data.size() - offset);
+      hasher.update(data.data() + offset, n);
+      offset += n;
+    }
+    EXPECT_EQ(hasher.digest().toHex(), expected) << Hasher::kernelName((HashAlgorithm) algorithm);
+  }
+
+  Hasher a(HASH_CRC32C), b(HASH_CRC32C), whole(HASH_CRC32C);
+  a.update(data.data(), 777);
+  b.update(data.data() + 777, data.size() - 777);
+  whole.update(data.data(), data.size());
+  HashValue value_a = a.digest(), value_b = b.digest();
+  uint32_t crc_a = (value_a.bytes[0] << 24) | (value_a.bytes[1] << 16) | (value_a.bytes[2] << 8) | value_a.bytes[3];
+  uint32_t crc_b = (value_b.bytes[0] << 24) | (value_b.bytes[1] << 16) | (value_b.bytes[2] << 8) | value_b.bytes[3];
+  char combined[16];
+  snprintf(combined, sizeof(combined), "%08x", Hasher::crc32cCombine(crc_a, crc_b, data.size() - 777));
+  EXPECT_EQ(std::string(combined), whole.digest().toHex());
+}
+
+TEST(FileHasherTest, filesAndParallelChunks) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path file_path = Path::join(scratch.path(), Path::newFromUtf8("data"));
+  std::string data = patternData(3 * 1024 * 1024 + 123);
+  auto writer = file_factory->createFileHandle(file_path);
+  ASSERT_EQ(writer->open(jcu::file::MODE_CREATE | jcu::file::MODE_WRITE), 0);
+  ASSERT_EQ(writer->write64(data.data(), data.size()), (int64_t) data.size());
+  writer->close();
+
+  FileHasherOptions options;
+  // several buffers so the reader thread runs
+  options.buffer_size = 256 * 1024;
+  for (int algorithm = HASH_CRC32C; algorithm <= HASH_SHA256; algorithm++) {
+    HashValue value;
+    EXPECT_EQ(FileHasher((HashAlgorithm) algorithm, options).hash(file_path, value), 0);
+    EXPECT_EQ(value.toHex(), hashHex((HashAlgorithm) algorithm, data));
+  }
+
+  options.threads = 4;
+  options.parallel_threshold = 1;
+  options.chunk_size = 512 * 1024;
+  HashValue value;
+  EXPECT_EQ(FileHasher(HASH_CRC32C, options).hash(file_path, value), 0);
+  EXPECT_EQ(value.toHex(), hashHex(HASH_CRC32C, data));
+
+  EXPECT_NE(FileHasher(HASH_CRC32C).hash(Path::join(file_path, Path::newFromUtf8("missing")), value), 0);
+}
+
+TEST(FileHasherTest, commitVerified) {
+  auto file_factory = fs();
+  TempDirectory scratch = makeScratchDir();
+  Path file_path = Path::join(scratch.path(), Path::newFromUtf8("target"));
+  std::string data = patternData(10000);
+  HashValue expected;
+  ASSERT_TRUE(HashValue::fromHex(HASH_SHA256, hashHex(HASH_SHA256, data), expected));
+  FileHasher hasher(HASH_SHA256);
+
+  HashValue wrong = expected;
+  wrong.bytes[0] ^= 1;
+  auto handler = file_factory->createFileHandle(file_path);
+  ASSERT_EQ(handler->open(jcu::file::MODE_READ | jcu::file::MODE_WRITE | jcu::file::USE_TEMPNAME), 0);
+  ASSERT_EQ(handler->write64(data.data(), data.size()), (int64_t) data.size());
+  EXPECT_EQ(hasher.commitVerified(*handler, wrong), EBADMSG);
+  EXPECT_FALSE(file_factory->isFile(file_path));
+
+  EXPECT_EQ(hasher.commitVerified(*handler, expected), 0);
+  handler->close();
+  EXPECT_TRUE(file_factory->isFile(file_path));
+  HashValue value;
+  EXPECT_EQ(hasher.hash(file_path, value), 0);
+  EXPECT_EQ(value, expected);
+}
+
+} // namespace
+
+#ifndef _WIN32
+// TreeSnapshotTest
+namespace {
+
+// move a directory's mtime out of the window that forces a rescan
+void ageDirectory(const Path &path) {
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = ::time(NULL) - 3600;
+  times[0].tv_nsec = times[1].tv_nsec = 0;
+  ASSERT_EQ(::utimensat(AT_FDCWD, path.getSystemString().c_str(), times, 0), 0);
+}
+
+std::string describe(const std::vector<SnapshotDiff> &changes) {
+  std::string text;
+  for (const SnapshotDiff &change : changes) {
+    text += (change.change == SNAPSHOT_ADDED) ? "+" : (change.change == SNAPSHOT_REMOVED) ? "-" : "*";
+    text += change.path.toUtf8() + " ";
+  }
+  return text;
+}
+
+TEST(TreeSnapshotTest, scanSaveAndLoad) {
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  ASSERT_EQ(fs()->makeDirectory(Path::join(root, Path::newFromUtf8("a/b")), true), 0);
+  writeFile(Path::join(root, Path::newFromUtf8("a/b/file")), "12345");
+  writeFile(Path::join(root, Path::newFromUtf8("top")), "x");
+
+  TreeSnapshot snapshot;
+  ASSERT_EQ(snapshot.scan(root), 0);
+  EXPECT_EQ(snapshot.size(), 5u);
+  EXPECT_EQ(snapshot.listedDirectories(), 3u);
+  uint32_t file = snapshot.find(Path::newFromUtf8("a/b/file"));
+  ASSERT_NE(file, TreeSnapshot::NO_ENTRY);
+  EXPECT_EQ(snapshot.entry(file).size, 5);
+  EXPECT_EQ(snapshot.entry(file).type, (uint32_t) FILE_TYPE_REGULAR);
+  EXPECT_EQ(snapshot.relativePath(file).toUtf8(), "a/b/file");
+  EXPECT_EQ(snapshot.find(Path::newFromUtf8("a/missing")), TreeSnapshot::NO_ENTRY);
+
+  TempDirectory index_dir = makeScratchDir();
+  Path index_path = Path::join(index_dir.path(), Path::newFromUtf8("index"));
+  ASSERT_EQ(snapshot.save(index_path), 0);
+  TreeSnapshot loaded;
+  ASSERT_EQ(loaded.load(index_path), 0);
+  EXPECT_EQ(loaded.size(), snapshot.size());
+  EXPECT_EQ(loaded.root(), root);
+  EXPECT_EQ(loaded.scanTime(), snapshot.scanTime());
+  EXPECT_EQ(loaded.entry(loaded.find(Path::newFromUtf8("top"))).size, 1);
+
+  std::vector<SnapshotDiff> changes;
+  TreeSnapshot::diff(snapshot, loaded, changes);
+  EXPECT_TRUE(changes.empty());
+
+  writeFile(index_path, "not a snapshot, just some bytes to fill the header");
+  EXPECT_EQ(loaded.load(index_path), EINVAL);
+}
+
+TEST(TreeSnapshotTest, rescanListsChangedDirectories) {
+  TempDirectory scratch = makeScratchDir();
+  Path root = scratch.path();
+  const char *dirs[] = {"d1", "d2", "d3", "d4"};
+  for (const char *dir : dirs) {
+    Path dir_path = Path::join(root, Path::newFromUtf8(dir));
+    ASSERT_EQ(fs()->makeDirectory(dir_path), 0);
+    writeFile(Path::join(dir_path, Path::newFromUtf8("f")), "data");
+    ageDirectory(dir_path);
+  }
+  ageDirectory(root);
+
+  TreeSnapshot before;
+  ASSERT_EQ(before.scan(root), 0);
+  TempDirectory index_dir = makeScratchDir();
+  Path index_path = Path::join(index_dir.path(), Path::newFromUtf8("index"));
+  ASSERT_EQ(before.save(index_path), 0);
+  ASSERT_EQ(before.load(index_path), 0);
+
+  TreeSnapshot after;
+  ASSERT_EQ(after.rescan(before), 0);
+  EXPECT_EQ(after.listedDirectories(), 0u);
+
+  writeFile(Path::join(root, Path::newFromUtf8("d1/new")), "n");
+  writeFile(Path::join(root, Path::newFromUtf8("d2/f")), "longer data");
+  ASSERT_EQ(::unlink(Path::join(root, Path::newFromUtf8("d3/f")).getSystemString().c_str()), 0);
+  ASSERT_EQ(fs()->makeDirectory(Path::join(root, Path::newFromUtf8("d4/sub"))), 0);
+  writeFile(Path::join(root, Path::newFromUtf8("d4/sub/g")), "g");
+
+  ASSERT_EQ(after.rescan(before), 0);
+  // d1, d3, d4 and the new d4/sub
+  EXPECT_EQ(after.listedDirectories(), 4u);
+  std::vector<SnapshotDiff> changes;
+  TreeSnapshot::diff(before, after, changes);
+  EXPECT_EQ(describe(changes), "+d1/new *d2/f -d3/f +d4/sub +d4/sub/g ");
+
+  // the same tree from scratch gives the same answer
+  TreeSnapshot full;
+  ASSERT_EQ(full.scan(root), 0);
+  changes.clear();
+  TreeSnapshot::diff(after, full, changes);
+  EXPECT_TRUE(changes.empty()) << describe(changes);
+
+  // without stat'ing unchanged directories the content change goes unseen
+  TreeSnapshotOptions options;
+  options.stat_unchanged = false;
+  TreeSnapshot quick;
+  ASSERT_EQ(quick.rescan(before, options), 0);
+  changes.clear();
+  TreeSnapshot::diff(before, quick, changes);
+  EXPECT_EQ(describe(changes), "+d1/new -d3/f +d4/sub +d4/sub/g ");
+}
+
 } // namespace
+#endif